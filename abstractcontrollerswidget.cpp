@@ -80,10 +80,10 @@ void AbstractControllersWidget::sendController(const QString &name, int value) {
     }
     else if (controller.type == Controller::NRPNType) {
         if (controller.hires) {
-            FP4App()->fp4()->sendNRPN(m_channel, controller.address.msb, controller.address.msb, value);
+            FP4App()->fp4()->sendNRPNHires(m_channel, controller.address.msb, controller.address.lsb, value);
         }
         else {
-            FP4App()->fp4()->sendNRPN(m_channel, controller.address.msb, controller.address.msb, value);
+            FP4App()->fp4()->sendNRPN(m_channel, controller.address.msb, controller.address.lsb, value);
         }
     }
     else {
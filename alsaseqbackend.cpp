@@ -0,0 +1,59 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "alsaseqbackend.h"
+
+int AlsaSeqBackend::output(snd_seq_event_t *ev, bool buffered) {
+    if (buffered) {
+        return snd_seq_event_output_buffer(m_seq, ev);
+    }
+
+    return snd_seq_event_output_direct(m_seq, ev);
+}
+
+int AlsaSeqBackend::flush() {
+    return snd_seq_drain_output(m_seq);
+}
+
+int AlsaSeqBackend::input(snd_seq_event_t **ev) {
+    return snd_seq_event_input(m_seq, ev);
+}
+
+bool AlsaSeqBackend::inputPending() {
+    return snd_seq_event_input_pending(m_seq, 0) > 0;
+}
+
+int AlsaSeqBackend::pollDescriptors(struct pollfd *pfds, int space) {
+    int count = snd_seq_poll_descriptors_count(m_seq, POLLIN);
+    if (count > space) {
+        count = space;
+    }
+
+    return snd_seq_poll_descriptors(m_seq, pfds, count, POLLIN);
+}
+
+int AlsaSeqBackend::removeScheduled(int queue, int tag) {
+    snd_seq_remove_events_t* remove;
+    snd_seq_remove_events_alloca(&remove);
+    snd_seq_remove_events_set_condition(remove, SND_SEQ_REMOVE_OUTPUT | SND_SEQ_REMOVE_TAG_MATCH);
+    snd_seq_remove_events_set_queue(remove, queue);
+    snd_seq_remove_events_set_tag(remove, tag);
+    return snd_seq_remove_events(m_seq, remove);
+}
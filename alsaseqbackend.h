@@ -0,0 +1,46 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Exchange events through the ALSA sequencer. The sequencer handle is owned
+   by FP4, which also creates the ports and connections. */
+
+#ifndef ALSASEQBACKEND_H
+#define ALSASEQBACKEND_H
+
+#include "midibackend.h"
+
+class AlsaSeqBackend : public MidiBackend {
+public:
+    explicit AlsaSeqBackend(snd_seq_t* seq) : m_seq(seq) {}
+
+    const char* name() const { return "seq"; }
+
+    int output(snd_seq_event_t* ev, bool buffered);
+    int flush();
+    int input(snd_seq_event_t** ev);
+    bool inputPending();
+    int pollDescriptors(struct pollfd* pfds, int space);
+    int removeScheduled(int queue, int tag);
+
+private:
+    snd_seq_t* m_seq;
+};
+
+#endif // ALSASEQBACKEND_H
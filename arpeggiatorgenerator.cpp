@@ -0,0 +1,409 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "arpeggiatorgenerator.h"
+#include "fp4qt.h"
+#include <QtWidgets>
+#include <algorithm>
+#include <math.h>
+
+// how far ahead notes are put on the output queue, in ms
+#define ARPEGGIO_LOOKAHEAD 500
+
+// interval at which the output queue is topped up, in ms. The GUI can be
+// busy for the lookahead minus this interval before notes come late.
+#define ARPEGGIO_REFILL_INTERVAL 100
+
+// allowed difference between queueNow() and the sequencer queue, in us
+#define ARPEGGIO_CLOCK_MARGIN 2000
+
+// shortest note, in us
+#define ARPEGGIO_MIN_NOTE_LENGTH 1000
+
+enum ArpeggioMode {
+    ArpeggioUp,
+    ArpeggioDown,
+    ArpeggioUpDown,
+    ArpeggioRandom,
+    ArpeggioChord
+};
+
+// steps per quarter note, in the order of the division combo
+static const int s_stepsPerBeat[] = { 1, 2, 3, 4, 6, 8 };
+
+ArpeggiatorGenerator::ArpeggiatorGenerator(FP4Qt *fp4, int channel, QWidget *parent) :
+    ControllerGenerator(fp4, channel, parent),
+    m_synced(false),
+    m_nextStep(0),
+    m_nextPatternIndex(0),
+    m_nextStepTime(0),
+    m_outputChannel(0)
+{
+    memset(m_velocities, 0, sizeof(m_velocities));
+
+    m_scheduleTag = m_fp4->allocateScheduleTag();
+
+    m_scheduleTimer = new QTimer(this);
+    m_scheduleTimer->setInterval(ARPEGGIO_REFILL_INTERVAL);
+    connect(m_scheduleTimer, SIGNAL(timeout()), SLOT(schedule()));
+}
+
+QString ArpeggiatorGenerator::description() const {
+    return QString("<p>Play the held notes one after the other, at a fixed tempo or in time with "
+                   "incoming MIDI clock.</p>"
+                   "<p>Notes are scheduled ahead on the sequencer queue and go straight to the "
+                   "output channel, without splits or mappings.</p>");
+}
+
+QString ArpeggiatorGenerator::configName() const {
+    return QString("Arpeggio");
+}
+
+QWidget *ArpeggiatorGenerator::buildOptionsWidget() {
+    QWidget* widget = new QWidget;
+    QGridLayout* layout = new QGridLayout;
+    layout->setMargin(0);
+    layout->setColumnStretch(1, 1);
+    widget->setLayout(layout);
+
+    QLabel* channelLabel = new QLabel("Output &Channel:");
+    layout->addWidget(channelLabel, 0, 0);
+    m_outputChannelSpinBox = new QSpinBox;
+    m_outputChannelSpinBox->setRange(1, 16);
+    m_outputChannelSpinBox->setValue(m_channel+1);
+    channelLabel->setBuddy(m_outputChannelSpinBox);
+    layout->addWidget(m_outputChannelSpinBox, 0, 1);
+
+    QLabel* modeLabel = new QLabel("&Mode:");
+    layout->addWidget(modeLabel, 1, 0);
+    m_modeCombo = new QComboBox;
+    m_modeCombo->addItems(QStringList() << "Up" << "Down" << "Up and down" << "Random" << "Chord");
+    modeLabel->setBuddy(m_modeCombo);
+    layout->addWidget(m_modeCombo, 1, 1);
+
+    QLabel* rateLabel = new QLabel("&Rate:");
+    layout->addWidget(rateLabel, 2, 0);
+    QWidget* rateWidget = new QWidget;
+    QHBoxLayout* rateHBox = new QHBoxLayout;
+    rateHBox->setMargin(0);
+    rateWidget->setLayout(rateHBox);
+    m_divisionCombo = new QComboBox;
+    m_divisionCombo->addItems(QStringList() << "1/4" << "1/8" << "1/8 triplets" << "1/16" << "1/16 triplets" << "1/32");
+    m_divisionCombo->setCurrentIndex(3);
+    rateLabel->setBuddy(m_divisionCombo);
+    rateHBox->addWidget(m_divisionCombo);
+    m_tempoSpinBox = new QSpinBox;
+    m_tempoSpinBox->setRange(MIN_CLOCK_TEMPO, MAX_CLOCK_TEMPO);
+    m_tempoSpinBox->setValue(120);
+    m_tempoSpinBox->setSuffix(" BPM");
+    rateHBox->addWidget(m_tempoSpinBox);
+    m_syncCheckBox = new QCheckBox("S&ync to MIDI clock");
+    m_syncCheckBox->setToolTip("Follow the tempo and beat of incoming MIDI clock when there is one");
+    rateHBox->addWidget(m_syncCheckBox);
+    rateHBox->addStretch();
+    layout->addWidget(rateWidget, 2, 1);
+
+    QLabel* gateLabel = new QLabel("&Gate %:");
+    layout->addWidget(gateLabel, 3, 0);
+    m_gateSlider = new QSlider(Qt::Horizontal);
+    m_gateSlider->setRange(5, 100);
+    m_gateSlider->setValue(50);
+    gateLabel->setBuddy(m_gateSlider);
+    layout->addWidget(m_gateSlider, 3, 1);
+
+    QLabel* swingLabel = new QLabel("S&wing %:");
+    layout->addWidget(swingLabel, 4, 0);
+    m_swingSlider = new QSlider(Qt::Horizontal);
+    m_swingSlider->setRange(0, 50);         // delay of every second step
+    m_swingSlider->setValue(0);
+    swingLabel->setBuddy(m_swingSlider);
+    layout->addWidget(m_swingSlider, 4, 1);
+
+    if (!m_fp4->hasQueue()) {
+        QLabel* warning = new QLabel("The sequencer queue is not available, the arpeggiator is silent.");
+        warning->setWordWrap(true);
+        layout->addWidget(warning, 5, 0, 1, 2);
+    }
+
+    m_configMap["Output Channel"] = m_outputChannelSpinBox;
+    m_configMap["Mode"] = m_modeCombo;
+    m_configMap["Division"] = m_divisionCombo;
+    m_configMap["Tempo"] = m_tempoSpinBox;
+    m_configMap["Sync"] = m_syncCheckBox;
+    m_configMap["Gate"] = m_gateSlider;
+    m_configMap["Swing"] = m_swingSlider;
+
+    return widget;
+}
+
+void ArpeggiatorGenerator::onNoteOnEvent(int channel, int note, int velocity) {
+    if (channel != m_channel || !m_fp4->hasQueue()) {
+        return;
+    }
+
+    m_velocities[note] = velocity;
+
+    QList<int>::iterator it = std::lower_bound(m_heldNotes.begin(), m_heldNotes.end(), note);
+    if (it != m_heldNotes.end() && *it == note) {
+        return;
+    }
+    m_heldNotes.insert(it, note);
+
+    if (m_heldNotes.count() == 1) {
+        start();
+    }
+    else {
+        reschedule();
+    }
+}
+
+void ArpeggiatorGenerator::onNoteOffEvent(int channel, int note) {
+    if (channel != m_channel) {
+        return;
+    }
+
+    if (!m_heldNotes.removeOne(note)) {
+        return;
+    }
+
+    if (m_heldNotes.isEmpty()) {
+        stop();
+    }
+    else {
+        reschedule();
+    }
+}
+
+void ArpeggiatorGenerator::onEnabledStateChange(bool enabled) {
+    if (!enabled) {
+        m_heldNotes.clear();
+        stop();
+    }
+}
+
+/* start the pattern with the first held note */
+void ArpeggiatorGenerator::start() {
+    m_outputChannel = m_outputChannelSpinBox->value()-1;
+    m_nextPatternIndex = 0;
+    restartGrid(m_fp4->queueNow());
+    schedule();
+    m_scheduleTimer->start();
+}
+
+/* remove notes that aren't played yet, and end the one that plays */
+void ArpeggiatorGenerator::stop() {
+    m_scheduleTimer->stop();
+    unschedule(true);
+}
+
+/* The held notes changed. Scheduled steps that haven't started are
+   scheduled again with the new notes, without moving the grid. */
+void ArpeggiatorGenerator::reschedule() {
+    uint64_t now = m_fp4->queueNow();
+    foreach(const ScheduledNote& scheduled, m_scheduledNotes) {
+        if (scheduled.on > now + ARPEGGIO_CLOCK_MARGIN) {
+            m_nextStep = scheduled.step;
+            m_nextPatternIndex = scheduled.patternIndex;
+            m_nextStepTime = scheduled.gridTime;
+            break;
+        }
+    }
+
+    unschedule(false);
+    schedule();
+}
+
+/* Remove every scheduled note from the output queue. Notes that may be
+   playing already are released now, or at the end of their step if release
+   is false. */
+void ArpeggiatorGenerator::unschedule(bool release) {
+    m_fp4->cancelScheduled(m_scheduleTag);
+
+    // read after cancelling, so nothing later than this was delivered
+    uint64_t now = m_fp4->queueNow();
+
+    if (release) {
+        m_fp4->releaseScheduledNotes(m_outputChannel);
+        m_scheduledNotes.clear();
+        return;
+    }
+
+    // a note off of a note that wasn't played is ignored
+    FP4OutputBatch batch(m_fp4);
+    QList<ScheduledNote> playing;
+    foreach(const ScheduledNote& scheduled, m_scheduledNotes) {
+        if (scheduled.on > now + ARPEGGIO_CLOCK_MARGIN || scheduled.off + ARPEGGIO_CLOCK_MARGIN < now) {
+            continue;
+        }
+
+        m_fp4->sendNoteOffAt(scheduled.off, m_outputChannel, scheduled.note, m_scheduleTag, false);
+        playing << scheduled;
+    }
+
+    m_scheduledNotes = playing;
+}
+
+/* Put the steps of the next ARPEGGIO_LOOKAHEAD ms on the output queue. The
+   sequencer plays them on time whatever this thread is doing, and the
+   number of wakeups doesn't depend on the rate. */
+void ArpeggiatorGenerator::schedule() {
+    if (m_heldNotes.isEmpty()) {
+        return;
+    }
+
+    uint64_t now = m_fp4->queueNow();
+
+    while (!m_scheduledNotes.isEmpty() && m_scheduledNotes.first().off + ARPEGGIO_CLOCK_MARGIN < now) {
+        m_scheduledNotes.removeFirst();
+    }
+
+    // clock started or stopped, or this thread was too late to keep up
+    if (isSynced() != m_synced || m_nextStepTime + ARPEGGIO_CLOCK_MARGIN < now) {
+        restartGrid(qMax(m_nextStepTime, now));
+    }
+
+    uint64_t horizon = now + ARPEGGIO_LOOKAHEAD * 1000;
+    int gate = m_gateSlider->value();
+    int swing = m_swingSlider->value();
+
+    FP4OutputBatch batch(m_fp4);
+    while (m_nextStepTime < horizon) {
+        uint64_t duration = stepDuration();
+        uint64_t gridTime = m_nextStepTime;
+        uint64_t nextGridTime = m_synced ? syncedStepTime(m_nextStep + 1, now) : gridTime + duration;
+        if (nextGridTime <= gridTime) {
+            nextGridTime = gridTime + duration;
+        }
+
+        uint64_t delay = duration * swing / 100;
+        uint64_t on = gridTime + ((m_nextStep & 1) ? delay : 0);
+        uint64_t nextOn = nextGridTime + (((m_nextStep + 1) & 1) ? delay : 0);
+        uint64_t length = (nextOn - on) * gate / 100;
+        length = qBound<uint64_t>(ARPEGGIO_MIN_NOTE_LENGTH, length, nextOn - on);
+
+        foreach(int note, stepNotes(m_nextPatternIndex)) {
+            m_fp4->sendNoteOnAt(on, m_outputChannel, note, m_velocities[note], m_scheduleTag, false);
+            m_fp4->sendNoteOffAt(on + length, m_outputChannel, note, m_scheduleTag, false);
+
+            ScheduledNote scheduled;
+            scheduled.step = m_nextStep;
+            scheduled.patternIndex = m_nextPatternIndex;
+            scheduled.gridTime = gridTime;
+            scheduled.on = on;
+            scheduled.off = on + length;
+            scheduled.note = note;
+            m_scheduledNotes << scheduled;
+        }
+
+        ++m_nextStep;
+        ++m_nextPatternIndex;
+        m_nextStepTime = nextGridTime;
+    }
+}
+
+/* Find the first step at or after time from. With MIDI clock this is the
+   next step on the beat grid, otherwise the grid starts at from. */
+void ArpeggiatorGenerator::restartGrid(uint64_t from) {
+    m_synced = isSynced();
+
+    if (!m_synced) {
+        m_nextStep = 0;
+        m_nextStepTime = from;
+        return;
+    }
+
+    const TempoTracker& tempo = m_fp4->tempoTracker();
+    uint64_t now = m_fp4->queueNow();
+    double beats = 0;
+    tempo.position(now, beats);
+    beats += ((double)from - (double)now) / tempo.beatDuration();
+
+    m_nextStep = (int64_t)ceil(beats * stepsPerBeat());
+    m_nextStepTime = syncedStepTime(m_nextStep, now);
+}
+
+bool ArpeggiatorGenerator::isSynced() const {
+    const TempoTracker& tempo = m_fp4->tempoTracker();
+    return m_syncCheckBox->isChecked() && tempo.isLocked() && tempo.isRunning();
+}
+
+int ArpeggiatorGenerator::stepsPerBeat() const {
+    return s_stepsPerBeat[qBound(0, m_divisionCombo->currentIndex(), 5)];
+}
+
+/* step length at the current tempo in us */
+uint64_t ArpeggiatorGenerator::stepDuration() const {
+    uint64_t beat = 0;
+    if (m_syncCheckBox->isChecked()) {
+        beat = m_fp4->tempoTracker().beatDuration();
+    }
+    if (beat == 0) {
+        beat = 60000000 / m_tempoSpinBox->value();
+    }
+    return beat / stepsPerBeat();
+}
+
+/* queue time of a step of the beat grid, as predicted from incoming clock */
+uint64_t ArpeggiatorGenerator::syncedStepTime(int64_t step, uint64_t now) const {
+    const TempoTracker& tempo = m_fp4->tempoTracker();
+    double beats = 0;
+    tempo.position(now, beats);
+
+    double time = (double)now + ((double)step / stepsPerBeat() - beats) * tempo.beatDuration();
+    return time > (double)now ? (uint64_t)time : now;
+}
+
+/* notes played by the step at patternIndex since the arpeggio started */
+QList<int> ArpeggiatorGenerator::stepNotes(int patternIndex) const {
+    QList<int> notes;
+    int count = m_heldNotes.count();
+
+    switch (m_modeCombo->currentIndex()) {
+    case ArpeggioDown:
+        notes << m_heldNotes.at(count - 1 - patternIndex % count);
+        break;
+
+    case ArpeggioUpDown: {
+        if (count == 1) {
+            notes << m_heldNotes.at(0);
+            break;
+        }
+        int period = 2 * count - 2;
+        int index = patternIndex % period;
+        notes << m_heldNotes.at(index < count ? index : period - index);
+        break;
+    }
+
+    case ArpeggioRandom:
+        notes << m_heldNotes.at(qrand() % count);
+        break;
+
+    case ArpeggioChord:
+        notes = m_heldNotes;
+        break;
+
+    case ArpeggioUp:
+    default:
+        notes << m_heldNotes.at(patternIndex % count);
+        break;
+    }
+
+    return notes;
+}
@@ -0,0 +1,102 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#ifndef ARPEGGIATORGENERATOR_H
+#define ARPEGGIATORGENERATOR_H
+
+#include "controllergenerator.h"
+#include <QList>
+#include <inttypes.h>
+
+class FP4Qt;
+class QSpinBox;
+class QComboBox;
+class QCheckBox;
+class QSlider;
+class QTimer;
+
+// play the held notes one after the other
+class ArpeggiatorGenerator : public ControllerGenerator {
+    Q_OBJECT
+public:
+    ArpeggiatorGenerator(FP4Qt* fp4, int channel, QWidget* parent);
+    QString description() const;
+    QString configName() const;
+
+protected:
+    QWidget* buildOptionsWidget();
+
+protected slots:
+    void onNoteOnEvent(int channel, int note, int velocity);
+    void onNoteOffEvent(int channel, int note);
+    void onEnabledStateChange(bool enabled);
+
+    void schedule();
+
+private:
+    // a note put on the output queue
+    struct ScheduledNote {
+        int64_t step;
+        int patternIndex;
+        uint64_t gridTime;      // us, time of the step without swing
+        uint64_t on;            // us
+        uint64_t off;           // us
+        int note;
+    };
+
+    void start();
+    void stop();
+    void reschedule();
+    void unschedule(bool release);
+    void restartGrid(uint64_t from);
+
+    bool isSynced() const;
+    int stepsPerBeat() const;
+    uint64_t stepDuration() const;
+    uint64_t syncedStepTime(int64_t step, uint64_t now) const;
+    QList<int> stepNotes(int patternIndex) const;
+
+private:
+    QSpinBox* m_outputChannelSpinBox;
+    QComboBox* m_modeCombo;
+    QComboBox* m_divisionCombo;
+    QSpinBox* m_tempoSpinBox;
+    QCheckBox* m_syncCheckBox;
+    QSlider* m_gateSlider;
+    QSlider* m_swingSlider;
+
+    int m_scheduleTag;
+    QTimer* m_scheduleTimer;
+
+    // held notes sorted by pitch, and their velocities
+    QList<int> m_heldNotes;
+    int m_velocities[128];
+
+    // next step to schedule
+    bool m_synced;
+    int64_t m_nextStep;
+    int m_nextPatternIndex;
+    uint64_t m_nextStepTime;
+
+    QList<ScheduledNote> m_scheduledNotes;
+    int m_outputChannel;
+};
+
+#endif
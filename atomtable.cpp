@@ -0,0 +1,50 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "atomtable.h"
+
+int AtomTable::atom(const QString &string) {
+    auto it = m_atoms.constFind(string);
+    if (it != m_atoms.constEnd()) {
+        return it.value();
+    }
+
+    int atom = m_strings.count();
+    m_strings.append(string);
+    m_atoms.insert(string, atom);
+    return atom;
+}
+
+int AtomTable::find(const QString &string) const {
+    return m_atoms.value(string, -1);
+}
+
+QString AtomTable::string(int atom) const {
+    if (atom < 0 || atom >= m_strings.count()) {
+        return QString();
+    }
+
+    return m_strings.at(atom);
+}
+
+AtomTable &AtomTable::bindingNames() {
+    static AtomTable table;
+    return table;
+}
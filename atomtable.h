@@ -0,0 +1,56 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Intern strings as compact integer ids (atoms), so they can be compared and
+   hashed without looking at their characters. Atoms are never released: the
+   table grows with the number of distinct strings, which is fixed for the
+   names it is used for.
+
+   The table is not thread safe.
+*/
+
+#ifndef ATOMTABLE_H
+#define ATOMTABLE_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class AtomTable
+{
+public:
+    // return the atom of a string, adding it to the table if needed
+    int atom(const QString& string);
+
+    // return the atom of a string, or -1 if it was never interned
+    int find(const QString& string) const;
+
+    QString string(int atom) const;
+    int count() const { return m_strings.count(); }
+
+    // cc_group and cc_name of bindable widgets. Only used by the GUI thread.
+    static AtomTable& bindingNames();
+
+private:
+    QHash<QString, int> m_atoms;
+    QVector<QString> m_strings;
+};
+
+#endif // ATOMTABLE_H
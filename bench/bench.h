@@ -0,0 +1,89 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Helpers shared by the benchmarks. A benchmark is a console program that
+   runs a piece of FP4 Manager many times and prints the time per run.
+   Output goes to a NullBackend, so the device and the sequencer are not
+   part of the timings.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "midibackend.h"
+#include <chrono>
+#include <stdio.h>
+
+// discards output, and counts events and writes to the device. An event
+// that is not buffered is a write of its own, buffered events are written
+// by the next flush.
+class NullBackend : public MidiBackend {
+public:
+    NullBackend() : events(0), writes(0) {}
+
+    const char* name() const { return "null"; }
+
+    int output(snd_seq_event_t* ev, bool buffered) {
+        (void)ev;
+        ++events;
+        if (!buffered) {
+            ++writes;
+        }
+        return 0;
+    }
+
+    int flush() {
+        ++writes;
+        return 0;
+    }
+
+    int input(snd_seq_event_t** ev) {
+        (void)ev;
+        return -EAGAIN;
+    }
+
+    bool inputPending() { return false; }
+    int pollDescriptors(struct pollfd* pfds, int space) { (void)pfds; (void)space; return 0; }
+
+    long events;
+    long writes;
+};
+
+// wall clock time since construction or the last restart()
+class Stopwatch {
+public:
+    Stopwatch() { restart(); }
+
+    void restart() { m_start = std::chrono::steady_clock::now(); }
+
+    double elapsedNs() const {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+/* print the time per run of a benchmark that ran count times */
+static inline void report(const char* name, long count, double ns) {
+    printf("%-40s %10ld runs %12.1f ns/run\n", name, count, ns / count);
+}
+
+#endif // BENCH_H
@@ -0,0 +1,23 @@
+# The MIDI core of FP4 Manager without the GUI, shared by the benchmarks.
+
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+
+SOURCES += \
+    $$PWD/../fp4hw.cpp \
+    $$PWD/../fp4memorymap.cpp \
+    $$PWD/../dt1transaction.cpp \
+    $$PWD/../sysexpacer.cpp \
+    $$PWD/../tempotracker.cpp \
+    $$PWD/../latencystats.cpp \
+    $$PWD/../alsaseqbackend.cpp
+
+HEADERS += \
+    $$PWD/bench.h
+
+QMAKE_CXXFLAGS += -std=c++0x
+LIBS += -lasound -lpthread
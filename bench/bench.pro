@@ -0,0 +1,8 @@
+# Benchmarks of FP4 Manager. Build them in a separate directory with
+# "qmake bench/bench.pro" and run the programs, they print their timings.
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    dt1 \
+    bindings
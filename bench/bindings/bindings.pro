@@ -0,0 +1,22 @@
+TARGET = bindingsbench
+
+include(../bench.pri)
+
+# FP4Qt and the binding tables need QtWidgets
+CONFIG += qt
+QT += widgets
+
+SOURCES += \
+    bindingsbench.cpp \
+    $$PWD/../../fp4qt.cpp \
+    $$PWD/../../midithread.cpp \
+    $$PWD/../../controllerbinding.cpp \
+    $$PWD/../../channeltransform.cpp \
+    $$PWD/../../controllerparser.cpp \
+    $$PWD/../../controlrateengine.cpp \
+    $$PWD/../../atomtable.cpp
+
+HEADERS += \
+    $$PWD/../../fp4qt.h \
+    $$PWD/../../midithread.h \
+    $$PWD/../../channeltransform.h
@@ -0,0 +1,78 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Loading a binding preset with 1,000 entries, binding the widgets as they
+   are created, looking up the controller of every widget and deleting the
+   widgets, as opening and closing a window does. */
+
+#include "bench.h"
+#include "fp4qt.h"
+#include <QApplication>
+#include <QSlider>
+
+static const int BINDINGS = 1000;
+static const int LOOKUP_RUNS = 100;
+
+int main(int argc, char* argv[]) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    FP4Qt fp4("bindingsbench", 0, new NullBackend);
+
+    // the preset is loaded before the widgets exist
+    Stopwatch watch;
+    for (int i=0; i<BINDINGS; ++i) {
+        BindingInfo binding("bench", QString("p%1").arg(i));
+        fp4.addControllerBinding(ControllerInfo(i / 128, i % 128), binding);
+    }
+    report("load preset", BINDINGS, watch.elapsedNs());
+
+    QList<QSlider*> sliders;
+    for (int i=0; i<BINDINGS; ++i) {
+        QSlider* slider = new QSlider;
+        slider->setProperty("cc_group", "bench");
+        slider->setProperty("cc_name", QString("p%1").arg(i));
+        sliders.append(slider);
+    }
+
+    watch.restart();
+    foreach (QSlider* slider, sliders) {
+        fp4.registerBindableWidget(slider);
+    }
+    report("register widget", BINDINGS, watch.elapsedNs());
+
+    int found = 0;
+    watch.restart();
+    for (int run=0; run<LOOKUP_RUNS; ++run) {
+        foreach (QSlider* slider, sliders) {
+            if (fp4.controlledWidgetInfo(slider) != ControllerInfo::Invalid) {
+                ++found;
+            }
+        }
+    }
+    report("controlledWidgetInfo", (long)LOOKUP_RUNS * BINDINGS, watch.elapsedNs());
+
+    watch.restart();
+    qDeleteAll(sliders);
+    report("delete widget", BINDINGS, watch.elapsedNs());
+
+    printf("  bound: %i of %i\n", found / LOOKUP_RUNS, BINDINGS);
+    return 0;
+}
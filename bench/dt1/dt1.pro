@@ -0,0 +1,6 @@
+TARGET = dt1bench
+
+include(../bench.pri)
+
+SOURCES += \
+    dt1bench.cpp
@@ -0,0 +1,132 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Cost of building and sending DT1 messages, with the number of heap
+   allocations per message, and the number of device writes saved by
+   batching output. */
+
+#include "bench.h"
+#include "fp4hw.h"
+#include "dt1message.h"
+#include <new>
+#include <stdlib.h>
+
+static const long RUNS = 1000000;
+
+// heap allocations made by the program
+static long s_allocations = 0;
+
+void* operator new(size_t size) {
+    ++s_allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+/* build single byte and 32 byte messages without sending them */
+static void benchBuilder() {
+    unsigned checksums = 0;
+    uint8_t data[32];
+    for (unsigned i=0; i<sizeof(data); ++i) {
+        data[i] = i;
+    }
+
+    long allocations = s_allocations;
+    Stopwatch watch;
+    for (long i=0; i<RUNS; ++i) {
+        unsigned char buffer[DT1_BYTE_MESSAGE_SIZE];
+        fillDT1ByteMessage(buffer, 0x40, 0x01, 0x30, i & 0x7f);
+        checksums += buffer[DT1_BYTE_MESSAGE_SIZE - 2];
+    }
+    report("fillDT1ByteMessage", RUNS, watch.elapsedNs());
+
+    watch.restart();
+    for (long i=0; i<RUNS; ++i) {
+        DT1Message message(0x40, 0x01, 0x31);
+        data[0] = i & 0x7f;
+        message.append(data, sizeof(data));
+        checksums += message.finish()[message.messageLength() - 2];
+    }
+    report("DT1Message, 32 bytes", RUNS, watch.elapsedNs());
+
+    printf("  allocations: %ld (checksums %u)\n", s_allocations - allocations, checksums);
+}
+
+/* FP4::sendDataByte() to the backend, as an effect slider drag does */
+static void benchSendDataByte(FP4& fp4) {
+    long allocations = s_allocations;
+    Stopwatch watch;
+    for (long i=0; i<RUNS; ++i) {
+        fp4.sendDataByte(0x40, 0x01, 0x30, i & 0x7f);
+    }
+    report("FP4::sendDataByte", RUNS, watch.elapsedNs());
+    printf("  allocations per message: %.3f\n", (double)(s_allocations - allocations) / RUNS);
+}
+
+/* controllers sent one by one, and in batches of 16 */
+static void benchBatching(FP4& fp4, NullBackend* backend) {
+    long writes = backend->writes;
+    Stopwatch watch;
+    for (long i=0; i<RUNS; ++i) {
+        fp4.sendController(i & 0xf, 7, i & 0x7f);
+    }
+    report("FP4::sendController", RUNS, watch.elapsedNs());
+    printf("  device writes: %ld\n", backend->writes - writes);
+
+    writes = backend->writes;
+    watch.restart();
+    for (long i=0; i<RUNS; i+=16) {
+        FP4OutputBatch batch(&fp4);
+        for (int channel=0; channel<16; ++channel) {
+            fp4.sendController(channel, 7, (i >> 4) & 0x7f);
+        }
+    }
+    report("FP4::sendController, batches of 16", RUNS, watch.elapsedNs());
+    printf("  device writes: %ld\n", backend->writes - writes);
+}
+
+int main() {
+    NullBackend* backend = new NullBackend;
+    FP4 fp4("dt1bench", backend);
+
+    // every message goes to the backend
+    fp4.setSysexBudget(0);
+    fp4.setMemoryMapEnabled(false);
+
+    benchBuilder();
+    benchSendDataByte(fp4);
+    benchBatching(fp4, backend);
+
+    return 0;
+}
@@ -57,11 +57,11 @@ QVariant MidiBindingTableModel::data(const QModelIndex &index, int role) const {
     case 0:
         return m_bindings[index.row()].controller.channel + 1;
     case 1:
-        return m_bindings[index.row()].controller.cc;
+        return m_bindings[index.row()].controller.description();
     case 2:
-        return m_bindings[index.row()].binding.group;
+        return m_bindings[index.row()].binding.group();
     case 3:
-        return m_bindings[index.row()].binding.name;
+        return m_bindings[index.row()].binding.name();
     case 4:
         return m_bindings[index.row()].binding.minValue;
     case 5:
@@ -103,6 +103,14 @@ int MidiBindingTableModel::findBinding(const ControllerInfo &controller) {
         : it - m_bindings.constBegin();
 }
 
+ControllerInfo MidiBindingTableModel::controllerAt(int row) const {
+    if (row < 0 || row >= m_bindings.count()) {
+        return ControllerInfo::Invalid;
+    }
+
+    return m_bindings[row].controller;
+}
+
 void MidiBindingTableModel::populate() {
     const BindingConfigMap& bindings = m_fp4->bindingConfigMap();
 
@@ -457,13 +465,7 @@ void BindingManagerWindow::editCurrentBinding() {
         return;
     }
 
-    int row = idx.row();
-    idx = m_bindingTable->index(row, 0);
-    int channel = m_bindingTable->data(idx, Qt::DisplayRole).value<int>() - 1;
-    idx = m_bindingTable->index(row, 1);
-    int cc = m_bindingTable->data(idx, Qt::DisplayRole).value<int>();
-
-    ControllerInfo controller(channel, cc);
+    ControllerInfo controller = m_bindingTable->controllerAt(idx.row());
     BindingInfo bindingInfo = m_fp4->bindingConfigMap().value(controller);
     MidiControllerBinding binding(controller, bindingInfo);
 
@@ -486,13 +488,7 @@ void BindingManagerWindow::deleteCurrentBinding() {
         return;
     }
 
-    int row = idx.row();
-    idx = m_bindingTable->index(row, 0);
-    int channel = m_bindingTable->data(idx, Qt::DisplayRole).value<int>() - 1;
-    idx = m_bindingTable->index(row, 1);
-    int cc = m_bindingTable->data(idx, Qt::DisplayRole).value<int>();
-
-    m_fp4->deleteControllerBinding(channel, cc);
+    m_fp4->deleteControllerBinding(m_bindingTable->controllerAt(idx.row()));
 }
 
 void BindingManagerWindow::saveBindings(QSettings &settings) {
@@ -502,8 +498,9 @@ void BindingManagerWindow::saveBindings(QSettings &settings) {
         settings.beginGroup(QString("binding%1").arg(i++));
         settings.setValue("channel", it.key().channel);
         settings.setValue("cc", it.key().cc);
-        settings.setValue("group", it.value().group);
-        settings.setValue("name", it.value().name);
+        settings.setValue("type", it.key().type);
+        settings.setValue("group", it.value().group());
+        settings.setValue("name", it.value().name());
         settings.setValue("min", it.value().minValue);
         settings.setValue("max", it.value().maxValue);
         settings.setValue("reversed", it.value().reversed);
@@ -517,11 +514,14 @@ void BindingManagerWindow::restoreBindings(QSettings &settings) {
 
         int channel = settings.value("channel", 0).toInt();
         int cc = settings.value("cc", -1).toInt();
+        int type = settings.value("type", ControllerInfo::CCType).toInt();
         QString group = settings.value("group", "").toString();
         QString name = settings.value("name", "").toString();
 
-        if (cc < 0 || cc > 127 || group.isEmpty() || name.isEmpty()) {
+        ControllerInfo controller(channel, cc, type);
+        if (!controller.isValid() || group.isEmpty() || name.isEmpty()) {
             qDebug() << "Ignoring invalid binding in config file.";
+            settings.endGroup();
             continue;
         }
 
@@ -529,7 +529,6 @@ void BindingManagerWindow::restoreBindings(QSettings &settings) {
         int maxValue = settings.value("max", 0).toInt();
         bool reversed = settings.value("reversed", false).toBool();
 
-        ControllerInfo controller(channel, cc);
         BindingInfo bindingInfo(group, name, minValue, maxValue, reversed);
 
         m_fp4->addControllerBinding(controller, bindingInfo);
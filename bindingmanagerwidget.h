@@ -61,6 +61,7 @@ public:
     Qt::ItemFlags flags(const QModelIndex &index) const;
 
     int findBinding(const ControllerInfo& controller);
+    ControllerInfo controllerAt(int row) const;
 
 public slots:
     void populate();
@@ -20,17 +20,16 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 
 #include "channelpressuregenerator.h"
 #include "fp4qt.h"
-#include "config.h"
 #include <QtWidgets>
 
 ChannelPressureGenerator::ChannelPressureGenerator(FP4Qt *fp4, int channel, QWidget *parent) :
     ControllerGenerator(fp4, channel, parent)
 {
     m_average = -1;
+    m_startTime = 0;
+    m_decayDuration = 0;
 
-    m_timer = new QTimer;
-    m_timer->setTimerType(Qt::PreciseTimer);
-    connect(m_timer, SIGNAL(timeout()), SLOT(onTimer()));
+    m_rampId = m_fp4->allocateControllerRamp();
 }
 
 QString ChannelPressureGenerator::description() const {
@@ -52,7 +51,7 @@ QWidget *ChannelPressureGenerator::buildOptionsWidget() {
     layout->addWidget(channelLabel, 0, 0);
     m_outputChannelSpinBox = new QSpinBox;
     m_outputChannelSpinBox->setRange(1, 16);
-    m_outputChannelSpinBox->setValue(m_channel);
+    m_outputChannelSpinBox->setValue(m_channel+1);
     channelLabel->setBuddy(m_outputChannelSpinBox);
     layout->addWidget(m_outputChannelSpinBox, 0, 1);
 
@@ -100,7 +99,7 @@ QWidget *ChannelPressureGenerator::buildOptionsWidget() {
     m_decaySlider->setValue(0);
     decayLabel->setBuddy(m_decaySlider);
     layout->addWidget(m_decaySlider, 5, 1);
-    connect(m_decaySlider, SIGNAL(valueChanged(int)), SLOT(updateTimerProperties(int)));
+    connect(m_decaySlider, SIGNAL(valueChanged(int)), SLOT(onDecayChanged(int)));
 
     m_configMap["Output Channel"] = m_outputChannelSpinBox;
     m_configMap["Output Controller"] = m_outputControllerSpinBox;
@@ -112,26 +111,28 @@ QWidget *ChannelPressureGenerator::buildOptionsWidget() {
     return widget;
 }
 
-void ChannelPressureGenerator::updateTimerProperties(int) {
-    // FIXME: we should calculate decaying value from start time
-    //        instead of incrementally calculating it since timers
-    //        don't have to be accurate.
-    if (m_decaySlider->value() == 0) {
-        m_timer->stop();
-        return;
+/* a running decay keeps its speed until the next note. Disabling decay stops
+   it where it is. */
+void ChannelPressureGenerator::onDecayChanged(int decay) {
+    if (decay == 0) {
+        m_average = currentValue();
+        m_decayDuration = 0;
+        m_fp4->stopControllerRamp(m_rampId);
     }
+}
 
-    float time = 10.0f * (m_decaySlider->maximum() - m_decaySlider->value()); // in ms
-    float msPerPoint = time / 127.0f;
-
-    if (msPerPoint <= MIN_TIMER_INTERVAL) {
-        m_timer->setInterval(MIN_TIMER_INTERVAL);
-        m_decaySpeed = 127.0f / ((float)time / (float)MIN_TIMER_INTERVAL);
+/* The value the controller has now. The decay is computed from the time of
+   the last note, the same way the control rate engine does. */
+int ChannelPressureGenerator::currentValue() const {
+    if (m_average < 0 || m_decayDuration == 0) {
+        return m_average;
     }
-    else {
-        m_timer->setInterval((int)msPerPoint);
-        m_decaySpeed = 1.0f;
+
+    quint64 elapsed = m_fp4->queueNow() - m_startTime;
+    if (elapsed >= m_decayDuration) {
+        return -1;
     }
+    return m_average - (int)((quint64)m_average * elapsed / m_decayDuration);
 }
 
 void ChannelPressureGenerator::onNoteOnEvent(int channel, int note, int velocity) {
@@ -142,34 +143,41 @@ void ChannelPressureGenerator::onNoteOnEvent(int channel, int note, int velocity
     }
 
     int value = velocity;
+    int average = currentValue();
 
     if (m_averageCheckBox->isChecked()) {
-        if (m_average < 0) {
+        if (average < 0) {
             value = velocity;
         }
-        else if (velocity < m_average) {
+        else if (velocity < average) {
             float fraction = m_downSpeedSlider->value() / 100.0;
-            value = fraction * velocity + (1.0f - fraction) * m_average;
+            value = fraction * velocity + (1.0f - fraction) * average;
         }
-        else if (velocity > m_average) {
+        else if (velocity > average) {
             float fraction = m_upSpeedSlider->value() / 100.0;
-            value = fraction * velocity + (1.0f - fraction) * m_average;
+            value = fraction * velocity + (1.0f - fraction) * average;
         }
     }
 
+    m_outputChannel = m_outputChannelSpinBox->value() - 1;
+    m_outputController = m_outputControllerSpinBox->value() - 1;
+    m_average = value;
+
+    // without decay the value is set by a ramp that doesn't move, so it is
+    // thinned like the other generated values
     if (m_decaySlider->value() == 0) {
-        m_fp4->onController(m_outputChannelSpinBox->value()-1, m_outputControllerSpinBox->value()-1, value);
-        m_average = value;
+        m_decayDuration = 0;
+        m_fp4->startControllerRamp(m_rampId, m_outputChannel, m_outputController, value, value, 0);
         return;
     }
 
-    m_outputChannel = m_outputChannelSpinBox->value() - 1;
-    m_outputController = m_outputControllerSpinBox->value() - 1;
-
-    m_timer->start();
+    // time to decay from 127 to 0 in us, the higher the decay the shorter
+    quint64 time = 10000ULL * (m_decaySlider->maximum() - m_decaySlider->value());
+    m_startTime = m_fp4->queueNow();
+    m_decayDuration = time * value / 127;
 
-    m_fp4->onController(m_outputChannelSpinBox->value()-1, m_outputControllerSpinBox->value()-1, value);
-    m_average = value;
+    // the ramp sends the first value right away
+    m_fp4->startControllerRamp(m_rampId, m_outputChannel, m_outputController, value, 0, m_decayDuration / 1000);
 }
 
 void ChannelPressureGenerator::onEnabledStateChange(bool enabled) {
@@ -177,18 +185,7 @@ void ChannelPressureGenerator::onEnabledStateChange(bool enabled) {
         m_average = -1;
     }
     else {
-        m_timer->stop();
-    }
-}
-
-void ChannelPressureGenerator::onTimer() {
-    m_average -= m_decaySpeed;
-    if (m_average < 0) {
-        m_timer->stop();
-        m_fp4->onController(m_outputChannel, m_outputController, 0);
-    }
-    else {
-        m_fp4->onController(m_outputChannel, m_outputController, m_average);
+        m_fp4->stopControllerRamp(m_rampId);
     }
 }
 
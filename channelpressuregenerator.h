@@ -30,7 +30,6 @@ class QComboBox;
 class QSlider;
 class QSettings;
 class QStatusBar;
-class QTimer;
 
 // convert channel last note velocity to arbitrary contoller
 class ChannelPressureGenerator : public ControllerGenerator {
@@ -42,11 +41,12 @@ public:
 protected:
     QWidget* buildOptionsWidget();
 protected slots:
-    void updateTimerProperties(int);
+    void onDecayChanged(int decay);
     void onNoteOnEvent(int channel, int note, int velocity);
     void onEnabledStateChange(bool enabled);
-    void onTimer();
 private:
+    int currentValue() const;
+
     QSpinBox* m_outputChannelSpinBox;
     QSpinBox* m_outputControllerSpinBox;
     QCheckBox* m_averageCheckBox;
@@ -54,12 +54,12 @@ private:
     QSlider* m_downSpeedSlider;
     QSlider* m_decaySlider;
 
-    QTimer* m_timer;
-    int m_average;
-    int m_decaySpeed;
+    int m_rampId;
+    int m_average;              // value after the last note, -1 if none
     int m_outputChannel;
     int m_outputController;
-    qint64 m_startTime;
+    quint64 m_startTime;        // queue time of the last note in us
+    quint64 m_decayDuration;    // time to decay from m_average to 0 in us
 };
 
 #endif
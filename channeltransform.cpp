@@ -20,7 +20,6 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 
 #include "channeltransform.h"
 #include "fp4qt.h"
-#include <QDateTime>
 #include <QtWidgets>
 
 ChannelTransform::ChannelTransform(FP4Qt *fp4, QObject *parent) :
@@ -58,13 +57,13 @@ ForwardChannelTransform::ForwardChannelTransform(FP4Qt *fp4, QObject *parent) :
     ChannelTransform(fp4, parent)
 { }
 
-void ForwardChannelTransform::handleNoteOn(ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
+void ForwardChannelTransform::handleNoteOn(const ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
     Q_UNUSED(mapping);
     Q_UNUSED(channelIn);
     m_fp4->sendNoteOn(channelOut, note, velocity);
 }
 
-void ForwardChannelTransform::handleNoteOff(ChannelMapping *mapping, int channelIn, int channelOut, int note) {
+void ForwardChannelTransform::handleNoteOff(const ChannelMapping *mapping, int channelIn, int channelOut, int note) {
     Q_UNUSED(mapping);
     Q_UNUSED(channelIn);
     m_fp4->sendNoteOff(channelOut, note);
@@ -77,7 +76,7 @@ MonophonicRetriggerChannelTransform::MonophonicRetriggerChannelTransform(FP4Qt *
     ChannelTransform(fp4, parent)
 { }
 
-void MonophonicRetriggerChannelTransform::handleNoteOn(ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
+void MonophonicRetriggerChannelTransform::handleNoteOn(const ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
     Q_UNUSED(mapping);
     if (m_fp4->isMappedNoteOn(channelIn, channelOut, note))
     {
@@ -91,7 +90,7 @@ void MonophonicRetriggerChannelTransform::handleNoteOn(ChannelMapping *mapping,
     }
 }
 
-void MonophonicRetriggerChannelTransform::handleNoteOff(ChannelMapping *mapping, int channelIn, int channelOut, int note) {
+void MonophonicRetriggerChannelTransform::handleNoteOff(const ChannelMapping *mapping, int channelIn, int channelOut, int note) {
     Q_UNUSED(mapping);
     Q_UNUSED(channelIn);
     Q_UNUSED(channelOut);
@@ -106,7 +105,7 @@ MonophonicToggleChannelTransform::MonophonicToggleChannelTransform(FP4Qt *fp4, Q
     ChannelTransform(fp4, parent)
 { }
 
-void MonophonicToggleChannelTransform::handleNoteOn(ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
+void MonophonicToggleChannelTransform::handleNoteOn(const ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
     Q_UNUSED(mapping);
 
     if (m_fp4->isMappedNoteOn(channelIn, channelOut, note))
@@ -121,7 +120,7 @@ void MonophonicToggleChannelTransform::handleNoteOn(ChannelMapping *mapping, int
     }
 }
 
-void MonophonicToggleChannelTransform::handleNoteOff(ChannelMapping *mapping, int channelIn, int channelOut, int note) {
+void MonophonicToggleChannelTransform::handleNoteOff(const ChannelMapping *mapping, int channelIn, int channelOut, int note) {
     Q_UNUSED(mapping);
     Q_UNUSED(channelIn);
     Q_UNUSED(channelOut);
@@ -131,9 +130,8 @@ void MonophonicToggleChannelTransform::handleNoteOff(ChannelMapping *mapping, in
 }
 
 /* ChannelMapping::Smart: Note On events arriving shortly on after the other are played as chords. Notes arriving
-   later send note off events for currently sounding notes. */
-
-#define SMART_CHANNEL_TRANSFORM_DELAY 20
+   later send note off events for currently sounding notes. Notes are timed by when they were received, so chords
+   are not split when the MIDI thread is late. The chord window is set per mapping. */
 
 SmartChannelTransform::SmartChannelTransform(FP4Qt *fp4, QObject *parent) :
     ChannelTransform(fp4, parent)
@@ -141,11 +139,9 @@ SmartChannelTransform::SmartChannelTransform(FP4Qt *fp4, QObject *parent) :
     memset(m_lastNotePress, 0, sizeof(m_lastNotePress));
 }
 
-void SmartChannelTransform::handleNoteOn(ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
-    Q_UNUSED(mapping);
-
-    qint64 now = QDateTime::currentMSecsSinceEpoch();
-    if (now > m_lastNotePress[channelIn][channelOut] + SMART_CHANNEL_TRANSFORM_DELAY) {
+void SmartChannelTransform::handleNoteOn(const ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
+    quint64 now = m_fp4->eventTime();
+    if (now > m_lastNotePress[channelIn][channelOut] + (quint64)mapping->chordWindow * 1000) {
         m_fp4->mappedNotesOff(channelIn, channelOut);
     }
 
@@ -155,11 +151,11 @@ void SmartChannelTransform::handleNoteOn(ChannelMapping *mapping, int channelIn,
     m_lastNotePress[channelIn][channelOut] = now;
 }
 
-void SmartChannelTransform::handleNoteOff(ChannelMapping *mapping, int channelIn, int channelOut, int note) {
+void SmartChannelTransform::handleNoteOff(const ChannelMapping *mapping, int channelIn, int channelOut, int note) {
     Q_UNUSED(mapping);
     Q_UNUSED(note);
 
-    m_lastNotePress[channelIn][channelOut] = QDateTime::currentMSecsSinceEpoch();
+    m_lastNotePress[channelIn][channelOut] = m_fp4->eventTime();
 }
 
 /* insert portamento messages after each note */
@@ -167,14 +163,14 @@ PortamentoChannelTransform::PortamentoChannelTransform(FP4Qt *fp4, QObject *pare
     ChannelTransform(fp4, parent)
 { }
 
-void PortamentoChannelTransform::handleNoteOn(ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
+void PortamentoChannelTransform::handleNoteOn(const ChannelMapping *mapping, int channelIn, int channelOut, int note, int velocity) {
     Q_UNUSED(mapping);
     Q_UNUSED(channelIn);
     m_fp4->sendNoteOn(channelOut, note, velocity);
     m_fp4->sendPortamentoControl(channelOut, note);
 }
 
-void PortamentoChannelTransform::handleNoteOff(ChannelMapping *mapping, int channelIn, int channelOut, int note) {
+void PortamentoChannelTransform::handleNoteOff(const ChannelMapping *mapping, int channelIn, int channelOut, int note) {
     Q_UNUSED(mapping);
     Q_UNUSED(channelIn);
     m_fp4->sendNoteOff(channelOut, note);
@@ -39,8 +39,8 @@ class ChannelTransform : public QObject {
     Q_OBJECT
 public:
     explicit ChannelTransform(FP4Qt* fp4, QObject* parent=0);
-    virtual void handleNoteOn(ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity) = 0;
-    virtual void handleNoteOff(ChannelMapping* mapping, int channelIn, int channelOut, int note) = 0;
+    virtual void handleNoteOn(const ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity) = 0;
+    virtual void handleNoteOff(const ChannelMapping* mapping, int channelIn, int channelOut, int note) = 0;
 
 protected:
     FP4Qt* m_fp4;
@@ -61,43 +61,43 @@ class ForwardChannelTransform : public ChannelTransform {
     Q_OBJECT
 public:
     explicit ForwardChannelTransform(FP4Qt* fp4, QObject* parent=0);
-    void handleNoteOn(ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
-    void handleNoteOff(ChannelMapping* mapping, int channelIn, int channelOut, int note);
+    void handleNoteOn(const ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
+    void handleNoteOff(const ChannelMapping* mapping, int channelIn, int channelOut, int note);
 };
 
 class MonophonicRetriggerChannelTransform : public ChannelTransform {
     Q_OBJECT
 public:
     explicit MonophonicRetriggerChannelTransform(FP4Qt* fp4, QObject* parent=0);
-    void handleNoteOn(ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
-    void handleNoteOff(ChannelMapping* mapping, int channelIn, int channelOut, int note);
+    void handleNoteOn(const ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
+    void handleNoteOff(const ChannelMapping* mapping, int channelIn, int channelOut, int note);
 };
 
 class MonophonicToggleChannelTransform : public ChannelTransform {
     Q_OBJECT
 public:
     explicit MonophonicToggleChannelTransform(FP4Qt* fp4, QObject* parent=0);
-    void handleNoteOn(ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
-    void handleNoteOff(ChannelMapping* mapping, int channelIn, int channelOut, int note);
+    void handleNoteOn(const ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
+    void handleNoteOff(const ChannelMapping* mapping, int channelIn, int channelOut, int note);
 };
 
 class SmartChannelTransform : public ChannelTransform {
     Q_OBJECT
 public:
     explicit SmartChannelTransform(FP4Qt* fp4, QObject* parent=0);
-    void handleNoteOn(ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
-    void handleNoteOff(ChannelMapping* mapping, int channelIn, int channelOut, int note);
+    void handleNoteOn(const ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
+    void handleNoteOff(const ChannelMapping* mapping, int channelIn, int channelOut, int note);
 
 private:
-    qint64 m_lastNotePress[16][16];
+    quint64 m_lastNotePress[16][16];       // event time in us
 };
 
 class PortamentoChannelTransform : public ChannelTransform {
     Q_OBJECT
 public:
     explicit PortamentoChannelTransform(FP4Qt* fp4, QObject* parent=0);
-    void handleNoteOn(ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
-    void handleNoteOff(ChannelMapping* mapping, int channelIn, int channelOut, int note);
+    void handleNoteOn(const ChannelMapping* mapping, int channelIn, int channelOut, int note, int velocity);
+    void handleNoteOff(const ChannelMapping* mapping, int channelIn, int channelOut, int note);
 };
 
 #endif // CHANNELTRANSFORM_H
@@ -49,6 +49,8 @@ bool ChorusWidget::advancedMode() const {
 }
 
 void ChorusWidget::sendAll() {
+    FP4DataTransaction transaction(FP4App()->fp4());
+
     if (advancedMode()) {
         int preLpf = parameterValue(CHORUS_PRE_LPF);
         int level = parameterValue(CHORUS_LEVEL);
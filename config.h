@@ -47,4 +47,16 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 // minimum timer interval for dynamic effects in ms
 #define MIN_TIMER_INTERVAL 20 
 
+// interval of the control rate timer that runs generator ramps in ms
+#define CONTROL_RATE_INTERVAL 5
+
+// default maximum number of messages per second a generator sends on one
+// controller. Ramps are computed at the control rate, but sent at most this
+// often.
+#define DEFAULT_GENERATED_CONTROLLER_RATE 50
+
+// default sysex output budget in bytes per ms. A MIDI DIN link carries
+// 3125 bytes/s, this leaves a third of it for notes and controllers.
+#define DEFAULT_SYSEX_BYTES_PER_MS 2
+
 #endif // CONFIG_H
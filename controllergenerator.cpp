@@ -63,11 +63,24 @@ void ControllerGenerator::loadSettings(QSettings& settings) {
             continue;
         }
 
+        QComboBox* comboBox = qobject_cast<QComboBox*>(widget);
+        if (comboBox) {
+            comboBox->setCurrentIndex(value.toInt());
+            continue;
+        }
+
         qDebug() << "Unhandled widget type in ControllerGenerator::loadSettings";
     }
+    loadLegacySettings(settings);
     settings.endGroup();
 }
 
+/* convert settings saved by older versions, called inside the group of the
+   generator after the current settings were loaded */
+void ControllerGenerator::loadLegacySettings(QSettings& settings) {
+    Q_UNUSED(settings);
+}
+
 void ControllerGenerator::saveSettings(QSettings& settings) const {
     settings.beginGroup(configName());
     settings.setValue("Enabled", m_enabledCheckBox->isChecked());
@@ -90,6 +103,12 @@ void ControllerGenerator::saveSettings(QSettings& settings) const {
             settings.setValue(config, slider->value());
             continue;
         }
+
+        QComboBox* comboBox = qobject_cast<QComboBox*>(widget);
+        if (comboBox) {
+            settings.setValue(config, comboBox->currentIndex());
+            continue;
+        }
     }
     settings.endGroup();
 }
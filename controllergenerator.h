@@ -49,6 +49,7 @@ protected slots:
 
 protected:
     virtual QWidget* buildOptionsWidget() = 0;
+    virtual void loadLegacySettings(QSettings& settings);
 
     FP4Qt* m_fp4;
     int m_channel;
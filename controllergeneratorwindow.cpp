@@ -28,6 +28,7 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 #include "controllerkeysgenerator.h"
 #include "keytimegenerator.h"
 #include "voicinggenerator.h"
+#include "arpeggiatorgenerator.h"
 #include <QtWidgets>
 
 ControllerGeneratorWindow::ControllerGeneratorWindow(FP4Qt *fp4, int channel, QWidget *parent) :
@@ -49,6 +50,9 @@ ControllerGeneratorWindow::ControllerGeneratorWindow(FP4Qt *fp4, int channel, QW
     m_voicingGenerator = new VoicingGenerator(fp4, channel, this);
     m_voicingGenerator->init();
 
+    m_arpeggiatorGenerator = new ArpeggiatorGenerator(fp4, channel, this);
+    m_arpeggiatorGenerator->init();
+
     QVBoxLayout* topLayout = new QVBoxLayout;
     topLayout->setMargin(0);
     topLayout->setSpacing(0);
@@ -72,6 +76,7 @@ ControllerGeneratorWindow::ControllerGeneratorWindow(FP4Qt *fp4, int channel, QW
     tabWidget->addTab(m_controllerKeysWidget, "Controller &Keys");
     tabWidget->addTab(m_keyTimeWidget, "Key &Time");
     tabWidget->addTab(m_voicingGenerator, "&Voicings");
+    tabWidget->addTab(m_arpeggiatorGenerator, "&Arpeggio");
 
     m_statusBar = new QStatusBar;
     topLayout->addWidget(m_statusBar);
@@ -83,6 +88,7 @@ void ControllerGeneratorWindow::saveSettings(QSettings &settings) const {
     m_controllerKeysWidget->saveSettings(settings);
     m_keyTimeWidget->saveSettings(settings);
     m_voicingGenerator->saveSettings(settings);
+    m_arpeggiatorGenerator->saveSettings(settings);
     settings.endGroup();
 }
 
@@ -92,6 +98,7 @@ void ControllerGeneratorWindow::loadSettings(QSettings &settings) {
     m_controllerKeysWidget->loadSettings(settings);
     m_keyTimeWidget->loadSettings(settings);
     m_voicingGenerator->loadSettings(settings);
+    m_arpeggiatorGenerator->loadSettings(settings);
     settings.endGroup();
 }
 
@@ -34,6 +34,7 @@ class ChannelPressureGenerator;
 class ControllerKeysGenerator;
 class KeyTimeGenerator;
 class VoicingGenerator;
+class ArpeggiatorGenerator;
 
 // the window that displays all the controllergenerator widgets
 class ControllerGeneratorWindow : public Window
@@ -60,6 +61,7 @@ private:
     ControllerKeysGenerator* m_controllerKeysWidget;
     KeyTimeGenerator* m_keyTimeWidget;
     VoicingGenerator* m_voicingGenerator;
+    ArpeggiatorGenerator* m_arpeggiatorGenerator;
 
     QStatusBar* m_statusBar;
 };
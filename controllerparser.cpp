@@ -0,0 +1,173 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "controllerparser.h"
+#include <string.h>
+
+#define CC_BANK_MSB 0
+#define CC_BANK_LSB 32
+#define CC_DATA_ENTRY_MSB 6
+#define CC_DATA_ENTRY_LSB 38
+#define CC_NRPN_LSB 98
+#define CC_NRPN_MSB 99
+#define CC_RPN_LSB 100
+#define CC_RPN_MSB 101
+
+ControllerParser::ControllerParser() {
+    reset();
+}
+
+void ControllerParser::reset() {
+    for (int channel=0; channel<16; ++channel) {
+        ChannelState& state = m_channels[channel];
+        memset(state.msb, -1, sizeof(state.msb));
+        state.bankMsb = 0;
+        state.bankLsb = 0;
+        state.bankPending = false;
+        state.parameterType = ParsedController::None;
+        state.rpnMsb = state.rpnLsb = 127;
+        state.nrpnMsb = state.nrpnLsb = 127;
+        state.dataMsb = -1;
+    }
+}
+
+bool ControllerParser::parse(int channel, int cc, int value, ParsedController &event) {
+    if (channel < 0 || channel >= 16 || cc < 0 || cc >= 128) {
+        return false;
+    }
+
+    ChannelState& state = m_channels[channel];
+    value &= 0x7f;
+
+    event.type = ParsedController::None;
+    event.channel = channel;
+
+    switch (cc) {
+    case CC_BANK_MSB:
+        state.bankMsb = value;
+        state.bankPending = true;
+        return false;
+
+    case CC_BANK_LSB:
+        state.bankLsb = value;
+        state.bankPending = false;
+        event.type = ParsedController::BankSelect;
+        event.number = 0;
+        event.value = (state.bankMsb << 7) | value;
+        return true;
+
+    case CC_DATA_ENTRY_MSB:
+        state.dataMsb = value;
+        return parameterEvent(channel, value << 7, event);
+
+    case CC_DATA_ENTRY_LSB:
+        if (state.dataMsb < 0) {
+            return false;
+        }
+        return parameterEvent(channel, (state.dataMsb << 7) | value, event);
+
+    case CC_NRPN_MSB:
+        state.nrpnMsb = value;
+        state.parameterType = ParsedController::NRPN;
+        state.dataMsb = -1;
+        return false;
+
+    case CC_NRPN_LSB:
+        state.nrpnLsb = value;
+        state.parameterType = ParsedController::NRPN;
+        state.dataMsb = -1;
+        return false;
+
+    case CC_RPN_MSB:
+        state.rpnMsb = value;
+        state.parameterType = ParsedController::RPN;
+        state.dataMsb = -1;
+        return false;
+
+    case CC_RPN_LSB:
+        state.rpnLsb = value;
+        state.parameterType = ParsedController::RPN;
+        state.dataMsb = -1;
+        return false;
+    }
+
+    if (cc < 32) {
+        // kept for the LSB that may follow
+        state.msb[cc] = value;
+        return false;
+    }
+
+    if (cc < 64) {
+        int msb = state.msb[cc - 32];
+        if (msb < 0) {
+            return false;
+        }
+
+        event.type = ParsedController::Controller14;
+        event.number = cc - 32;
+        event.value = (msb << 7) | value;
+        return true;
+    }
+
+    return false;
+}
+
+/* report a data entry for the selected RPN or NRPN. Nothing is reported
+   when no parameter or the null RPN (127/127) is selected. */
+bool ControllerParser::parameterEvent(int channel, int value, ParsedController &event) {
+    const ChannelState& state = m_channels[channel];
+
+    int parameter;
+    switch (state.parameterType) {
+    case ParsedController::RPN:
+        parameter = (state.rpnMsb << 7) | state.rpnLsb;
+        break;
+    case ParsedController::NRPN:
+        parameter = (state.nrpnMsb << 7) | state.nrpnLsb;
+        break;
+    default:
+        return false;
+    }
+
+    if (parameter == 0x3fff) {
+        return false;
+    }
+
+    event.type = state.parameterType;
+    event.channel = channel;
+    event.number = parameter;
+    event.value = value;
+    return true;
+}
+
+bool ControllerParser::programChange(int channel, ParsedController &event) {
+    if (channel < 0 || channel >= 16 || !m_channels[channel].bankPending) {
+        return false;
+    }
+
+    ChannelState& state = m_channels[channel];
+    state.bankPending = false;
+
+    event.type = ParsedController::BankSelect;
+    event.channel = channel;
+    event.number = 0;
+    event.value = (state.bankMsb << 7) | state.bankLsb;
+    return true;
+}
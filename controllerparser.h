@@ -0,0 +1,87 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Assemble controller messages that span several control changes:
+   - bank select (CC 0 and 32)
+   - 14-bit controllers (CC n and n+32, for n < 32)
+   - RPN (CC 101/100) and NRPN (CC 99/98) with data entry (CC 6/38)
+
+   Each channel keeps its own state, so messages of different channels may
+   be interleaved and a message may be split over several input batches.
+   Nothing is ever waited for: every control change is parsed as it arrives,
+   and completes at most one high level event.
+
+   14-bit controllers are reported when their LSB arrives, with the last
+   MSB. RPN/NRPN values are reported on data entry MSB (with a zero LSB)
+   and again on data entry LSB.
+*/
+
+#ifndef CONTROLLERPARSER_H
+#define CONTROLLERPARSER_H
+
+#include <inttypes.h>
+
+// a high level controller event
+struct ParsedController {
+    enum Type {
+        None,
+        BankSelect,     // value: (msb << 7) | lsb
+        Controller14,   // number: MSB controller (0-31), value: 0-16383
+        RPN,            // number: parameter, value: 0-16383
+        NRPN            // number: parameter, value: 0-16383
+    };
+
+    int type;
+    int channel;
+    int number;
+    int value;
+};
+
+class ControllerParser {
+public:
+    ControllerParser();
+
+    // parse a control change. returns true if it completed an event.
+    bool parse(int channel, int cc, int value, ParsedController& event);
+
+    // a program change completes a bank select that has no LSB.
+    bool programChange(int channel, ParsedController& event);
+
+    void reset();
+
+private:
+    struct ChannelState {
+        int8_t msb[32];         // last MSB of 14-bit controllers, -1 if none
+        int8_t bankMsb;
+        int8_t bankLsb;
+        bool bankPending;       // MSB received, LSB not yet
+
+        int8_t parameterType;   // RPN, NRPN or None
+        int8_t rpnMsb, rpnLsb;
+        int8_t nrpnMsb, nrpnLsb;
+        int8_t dataMsb;
+    };
+
+    bool parameterEvent(int channel, int value, ParsedController& event);
+
+    ChannelState m_channels[16];
+};
+
+#endif // CONTROLLERPARSER_H
@@ -0,0 +1,110 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "controlrateengine.h"
+
+ControlRateEngine::ControlRateEngine() :
+    m_count(0),
+    m_minInterval(0),
+    m_sent(0),
+    m_unchanged(0),
+    m_limited(0)
+{
+    for (int channel=0; channel<16; ++channel) {
+        for (int cc=0; cc<128; ++cc) {
+            m_streams[channel][cc].lastValue = -1;
+            m_streams[channel][cc].lastSent = 0;
+            m_streams[channel][cc].sent = false;
+        }
+    }
+}
+
+/* Start a ramp. The value of the stream may have been changed by someone
+   else since the engine last sent it, so the first value of the ramp is
+   never dropped as unchanged. It still waits for the rate limit. */
+bool ControlRateEngine::start(const ControlRamp &ramp) {
+    m_streams[ramp.channel & 0xf][ramp.cc & 0x7f].lastValue = -1;
+
+    for (int i=0; i<m_count; ++i) {
+        if (m_ramps[i].id == ramp.id) {
+            settle(m_ramps[i], -1);
+            m_ramps[i] = ramp;
+            m_ramps[i].pendingValue = -1;
+            return true;
+        }
+    }
+
+    if (m_count == CONTROL_RAMP_SLOTS) {
+        return false;
+    }
+
+    m_ramps[m_count] = ramp;
+    m_ramps[m_count++].pendingValue = -1;
+    return true;
+}
+
+/* stop a ramp. A value it held back is dropped. */
+void ControlRateEngine::stop(int id) {
+    for (int i=0; i<m_count; ++i) {
+        if (m_ramps[i].id == id) {
+            settle(m_ramps[i], -1);
+            m_ramps[i] = m_ramps[--m_count];
+            return;
+        }
+    }
+}
+
+void ControlRateEngine::clear() {
+    for (int i=0; i<m_count; ++i) {
+        settle(m_ramps[i], -1);
+    }
+    m_count = 0;
+}
+
+ControlRateStats ControlRateEngine::stats() const {
+    ControlRateStats stats;
+    stats.sent = m_sent.load(std::memory_order_relaxed);
+    stats.unchanged = m_unchanged.load(std::memory_order_relaxed);
+    stats.limited = m_limited.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ControlRateEngine::resetStats() {
+    m_sent.store(0, std::memory_order_relaxed);
+    m_unchanged.store(0, std::memory_order_relaxed);
+    m_limited.store(0, std::memory_order_relaxed);
+}
+
+/* value of the ramp at time now, rounded to the nearest integer */
+int ControlRateEngine::valueAt(const ControlRamp &ramp, uint64_t now) {
+    if (now <= ramp.start) {
+        return ramp.from;
+    }
+
+    uint64_t elapsed = now - ramp.start;
+    if (elapsed >= ramp.duration) {
+        return ramp.to;
+    }
+
+    int64_t delta = (int64_t)(ramp.to - ramp.from) * (int64_t)elapsed;
+    int64_t half = (int64_t)ramp.duration / 2;
+    int64_t offset = (delta >= 0 ? delta + half : delta - half) / (int64_t)ramp.duration;
+    return ramp.from + (int)offset;
+}
@@ -0,0 +1,170 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Move controllers from one value to another over time, for all generators
+   at once. Values are computed from the time elapsed since a ramp started,
+   so late or skipped ticks don't change the shape of the ramp, only its
+   resolution.
+
+   The engine doesn't have a timer of its own. The owner calls advance() at
+   the control rate and passes the time in, in microseconds.
+
+   Output is thinned per (channel, cc) stream: a value equal to the last one
+   sent on the stream is dropped, and a stream doesn't send more often than
+   once every minInterval us. A ramp may then skip values, but its final
+   value is always sent: a finished ramp is kept until the stream can send
+   it. A ramp with no duration sets a controller under the same limits.
+*/
+
+#ifndef CONTROLRATEENGINE_H
+#define CONTROLRATEENGINE_H
+
+#include <inttypes.h>
+#include <atomic>
+
+// number of ramps that can run at once
+#define CONTROL_RAMP_SLOTS 64
+
+// a controller moving linearly from one value to another
+struct ControlRamp {
+    int id;
+    int channel;
+    int cc;
+    int from;
+    int to;
+    uint64_t start;         // us
+    uint64_t duration;      // us
+    int lastValue;          // last value sent, -1 if none
+    int pendingValue;       // value held back by the rate limit, -1 if none
+};
+
+// number of generated controller values sent and dropped
+struct ControlRateStats {
+    uint64_t sent;
+    uint64_t unchanged;     // same value as last sent on the stream
+    uint64_t limited;       // held back, then replaced or dropped to keep
+                            // the stream under its rate
+};
+
+class ControlRateEngine {
+public:
+    ControlRateEngine();
+
+    // start a ramp, replacing the ramp with the same id. returns false if
+    // all slots are in use.
+    bool start(const ControlRamp& ramp);
+    void stop(int id);
+    void clear();
+
+    bool isIdle() const { return m_count == 0; }
+    int count() const { return m_count; }
+
+    // minimum time between two values of a stream in us, 0 for no limit.
+    // This can be set from any thread.
+    void setMinInterval(uint64_t interval) { m_minInterval.store(interval, std::memory_order_relaxed); }
+    uint64_t minInterval() const { return m_minInterval.load(std::memory_order_relaxed); }
+
+    // statistics can be read and reset from any thread
+    ControlRateStats stats() const;
+    void resetStats();
+
+    // count values that were never sent to the engine because the caller
+    // thinned them out itself
+    void addLimited(uint64_t count) { m_limited.fetch_add(count, std::memory_order_relaxed); }
+
+    static int valueAt(const ControlRamp& ramp, uint64_t now);
+
+    /* compute every ramp at time now. send(channel, cc, value) is called for
+       the ramps whose value changed, unless the stream already has that value
+       or sent a value less than minInterval ago. Finished ramps are removed
+       once their last value is sent. */
+    template<typename F>
+    void advance(uint64_t now, F send) {
+        uint64_t minInterval = this->minInterval();
+
+        int i = 0;
+        while (i < m_count) {
+            ControlRamp& ramp = m_ramps[i];
+            bool finished = now >= ramp.start + ramp.duration;
+            int value = valueAt(ramp, now);
+
+            if (value != ramp.lastValue) {
+                Stream& stream = m_streams[ramp.channel & 0xf][ramp.cc & 0x7f];
+
+                if (value == stream.lastValue) {
+                    settle(ramp, value);
+                    ramp.lastValue = value;
+                    m_unchanged.fetch_add(1, std::memory_order_relaxed);
+                }
+                else if (minInterval && stream.sent && now - stream.lastSent < minInterval) {
+                    // try again on the next tick, with whatever value the ramp has then
+                    settle(ramp, value);
+                    ramp.pendingValue = value;
+                    ++i;
+                    continue;
+                }
+                else {
+                    settle(ramp, value);
+                    ramp.lastValue = value;
+                    stream.lastValue = value;
+                    stream.lastSent = now;
+                    stream.sent = true;
+                    m_sent.fetch_add(1, std::memory_order_relaxed);
+                    send(ramp.channel, ramp.cc, value);
+                }
+            }
+
+            if (finished) {
+                m_ramps[i] = m_ramps[--m_count];
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+
+private:
+    // output state of a (channel, cc) pair
+    struct Stream {
+        int lastValue;      // -1 if unknown
+        uint64_t lastSent;  // us
+        bool sent;          // lastSent is valid
+    };
+
+    // a value of the ramp is handled. A value it held back before counts as
+    // limited if it is replaced by another one.
+    void settle(ControlRamp& ramp, int value) {
+        if (ramp.pendingValue >= 0 && ramp.pendingValue != value) {
+            m_limited.fetch_add(1, std::memory_order_relaxed);
+        }
+        ramp.pendingValue = -1;
+    }
+
+    ControlRamp m_ramps[CONTROL_RAMP_SLOTS];
+    int m_count;
+    Stream m_streams[16][128];
+
+    std::atomic<uint64_t> m_minInterval;
+    std::atomic<uint64_t> m_sent;
+    std::atomic<uint64_t> m_unchanged;
+    std::atomic<uint64_t> m_limited;
+};
+
+#endif // CONTROLRATEENGINE_H
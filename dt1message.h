@@ -0,0 +1,155 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Build Roland GS DT1 (data set) sysex messages without heap allocation.
+
+   A DT1 message looks like:
+     f0 41 10 42 12 <addr msb> <addr> <addr lsb> <data...> <checksum> f7
+
+   The checksum is computed incrementally while bytes are appended. Addresses
+   are three 7-bit bytes, dt1Address() and dt1AddressByte() convert them
+   from/to a linear address so address ranges can be split and merged.
+*/
+
+#ifndef DT1MESSAGE_H
+#define DT1MESSAGE_H
+
+#include <string.h>
+#include <inttypes.h>
+
+// f0 41 10 42 12 + 3 address bytes
+#define DT1_HEADER_SIZE 8
+
+// maximum number of data bytes in one DT1 message
+#define DT1_MAX_DATA 128
+
+// header + data + checksum + f7
+#define DT1_MAX_MESSAGE_SIZE (DT1_HEADER_SIZE + DT1_MAX_DATA + 2)
+
+// header + checksum + f7
+#define DT1_MESSAGE_OVERHEAD (DT1_HEADER_SIZE + 2)
+
+// size of a DT1 message containing a single data byte
+#define DT1_BYTE_MESSAGE_SIZE (DT1_HEADER_SIZE + 1 + 2)
+
+// address of the GS reset parameter (40 00 7f)
+#define GS_RESET_ADDRESS dt1Address(0x40, 0x00, 0x7f)
+
+static constexpr unsigned char DT1_HEADER[5] = {
+    0xf0,
+    0x41, // roland
+    0x10, // device id
+    0x42, // model (GS)
+    0x12  // command (data transfer)
+};
+
+// Roland checksum: address + data + checksum must be 0 modulo 128
+constexpr uint8_t dt1Checksum(unsigned sum) {
+    return (uint8_t)((128 - (sum & 0x7f)) & 0x7f);
+}
+
+// convert a 3 byte address to a linear address
+constexpr uint32_t dt1Address(uint8_t msb, uint8_t fsb, uint8_t lsb) {
+    return ((uint32_t)(msb & 0x7f) << 14) | ((uint32_t)(fsb & 0x7f) << 7) | (uint32_t)(lsb & 0x7f);
+}
+
+// return byte 0 (msb), 1 or 2 (lsb) of a linear address
+constexpr uint8_t dt1AddressByte(uint32_t address, int byte) {
+    return (uint8_t)((address >> (7 * (2 - byte))) & 0x7f);
+}
+
+/* fast path for the common single byte parameter writes. buffer must hold
+   DT1_BYTE_MESSAGE_SIZE bytes. */
+inline void fillDT1ByteMessage(unsigned char* buffer, uint8_t msb, uint8_t fsb, uint8_t lsb, uint8_t value) {
+    memcpy(buffer, DT1_HEADER, sizeof(DT1_HEADER));
+    buffer[5] = msb;
+    buffer[6] = fsb;
+    buffer[7] = lsb;
+    buffer[8] = value & 0x7f;
+    buffer[9] = dt1Checksum(msb + fsb + lsb + (value & 0x7f));
+    buffer[10] = 0xf7;
+}
+
+// DT1 message builder with a fixed size buffer
+class DT1Message {
+public:
+    DT1Message(uint8_t msb, uint8_t fsb, uint8_t lsb) {
+        init(msb, fsb, lsb);
+    }
+
+    explicit DT1Message(uint32_t address) {
+        init(dt1AddressByte(address, 0), dt1AddressByte(address, 1), dt1AddressByte(address, 2));
+    }
+
+    // append a data byte. returns false if the message is full.
+    bool append(uint8_t value) {
+        if (m_length >= DT1_HEADER_SIZE + DT1_MAX_DATA) {
+            return false;
+        }
+
+        value &= 0x7f;
+        m_buffer[m_length++] = value;
+        m_sum += value;
+        return true;
+    }
+
+    // append as many bytes as fit. returns the number of bytes appended.
+    unsigned append(const uint8_t* data, unsigned length) {
+        unsigned room = DT1_HEADER_SIZE + DT1_MAX_DATA - m_length;
+        if (length > room) {
+            length = room;
+        }
+
+        for (unsigned i=0; i<length; ++i) {
+            uint8_t value = data[i] & 0x7f;
+            m_buffer[m_length++] = value;
+            m_sum += value;
+        }
+
+        return length;
+    }
+
+    unsigned dataLength() const { return m_length - DT1_HEADER_SIZE; }
+
+    // terminate the message and return it. size is messageLength().
+    unsigned char* finish() {
+        m_buffer[m_length] = dt1Checksum(m_sum);
+        m_buffer[m_length + 1] = 0xf7;
+        return m_buffer;
+    }
+
+    unsigned messageLength() const { return m_length + 2; }
+
+private:
+    void init(uint8_t msb, uint8_t fsb, uint8_t lsb) {
+        memcpy(m_buffer, DT1_HEADER, sizeof(DT1_HEADER));
+        m_buffer[5] = msb;
+        m_buffer[6] = fsb;
+        m_buffer[7] = lsb;
+        m_length = DT1_HEADER_SIZE;
+        m_sum = msb + fsb + lsb;
+    }
+
+    unsigned char m_buffer[DT1_MAX_MESSAGE_SIZE];
+    unsigned m_length;
+    unsigned m_sum;
+};
+
+#endif // DT1MESSAGE_H
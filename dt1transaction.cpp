@@ -0,0 +1,93 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "dt1transaction.h"
+#include <string.h>
+#include <algorithm>
+
+DT1Transaction::DT1Transaction() {
+    clear();
+}
+
+void DT1Transaction::clear() {
+    m_writeCount = 0;
+    m_poolUsed = 0;
+    m_next = 0;
+}
+
+bool DT1Transaction::stage(uint32_t address, const uint8_t *data, unsigned length) {
+    if (m_writeCount >= DT1_TRANSACTION_MAX_WRITES || m_poolUsed + length > DT1_TRANSACTION_POOL_SIZE) {
+        return false;
+    }
+
+    StagedWrite& write = m_writes[m_writeCount];
+    write.address = address;
+    write.offset = m_poolUsed;
+    write.length = length;
+    write.sequence = m_writeCount;
+    ++m_writeCount;
+
+    memcpy(&m_pool[m_poolUsed], data, length);
+    m_poolUsed += length;
+    return true;
+}
+
+void DT1Transaction::merge() {
+    std::sort(m_writes, m_writes + m_writeCount, [](const StagedWrite& a, const StagedWrite& b) {
+        return a.address < b.address;
+    });
+    m_next = 0;
+}
+
+/* Take the writes that touch or overlap the first one, and copy them in
+   the order they were staged so later writes overwrite earlier ones. A
+   merged range can't be longer than the staged data, so m_merged is always
+   large enough. */
+bool DT1Transaction::nextRange(uint32_t &address, const uint8_t *&data, unsigned &length) {
+    if (m_next >= m_writeCount) {
+        return false;
+    }
+
+    unsigned first = m_next;
+    uint32_t start = m_writes[first].address;
+    uint32_t end = start + m_writes[first].length;
+
+    unsigned last = first + 1;
+    while (last < m_writeCount && m_writes[last].address <= end) {
+        end = std::max(end, m_writes[last].address + m_writes[last].length);
+        ++last;
+    }
+
+    std::sort(m_writes + first, m_writes + last, [](const StagedWrite& a, const StagedWrite& b) {
+        return a.sequence < b.sequence;
+    });
+
+    for (unsigned i=first; i<last; ++i) {
+        const StagedWrite& write = m_writes[i];
+        memcpy(&m_merged[write.address - start], &m_pool[write.offset], write.length);
+    }
+
+    m_next = last;
+
+    address = start;
+    data = m_merged;
+    length = end - start;
+    return true;
+}
@@ -0,0 +1,85 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Collect DT1 writes so they can be sent with as few messages as possible.
+
+   Staged writes are sorted by address, and writes to adjacent or overlapping
+   addresses are merged in a single range. Where writes overlap, the last one
+   wins. Storage is fixed size: stage() fails when it is full, the caller is
+   expected to send what was staged and start over.
+
+   USAGE
+     transaction.stage(address, data, length);
+     ...
+     transaction.merge();
+     while (transaction.nextRange(address, data, length)) {
+         // send
+     }
+     transaction.clear();
+*/
+
+#ifndef DT1TRANSACTION_H
+#define DT1TRANSACTION_H
+
+#include <inttypes.h>
+
+// maximum number of writes staged in a transaction
+#define DT1_TRANSACTION_MAX_WRITES 256
+
+// maximum number of data bytes staged in a transaction
+#define DT1_TRANSACTION_POOL_SIZE 4096
+
+class DT1Transaction {
+public:
+    DT1Transaction();
+
+    bool isEmpty() const { return m_writeCount == 0; }
+    unsigned writeCount() const { return m_writeCount; }
+
+    // returns false if there is no room left
+    bool stage(uint32_t address, const uint8_t* data, unsigned length);
+
+    // sort staged writes, must be called before nextRange()
+    void merge();
+
+    // get the next merged range. data remains valid until the next call.
+    bool nextRange(uint32_t& address, const uint8_t*& data, unsigned& length);
+
+    void clear();
+
+private:
+    struct StagedWrite {
+        uint32_t address;
+        uint16_t offset;
+        uint16_t length;
+        uint16_t sequence;
+    };
+
+    StagedWrite m_writes[DT1_TRANSACTION_MAX_WRITES];
+    unsigned m_writeCount;
+    unsigned m_next;
+
+    uint8_t m_pool[DT1_TRANSACTION_POOL_SIZE];
+    unsigned m_poolUsed;
+
+    uint8_t m_merged[DT1_TRANSACTION_POOL_SIZE];
+};
+
+#endif // DT1TRANSACTION_H
@@ -132,6 +132,7 @@ void EffectParametersWidget::sendAll() {
     qDebug() << "Sending Effects >> FP4";
 
     FP4Qt* fp4 = FP4App()->fp4();
+    FP4DataTransaction transaction(fp4);
 
     // send channel effect first so master effect parameters are not reset
     // by channel effect parameters
@@ -47,7 +47,22 @@ SOURCES += \
     controllerkeysgenerator.cpp \
     keytimegenerator.cpp \
     voicinggenerator.cpp \
-    chordselecterdialog.cpp
+    harmonizer.cpp \
+    arpeggiatorgenerator.cpp \
+    chordselecterdialog.cpp \
+    midithread.cpp \
+    fp4memorymap.cpp \
+    dt1transaction.cpp \
+    sysexpacer.cpp \
+    controlrateengine.cpp \
+    tempotracker.cpp \
+    latencystats.cpp \
+    latencywindow.cpp \
+    alsaseqbackend.cpp \
+    loopbackbackend.cpp \
+    rawmidibackend.cpp \
+    controllerparser.cpp \
+    atomtable.cpp
 
 HEADERS += \
     fp4win.h \
@@ -100,7 +115,26 @@ HEADERS += \
     controllerkeysgenerator.h \
     keytimegenerator.h \
     voicinggenerator.h \
-    chordselecterdialog.h
+    harmonizer.h \
+    arpeggiatorgenerator.h \
+    chordselecterdialog.h \
+    midithread.h \
+    spscring.h \
+    notetracker.h \
+    dt1message.h \
+    fp4memorymap.h \
+    dt1transaction.h \
+    sysexpacer.h \
+    controlrateengine.h \
+    tempotracker.h \
+    latencystats.h \
+    latencywindow.h \
+    midibackend.h \
+    alsaseqbackend.h \
+    loopbackbackend.h \
+    rawmidibackend.h \
+    controllerparser.h \
+    atomtable.h
 
 QMAKE_CXXFLAGS += -std=c++0x
 LIBS += -lasound
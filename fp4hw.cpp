@@ -19,10 +19,28 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 ******************************************************************************/
 
 #include "fp4hw.h"
+#include "dt1message.h"
+#include "alsaseqbackend.h"
 #include <iostream>
 #include <iomanip>
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
+
+/* Number of output batches the current thread is in. Events written inside
+   a batch go to the output buffer of the backend, which is shared by all
+   threads, see FP4::writeEvent(). */
+static thread_local int s_outputBatchDepth = 0;
+
+/* Input event whose output the current thread is producing. */
+static thread_local LatencyContext s_latencyContext = { false, LatencyDirect, 0 };
+
+/* monotonic time in us */
+static uint64_t monotonicTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 /* Data structure to keep track of alsa ports */
 
@@ -45,27 +63,54 @@ AlsaClientInfo::~AlsaClientInfo() {
 
 /*-------------------------------------------------------------------------------*/
 
-FP4::FP4(const char* client_name) :
+FP4::FP4(const char* client_name, MidiBackend* backend) :
+    m_seq(0),
+    m_backend(backend),
+    m_hin(-1),
+    m_hout(-1),
+    m_client_id(-1),
     m_autoreconnect(false),
     m_autoclient_id(0),
     m_autoclient(0),
     m_autoport(-1),
     m_outputEnabled(true),
     m_wasConnected(false),
+    m_maxBatchDelay(DEFAULT_MAX_BATCH_DELAY),
+    m_outputPending(false),
+    m_firstPending(0),
+    m_memoryMapEnabled(true),
+    m_transactionDepth(0),
+    m_queue(-1),
+    m_nextScheduleTag(0),
+    m_queueStartMonotonic(0),
+    m_inputTimestamps(false),
     m_traceMode(0)
 {
     m_client_name = strdup(client_name);
 
     clearKeyStateBuffer();
-
-    openClient();
-    openSystem();
+    memset(&m_transactionReport, 0, sizeof(m_transactionReport));
+    memset(m_sentControllers, -1, sizeof(m_sentControllers));
+    memset(m_scheduleGenerations, 0, sizeof(m_scheduleGenerations));
+
+    // without a sequencer there is nothing to connect to, the backend may
+    // emulate the output queue
+    if (!m_backend) {
+        openClient();
+        openSystem();
+        m_backend = new AlsaSeqBackend(m_seq);
+    }
+    else {
+        m_queue = m_backend->queue();
+        m_client_id = m_backend->client();
+    }
 
     m_input_id = -1;
     m_input_port = 0;
 }
 
 FP4::~FP4() {
+    delete m_backend;
     closeClient();
 
     if (m_autoclient) {
@@ -85,15 +130,26 @@ bool FP4::open(const char *client_name, int port) {
 }
 
 bool FP4::open(int client_id, int port) {
-    if (!openInput(client_id, port)) {
-        return false;
+    if (!m_seq) {
+        // the backend talks to the device directly
+        if (!m_backend->connect()) {
+            return false;
+        }
     }
+    else {
+        if (!openInput(client_id, port)) {
+            return false;
+        }
 
-    if (!openOutput(client_id, port)) {
-        closeInput();
-        return false;
+        if (!openOutput(client_id, port)) {
+            closeInput();
+            return false;
+        }
     }
 
+    // the device may have been reset or replaced
+    invalidateMemoryMap();
+
     if (!m_wasConnected) {
         onConnect();
     }
@@ -112,6 +168,10 @@ void FP4::close() {
 }
 
 bool FP4::openSecondary(int client_id, int port, PortType dir) {
+    if (!m_seq) {
+        return false;
+    }
+
     if (dir == Readable) {
         return !snd_seq_connect_from( m_seq, m_hin, client_id, port);
     }
@@ -121,6 +181,10 @@ bool FP4::openSecondary(int client_id, int port, PortType dir) {
 }
 
 void FP4::closeSecondary(int client_id, int port, PortType dir) {
+    if (!m_seq) {
+        return;
+    }
+
     if (dir == Readable) {
         snd_seq_disconnect_from(m_seq, m_hin, client_id, port);
     }
@@ -132,6 +196,10 @@ void FP4::closeSecondary(int client_id, int port, PortType dir) {
 bool FP4::openInput(int client_id, int port) {
     closeInput();
 
+    if (!m_seq) {
+        return false;
+    }
+
     if (snd_seq_connect_from( m_seq, m_hin, client_id, port )) {
         return false;
     }
@@ -163,6 +231,10 @@ void FP4::closeInput() {
 bool FP4::openOutput(int client_id, int port) {
     closeOutput();
 
+    if (!m_seq) {
+        return false;
+    }
+
     // 1 is the output port
     if (snd_seq_connect_to(m_seq, m_hout, client_id, port)) {
         return false;
@@ -218,6 +290,9 @@ int FP4::resolveClientName(const char* client_name, PortType type) {
 
 vector< AlsaClientInfo > FP4::getPortList(PortType type) {
     vector< AlsaClientInfo > clients;
+    if (!m_seq) {
+        return clients;
+    }
 
     uint perm = 0;
     switch ( type ) {
@@ -319,12 +394,44 @@ void FP4::openClient() {
 
     m_client_id = snd_seq_client_id( m_seq );
 
-    // create ports
-    m_hin = snd_seq_create_simple_port(
-                m_seq,
-                "In",
-                SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
-                SND_SEQ_PORT_TYPE_APPLICATION );
+    // queue for scheduled output and input timestamps. without it scheduled
+    // events are sent directly.
+    m_queue = snd_seq_alloc_named_queue( m_seq, OUTPUT_QUEUE_NAME );
+    if (m_queue < 0) {
+        cerr << "FP4: cannot allocate output queue. Scheduled events are sent immediately." << endl;
+    }
+    else {
+        setQueueTempo(DEFAULT_QUEUE_BPM, DEFAULT_QUEUE_PPQ);
+        snd_seq_start_queue( m_seq, m_queue, NULL );
+        snd_seq_drain_output( m_seq );
+        m_queueStartMonotonic = monotonicTime() - queueTime();
+    }
+
+    // create ports. incoming events get a real time stamp from the queue.
+    m_hin = -1;
+    if (m_queue >= 0) {
+        snd_seq_port_info_t* info;
+        snd_seq_port_info_alloca(&info);
+        snd_seq_port_info_set_name(info, "In");
+        snd_seq_port_info_set_capability(info, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE);
+        snd_seq_port_info_set_type(info, SND_SEQ_PORT_TYPE_APPLICATION);
+        snd_seq_port_info_set_timestamping(info, 1);
+        snd_seq_port_info_set_timestamp_real(info, 1);
+        snd_seq_port_info_set_timestamp_queue(info, m_queue);
+
+        if (snd_seq_create_port( m_seq, info ) >= 0) {
+            m_hin = snd_seq_port_info_get_port(info);
+            m_inputTimestamps = true;
+        }
+    }
+
+    if (m_hin < 0) {
+        m_hin = snd_seq_create_simple_port(
+                    m_seq,
+                    "In",
+                    SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                    SND_SEQ_PORT_TYPE_APPLICATION );
+    }
 
     m_hout = snd_seq_create_simple_port(
                 m_seq,
@@ -334,6 +441,12 @@ void FP4::openClient() {
 }
 
 void FP4::closeClient() {
+    if ( m_seq && m_queue >= 0 ) {
+        snd_seq_stop_queue( m_seq, m_queue, NULL );
+        snd_seq_free_queue( m_seq, m_queue );
+        m_queue = -1;
+    }
+
     if ( m_seq ) {
         snd_seq_close( m_seq );
     }
@@ -371,8 +484,11 @@ void FP4::openSystem() {
 void FP4::processEvents() {
     snd_seq_event_t* ev_in;
 
+    // everything sent while handling this batch of input is flushed once
+    FP4OutputBatch batch(this);
+
     do {
-        int err=snd_seq_event_input( m_seq, &ev_in );
+        int err=m_backend->input( &ev_in );
         if (err == -EAGAIN) {
             // nothing to read from input fifo
             return;
@@ -382,10 +498,35 @@ void FP4::processEvents() {
             // fifo is full
             cerr << "FP4: seq FIFO input buffer full. Events are lost." << endl;
         }
+        else if (err == -ENODEV) {
+            // a backend that talks to the device directly lost it
+            cerr << "FP4: MIDI device disconnected." << endl;
+            invalidateMemoryMap();
+            clearOutputQueue();
+            onDisconnect();
+            return;
+        }
+        else if (err < 0) {
+            cerr << "FP4: event input returned failure: " << err << endl;
+            return;
+        }
 
         // if (ev_in->type != SND_SEQ_EVENT_CLOCK)
         //     cout << "<- event " << (int)ev_in->type << endl;
 
+        // output caused by this event is measured from its timestamp
+        if (m_inputTimestamps && ev_in->queue == m_queue
+                && (ev_in->flags & SND_SEQ_TIME_STAMP_MASK) == SND_SEQ_TIME_STAMP_REAL) {
+            s_latencyContext.valid = true;
+            s_latencyContext.stage = LatencyDirect;
+            s_latencyContext.timestamp = (uint64_t)ev_in->time.time.tv_sec * 1000000 + ev_in->time.time.tv_nsec / 1000;
+        }
+        else {
+            // not timestamped by ALSA, use the time it was read
+            s_latencyContext.valid = false;
+            s_latencyContext.timestamp = queueNow();
+        }
+
         switch ( ev_in->type ) {
         case SND_SEQ_EVENT_CONTROLLER: {
             int cc_channel = ev_in->data.control.channel;
@@ -396,6 +537,12 @@ void FP4::processEvents() {
         }
 
         case SND_SEQ_EVENT_NOTEON: {
+            // a scheduled note that is due
+            if (ev_in->source.client == m_client_id) {
+                playScheduledNote(ev_in);
+                break;
+            }
+
             int note_channel = ev_in->data.note.channel;
             int note_value = ev_in->data.note.note;
             int note_velocity = ev_in->data.note.velocity;
@@ -404,6 +551,11 @@ void FP4::processEvents() {
         }
 
         case SND_SEQ_EVENT_NOTEOFF: {
+            if (ev_in->source.client == m_client_id) {
+                playScheduledNote(ev_in);
+                break;
+            }
+
             int note_channel = ev_in->data.note.channel;
             int note_value = ev_in->data.note.note;
             onNoteOff(note_channel, note_value);
@@ -463,6 +615,8 @@ void FP4::processEvents() {
                 cerr << "FP4: Main input disconnected." << endl;
                 m_input_id = -1;
                 m_input_port = -1;
+                invalidateMemoryMap();
+                clearOutputQueue();
                 onDisconnect();
             }
 
@@ -489,7 +643,23 @@ void FP4::processEvents() {
         }
 
         case SND_SEQ_EVENT_CLOCK:
-            // ignore clock events
+            m_tempoTracker.clock(eventTime());
+            break;
+
+        case SND_SEQ_EVENT_START:
+            m_tempoTracker.start();
+            break;
+
+        case SND_SEQ_EVENT_CONTINUE:
+            m_tempoTracker.resume();
+            break;
+
+        case SND_SEQ_EVENT_STOP:
+            m_tempoTracker.stop();
+            break;
+
+        case SND_SEQ_EVENT_SONGPOS:
+            m_tempoTracker.setSongPosition(ev_in->data.control.value);
             break;
 
         case SND_SEQ_EVENT_SYSEX:
@@ -501,37 +671,28 @@ void FP4::processEvents() {
             break;
         }
 
-        snd_seq_free_event(ev_in);
+        s_latencyContext.valid = false;
+        s_latencyContext.timestamp = 0;
 
-    } while (snd_seq_event_input_pending(m_seq, 0) > 0);
+    } while (m_backend->inputPending());
 } 
 
 void FP4::sendProgramChange(int channel, int program) {
     if (m_outputEnabled) {
         trace(TraceProgramChanges, ">> PGM CHANGE channel: %i program: %i", channel, program);
         snd_seq_event_t ev;
-        snd_seq_ev_set_direct(&ev);
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
         snd_seq_ev_set_pgmchange(&ev, channel, program);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        outputEvent(&ev);
     }
 }
 
 void FP4::sendBankChange(int channel, int msb, int lsb) {
     if (m_outputEnabled) {
         trace(TraceProgramChanges, ">> BANK CHANGE channel: %i bank: %i %i", channel, msb, lsb);
-        snd_seq_event_t ev;
-        snd_seq_ev_set_direct(&ev);
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_controller(&ev, channel, 0, msb);
-        snd_seq_event_output_direct(m_seq, &ev);
-
-        snd_seq_ev_set_controller(&ev, channel, 32, lsb);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        FP4OutputBatch batch(this);
+        sendController(channel, 0, msb);
+        sendController(channel, 32, lsb);
     }
 }
 
@@ -539,37 +700,53 @@ void FP4::sendNoteOn(int channel, int note, int velocity) {
     if (m_outputEnabled) {
         trace(TraceNotes, ">> NOTE ON channel: %i note: %i velocity: %i", channel, note, velocity);
 
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        snd_seq_event_t ev;
         if (isKeyPressed(channel, note)) {
-            cerr << "Duplicate note on." << endl;
-            sendNoteOff(channel, note);
-            //        return;
+            // retrigger the note, the note stays held until every note on is
+            // matched by a note off
+            trace(TraceNotes, ">> NOTE OFF channel: %i note: %i (retrigger)", channel, note);
+            snd_seq_ev_set_noteoff(&ev, channel, note, 0);
+            outputEvent(&ev);
         }
 
-        snd_seq_event_t ev;
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_direct(&ev);
         snd_seq_ev_set_noteon(&ev, channel, note, velocity);
-        snd_seq_event_output(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        outputEvent(&ev);
 
         registerKeyPress(channel, note);
     }
 }
 
+/* The note off is only sent when the last hold on the note is released. Notes
+   that are not known to be held are always released, unless a scheduled
+   note holds them. */
 void FP4::sendNoteOff(int channel, int note) {
     if (m_outputEnabled) {
-        trace(TraceNotes, ">> NOTE OFF channel: %i note: %i", channel, note);
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        registerKeyRelease(channel, note);
+        if (isKeyPressed(channel, note)) {
+            trace(TraceNotes, ">> NOTE OFF channel: %i note: %i (still held)", channel, note);
+            return;
+        }
 
+        trace(TraceNotes, ">> NOTE OFF channel: %i note: %i", channel, note);
         snd_seq_event_t ev;
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_direct(&ev);
         snd_seq_ev_set_noteoff(&ev, channel, note, 0);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        outputEvent(&ev);
+    }
+}
 
-        registerKeyRelease(channel, note);
+/* send a note off for every note sounding on channel, however many times it
+   is held */
+void FP4::sendNotesOff(int channel) {
+    if (m_outputEnabled) {
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        m_notes.releaseChannel(channel, [&](int note) {
+            trace(TraceNotes, ">> NOTE OFF channel: %i note: %i", channel, note);
+            snd_seq_event_t ev;
+            snd_seq_ev_set_noteoff(&ev, channel, note, 0);
+            outputEvent(&ev);
+        });
     }
 }
 
@@ -577,22 +754,89 @@ void FP4::sendController(int channel, int cc, int value) {
     if (m_outputEnabled) {
         trace(TraceNotes, ">> CTL channel: %i cc: %i value: %i", channel, cc, value);
 
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
         snd_seq_event_t ev;
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_direct(&ev);
         snd_seq_ev_set_controller(&ev, channel, cc, value);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        outputEvent(&ev);
+
+        rememberController(channel, cc, value);
+    }
+}
+
+/* keep track of the controller values the FP4 holds. Selecting another
+   parameter makes the data entry values unknown, and selecting a RPN
+   deselects the NRPN and vice-versa. */
+void FP4::rememberController(int channel, int cc, int value) {
+    if (channel < 0 || channel >= 16 || cc < 0 || cc >= 128) {
+        return;
+    }
+
+    int8_t* sent = m_sentControllers[channel];
+
+    // the LSB of a 14-bit controller is reset by its MSB
+    if (cc < 32) {
+        sent[cc + 32] = -1;
+    }
+
+    if (sent[cc] == value) {
+        return;
+    }
+
+    switch (cc) {
+    case 98:
+    case 99:
+        sent[100] = sent[101] = -1;
+        sent[6] = sent[38] = -1;
+        break;
+    case 100:
+    case 101:
+        sent[98] = sent[99] = -1;
+        sent[6] = sent[38] = -1;
+        break;
+    case 121:
+        // reset all controllers
+        memset(sent, -1, 128);
+        return;
+    }
+
+    sent[cc] = value;
+}
+
+/* Send a 14-bit value as MSB and LSB controllers. Only the LSB is sent if the
+   MSB didn't change. A receiver may reset the LSB when it gets a new MSB, so
+   the LSB is always sent after the MSB. */
+void FP4::sendControllerPair(int channel, int msbCC, int lsbCC, int value) {
+    int lsb = value & 0x7f;
+    int msb = (value>>7) & 0x7f;
+
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    FP4OutputBatch batch(this);
+
+    bool known = channel >= 0 && channel < 16;
+    if (!known || m_sentControllers[channel][msbCC] != msb) {
+        sendController(channel, msbCC, msb);
+        sendController(channel, lsbCC, lsb);
+    }
+    else if (m_sentControllers[channel][lsbCC] != lsb) {
+        sendController(channel, lsbCC, lsb);
+    }
+}
+
+/* select a RPN or NRPN, unless it is already selected */
+void FP4::selectParameter(int channel, int msbCC, int lsbCC, int msb, int lsb) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+
+    bool known = channel >= 0 && channel < 16;
+    if (!known || m_sentControllers[channel][msbCC] != msb || m_sentControllers[channel][lsbCC] != lsb) {
+        FP4OutputBatch batch(this);
+        sendController(channel, lsbCC, lsb);
+        sendController(channel, msbCC, msb);
     }
 }
 
 void FP4::sendControllerHires(int channel, int cc, int value) {
     if (m_outputEnabled) {
-        int lsb = value & 0x7f;
-        int msb = (value>>7) & 0x7f;
-        sendController(channel, cc, msb);
-        sendController(channel, cc+0x20, lsb);
+        sendControllerPair(channel, cc, cc+0x20, value);
     }
 }
 
@@ -606,16 +850,13 @@ void FP4::sendPitchChange(int channel, int pitch) {
 
         // Doesn't seem to work
         snd_seq_event_t ev;
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_direct(&ev);
         snd_seq_ev_set_pitchbend(&ev, channel, pitch);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        outputEvent(&ev);
     }
 }
 
-// change pitch bend range (0-24 semitones)
+/* change pitch bend range (0-24 semitones) with RPN 0, then select the null
+   RPN. Sent as controllers, so the parameter selection is remembered. */
 void FP4::sendPitchRange(int channel, int range) {
     if (!m_outputEnabled)
         return;
@@ -625,19 +866,12 @@ void FP4::sendPitchRange(int channel, int range) {
     if (range < 0) range=0;
     if (range > 24) range=24;
 
-    uint8_t data[] = {
-        (uint8_t)(0xb0 + channel),  // controller change
-        0x64, 00,                   // rpn low
-        0x65, 00,                   // rpn high
-        0x06, (uint8_t)range,       // data entry1
-        0x26, 0,                    // data entry2
-        0x64, 0x7f,                 // rpn low reset
-        0x65, 0x7f                  // rpn high reset
-    };
-
-    if (m_outputEnabled) {
-        sendBytes(data, sizeof(data));
-    }
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    FP4OutputBatch batch(this);
+    selectParameter(channel, 101, 100, 0, 0);
+    sendController(channel, 6, range);
+    sendController(channel, 38, 0);
+    selectParameter(channel, 101, 100, 0x7f, 0x7f);
 }
 
 // send a channel pressure message to channel
@@ -645,12 +879,8 @@ void FP4::sendChannelPressure(int channel, int pressure) {
     if (m_outputEnabled) {
         trace(TraceChannelPressure, ">> CHANNEL PRESSURE channel: %i pressure: %i", channel, pressure);
         snd_seq_event_t ev;
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_direct(&ev);
         snd_seq_ev_set_chanpress(&ev, channel, pressure);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        outputEvent(&ev);
     }
 }
 
@@ -659,12 +889,8 @@ void FP4::sendPortamentoControl(int channel, int note) {
     if (m_outputEnabled) {
         trace(TracePortamento, ">> PORTAMENTO CONTROL channel: %i note: %i", channel, note);
         snd_seq_event_t ev;
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_direct(&ev);
         snd_seq_ev_set_controller(&ev, channel, 84, note);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        outputEvent(&ev);
     }
 }
 
@@ -672,13 +898,13 @@ void FP4::sendPortamentoControl(int channel, int note) {
 void FP4::sendAllSoundsOff(int channel) {
     if (m_outputEnabled) {
         trace(TraceChannelControl, ">> SOUNDS OFF channel: %i", channel);
+
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
         snd_seq_event_t ev;
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_direct(&ev);
         snd_seq_ev_set_controller(&ev, channel, 120, 0);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        outputEvent(&ev);
+
+        forgetChannelNotes(channel);
     }
 }
 
@@ -687,13 +913,13 @@ void FP4::sendAllSoundsOff(int channel) {
 void FP4::sendAllNotesOff(int channel) {
     if (m_outputEnabled) {
         trace(TraceChannelControl, ">> NOTES OFF channel: %i", channel);
+
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
         snd_seq_event_t ev;
-        snd_seq_ev_set_source(&ev, m_input_port);
-        snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
-        snd_seq_ev_set_direct(&ev);
-        snd_seq_ev_set_controller(&ev, channel, 120, 0);
-        snd_seq_event_output_direct(m_seq, &ev);
-        snd_seq_drain_output(m_seq);
+        snd_seq_ev_set_controller(&ev, channel, 123, 0);
+        outputEvent(&ev);
+
+        forgetChannelNotes(channel);
     }
 }
 
@@ -702,48 +928,536 @@ void FP4::sendBytes(unsigned char data[], unsigned int length) {
     if (m_outputEnabled) {
         trace(TraceSysex, ">> SYSEX bytes: %i", length);
         snd_seq_event_t ev;
+        snd_seq_ev_set_sysex(&ev, length, data);
+        outputEvent(&ev);
+    }
+}
+
+/* Write a single event to the FP4. Every send method ends up here. Output
+   is used from both the MIDI thread and the GUI thread, so access to the
+   sequencer output is serialized.
+   Inside an output batch the event is only buffered. The buffer is flushed
+   when the batch ends or when the oldest buffered event exceeds the maximum
+   batch delay. */
+void FP4::outputEvent(snd_seq_event_t* ev) {
+    snd_seq_ev_set_source(ev, m_input_port);
+    snd_seq_ev_set_dest(ev, m_output_id, m_output_port);
+    snd_seq_ev_set_direct(ev);
+
+    if (s_latencyContext.valid) {
+        recordLatency(ev);
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+
+    if (ev->type == SND_SEQ_EVENT_SYSEX && m_sysexPacer.isEnabled()) {
+        uint64_t now = monotonicTime();
+        unsigned int length = ev->data.ext.len;
+
+        if (m_sysexPacer.isEmpty() && m_sysexPacer.canSend(length, now)) {
+            m_sysexPacer.consume(length);
+        }
+        else if (m_sysexPacer.enqueue((const uint8_t*)ev->data.ext.ptr, length, now)) {
+            onOutputQueued();
+            return;
+        }
+        else {
+            // no room: give up pacing rather than reordering messages
+            m_sysexPacer.countOverflow();
+            sendQueuedSysex(true);
+            m_sysexPacer.consume(length);
+        }
+    }
+    else if (!m_sysexPacer.isEmpty()) {
+        // queued sysex goes first: a reset sent after this event would wipe it
+        sendQueuedSysex(true);
+    }
+
+    writeEvent(ev);
+}
+
+/* Send queued sysex messages the budget allows, or all of them if force is
+   set. Returns the number of messages sent. */
+int FP4::sendQueuedSysex(bool force) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+
+    if (m_sysexPacer.isEmpty()) {
+        return 0;
+    }
+
+    FP4OutputBatch batch(this);
+    uint64_t now = monotonicTime();
+    int count = 0;
+
+    const uint8_t* data;
+    unsigned int length;
+    while (force ? m_sysexPacer.peek(data, length) : m_sysexPacer.front(data, length, now)) {
+        snd_seq_event_t ev;
+        snd_seq_ev_clear(&ev);
+        snd_seq_ev_set_sysex(&ev, length, (void*)data);
         snd_seq_ev_set_source(&ev, m_input_port);
         snd_seq_ev_set_dest(&ev, m_output_id, m_output_port);
         snd_seq_ev_set_direct(&ev);
-        snd_seq_ev_set_sysex(&ev, length, data);
-        int ret = snd_seq_event_output_direct(m_seq, &ev);
+        writeEvent(&ev);
+
+        m_sysexPacer.pop(now);
+        ++count;
+    }
+
+    return count;
+}
+
+/* Send paced sysex messages that are due, and buffered events that were
+   held for the maximum batch delay. Call this regularly, outputQueueTimeout()
+   tells when something is due. */
+void FP4::processOutputQueue() {
+    sendQueuedSysex(false);
+
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    if (m_outputPending && monotonicTime() - m_firstPending >= (uint64_t)m_maxBatchDelay) {
+        flushOutput();
+    }
+}
+
+/* descriptors of the backend to poll for POLLOUT while output it couldn't
+   take waits in its buffer. Call flushOutput() when one is writable. */
+int FP4::outputPollDescriptors(struct pollfd *pfds, int space) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    return m_backend->outputPollDescriptors(pfds, space);
+}
+
+/* ms until processOutputQueue() has something to send, or -1 */
+int FP4::outputQueueTimeout() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    uint64_t now = monotonicTime();
+    int timeout = m_sysexPacer.timeout(now);
+
+    if (m_outputPending) {
+        uint64_t due = m_firstPending + m_maxBatchDelay;
+        int flushTimeout = due > now ? (int)((due - now + 999) / 1000) : 0;
+        if (timeout < 0 || flushTimeout < timeout) {
+            timeout = flushTimeout;
+        }
+    }
+
+    return timeout;
+}
+
+void FP4::clearOutputQueue() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    m_sysexPacer.clear();
+}
+
+/* limit sysex output to bytesPerMs. 0 sends sysex without delay. */
+void FP4::setSysexBudget(double bytesPerMs) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    m_sysexPacer.setBytesPerMs(bytesPerMs);
+
+    if (!m_sysexPacer.isEnabled()) {
+        sendQueuedSysex(true);
+    }
+}
+
+double FP4::sysexBudget() const {
+    return m_sysexPacer.bytesPerMs();
+}
+
+SysexPacerStats FP4::outputStats() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    return m_sysexPacer.stats();
+}
+
+void FP4::resetOutputStats() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    m_sysexPacer.resetStats();
+}
+
+/* Schedule an event on the output queue at a tick (absolute, or relative to
+   the current queue position). Events are written to the sequencer at once
+   and delivered by ALSA when they are due. A non zero tag can be used to
+   cancel them with cancelScheduled(). */
+void FP4::sendAtTick(snd_seq_event_t *ev, snd_seq_tick_time_t tick, bool relative, int tag) {
+    // an emulated queue has no tempo
+    if (m_queue < 0 || !m_seq) {
+        outputEvent(ev);
+        return;
+    }
+
+    snd_seq_ev_set_source(ev, m_input_port);
+    snd_seq_ev_set_dest(ev, m_output_id, m_output_port);
+    snd_seq_ev_schedule_tick(ev, m_queue, relative, tick);
+    snd_seq_ev_set_tag(ev, tag);
+
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    writeEvent(ev);
+}
+
+/* Schedule an event on the output queue at a time in us (absolute queue
+   time, or relative to now). */
+void FP4::sendAtTime(snd_seq_event_t *ev, uint64_t usec, bool relative, int tag) {
+    if (m_queue < 0) {
+        outputEvent(ev);
+        return;
+    }
+
+    snd_seq_real_time_t time;
+    time.tv_sec = usec / 1000000;
+    time.tv_nsec = (usec % 1000000) * 1000;
+
+    snd_seq_ev_set_source(ev, m_input_port);
+    snd_seq_ev_set_dest(ev, m_output_id, m_output_port);
+    snd_seq_ev_schedule_real(ev, m_queue, relative, &time);
+    snd_seq_ev_set_tag(ev, tag);
+
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    writeEvent(ev);
+}
+
+/* Scheduled notes are held in the key state buffer by KeysScheduled from
+   the moment they are due, see playScheduledNote(). */
+void FP4::sendNoteOnAt(uint64_t usec, int channel, int note, int velocity, int tag, bool relative) {
+    if (m_outputEnabled) {
+        trace(TraceNotes, ">> NOTE ON channel: %i note: %i velocity: %i %s %lli us", channel, note, velocity,
+              relative ? "in" : "at", (long long)usec);
+        snd_seq_event_t ev;
+        snd_seq_ev_clear(&ev);
+        snd_seq_ev_set_noteon(&ev, channel, note, velocity);
+        sendScheduledNote(&ev, usec, relative, tag);
+    }
+}
+
+void FP4::sendNoteOffAt(uint64_t usec, int channel, int note, int tag, bool relative) {
+    if (m_outputEnabled) {
+        trace(TraceNotes, ">> NOTE OFF channel: %i note: %i %s %lli us", channel, note,
+              relative ? "in" : "at", (long long)usec);
+        snd_seq_event_t ev;
+        snd_seq_ev_clear(&ev);
+        snd_seq_ev_set_noteoff(&ev, channel, note, 0);
+        sendScheduledNote(&ev, usec, relative, tag);
+    }
+}
+
+/* Schedule a note to come back to FP4's input port, with the generation of
+   its tag in the duration field. Without a queue it is played now. */
+void FP4::sendScheduledNote(snd_seq_event_t *ev, uint64_t usec, bool relative, int tag) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    snd_seq_ev_set_tag(ev, tag);
+    ev->data.note.duration = m_scheduleGenerations[tag & 0xff];
+
+    if (m_queue < 0) {
+        playScheduledNote(ev);
+        return;
+    }
+
+    snd_seq_real_time_t time;
+    time.tv_sec = usec / 1000000;
+    time.tv_nsec = (usec % 1000000) * 1000;
+
+    snd_seq_ev_set_source(ev, m_hout);
+    snd_seq_ev_set_dest(ev, m_client_id, m_hin);
+    snd_seq_ev_schedule_real(ev, m_queue, relative, &time);
+    writeEvent(ev);
+}
+
+/* Send a scheduled note that is due, unless its tag was cancelled after it
+   was scheduled. It holds the note like a note played directly: the note is
+   retriggered if it sounds, and the note off is only sent when nothing else
+   holds the note. */
+void FP4::playScheduledNote(const snd_seq_event_t *ev) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    if (!m_outputEnabled || ev->data.note.duration != m_scheduleGenerations[ev->tag & 0xff]) {
+        return;
+    }
+
+    int channel = ev->data.note.channel;
+    int note = ev->data.note.note;
+    snd_seq_event_t out;
+
+    if (ev->type == SND_SEQ_EVENT_NOTEON && ev->data.note.velocity > 0) {
+        if (isKeyPressed(channel, note)) {
+            trace(TraceNotes, ">> NOTE OFF channel: %i note: %i (retrigger)", channel, note);
+            snd_seq_ev_set_noteoff(&out, channel, note, 0);
+            outputEvent(&out);
+        }
+
+        snd_seq_ev_set_noteon(&out, channel, note, ev->data.note.velocity);
+        outputEvent(&out);
+        m_notes.press(KeysScheduled, channel, note);
+        return;
+    }
+
+    // the note on was cancelled, or something else still holds the note
+    if (m_notes.release(KeysScheduled, channel, note) != 0) {
+        return;
+    }
+
+    snd_seq_ev_set_noteoff(&out, channel, note, 0);
+    outputEvent(&out);
+}
+
+/* release every scheduled note that is playing on channel, whoever
+   scheduled it. Notes held by something else keep sounding. */
+void FP4::releaseScheduledNotes(int channel) {
+    if (channel < 0 || channel >= 16) {
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    FP4OutputBatch batch(this);
+    m_notes.releaseAll(KeysScheduled, channel, [&](int note, int) {
+        if (!isKeyPressed(channel, note) && m_outputEnabled) {
+            trace(TraceNotes, ">> NOTE OFF channel: %i note: %i (scheduled)", channel, note);
+            snd_seq_event_t ev;
+            snd_seq_ev_set_noteoff(&ev, channel, note, 0);
+            outputEvent(&ev);
+        }
+    });
+}
+
+void FP4::sendControllerAt(uint64_t usec, int channel, int cc, int value, int tag) {
+    if (m_outputEnabled) {
+        trace(TraceControllers, ">> CONTROLLER channel: %i cc: %i value: %i in %i us", channel, cc, value, (int)usec);
+        snd_seq_event_t ev;
+        snd_seq_ev_clear(&ev);
+        snd_seq_ev_set_controller(&ev, channel, cc, value);
+        sendAtTime(&ev, usec, true, tag);
+    }
+}
+
+/* Remove events with this tag that are still waiting in the output queue.
+   Events that were buffered in a batch but not flushed yet are flushed first
+   so they can be removed too. Scheduled notes with this tag that were
+   delivered but not read yet are dropped when they are read. */
+void FP4::cancelScheduled(int tag) {
+    if (m_queue < 0 || tag == 0) {
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    ++m_scheduleGenerations[tag & 0xff];
+
+    if (m_outputPending) {
+        flushOutput();
+    }
+
+    m_backend->removeScheduled(m_queue, tag);
+}
+
+/* get a tag for cancelScheduled(). tags are reused after 255 calls. */
+int FP4::allocateScheduleTag() {
+    return (m_nextScheduleTag++ % 255) + 1;
+}
+
+void FP4::setQueueTempo(int bpm, int ppq) {
+    if (m_queue < 0 || !m_seq || bpm <= 0) {
+        return;
+    }
+
+    snd_seq_queue_tempo_t* tempo;
+    snd_seq_queue_tempo_alloca(&tempo);
+    snd_seq_queue_tempo_set_tempo(tempo, 60000000 / bpm);
+    snd_seq_queue_tempo_set_ppq(tempo, ppq);
+    snd_seq_set_queue_tempo(m_seq, m_queue, tempo);
+}
+
+snd_seq_tick_time_t FP4::queueTick() {
+    if (m_queue < 0 || !m_seq) {
+        return 0;
+    }
+
+    snd_seq_queue_status_t* status;
+    snd_seq_queue_status_alloca(&status);
+    snd_seq_get_queue_status(m_seq, m_queue, status);
+    return snd_seq_queue_status_get_tick_time(status);
+}
+
+uint64_t FP4::queueTime() {
+    if (m_queue < 0) {
+        return 0;
+    }
+
+    // an emulated queue runs on monotonic time
+    if (!m_seq) {
+        return queueNow();
+    }
+
+    snd_seq_queue_status_t* status;
+    snd_seq_queue_status_alloca(&status);
+    snd_seq_get_queue_status(m_seq, m_queue, status);
+    const snd_seq_real_time_t* time = snd_seq_queue_status_get_real_time(status);
+    return (uint64_t)time->tv_sec * 1000000 + time->tv_nsec / 1000;
+}
+
+/* current time of the output queue in us, without asking the sequencer. */
+uint64_t FP4::queueNow() const {
+    return monotonicTime() - m_queueStartMonotonic;
+}
+
+/* Record the time since the input event of the current latency context was
+   timestamped. Time sysex messages spend in the pacer queue is not included,
+   see outputStats(). */
+void FP4::recordLatency(const snd_seq_event_t *ev) {
+    int eventClass;
+    switch (ev->type) {
+    case SND_SEQ_EVENT_NOTEON:
+    case SND_SEQ_EVENT_NOTEOFF:
+        eventClass = LatencyNote;
+        break;
+    case SND_SEQ_EVENT_SYSEX:
+        eventClass = LatencySysex;
+        break;
+    default:
+        eventClass = LatencyController;
+        break;
+    }
+
+    uint64_t now = queueNow();
+    uint64_t latency = now > s_latencyContext.timestamp ? now - s_latencyContext.timestamp : 0;
+    m_latencyStats.record(eventClass, s_latencyContext.stage, latency);
+}
+
+LatencyContext FP4::latencyContext() {
+    return s_latencyContext;
+}
+
+/* Queue time in us at which the input event handled by the current thread
+   was received, or the current time if it is not known. Unlike the time the
+   event is handled, this doesn't depend on how busy the threads are. */
+uint64_t FP4::eventTime() const {
+    return s_latencyContext.timestamp ? s_latencyContext.timestamp : queueNow();
+}
+
+void FP4::setLatencyContext(const LatencyContext &context) {
+    s_latencyContext = context;
+}
+
+/* stages only go forward, see LatencyStage */
+void FP4::raiseLatencyStage(int stage) {
+    if (stage > s_latencyContext.stage) {
+        s_latencyContext.stage = stage;
+    }
+}
+
+/* Write an event to the sequencer, or to the output buffer in a batch. The
+   buffer is shared by all threads, so it is flushed before an event is
+   written directly: output stays in the order it was written. */
+void FP4::writeEvent(snd_seq_event_t *ev) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+
+    if (s_outputBatchDepth == 0 && m_outputPending) {
+        flushOutput();
+    }
+
+    // events still in the buffer would be overtaken, queue behind them
+    if (s_outputBatchDepth == 0 && !m_outputPending) {
+        int ret = m_backend->output(ev, false);
         if (ret < 0) {
-            cerr << "snd_seq_event_output_direct returned failure: " << ret;
+            cerr << "FP4: event output returned failure: " << ret << endl;
+        }
+        return;
+    }
+
+    uint64_t now = monotonicTime();
+    if (m_backend->output(ev, true) < 0) {
+        // buffer full: flush what we have and retry
+        flushOutput();
+        if (m_backend->output(ev, true) < 0) {
+            int ret = m_backend->output(ev, false);
+            if (ret < 0) {
+                cerr << "FP4: event output returned failure: " << ret << endl;
+            }
+            return;
+        }
+    }
+
+    if (!m_outputPending) {
+        m_outputPending = true;
+        m_firstPending = now;
+
+        // the MIDI thread flushes the buffer when it was held too long
+        onOutputQueued();
+    }
+
+    if (now - m_firstPending >= (uint64_t)m_maxBatchDelay) {
+        flushOutput();
+    }
+}
+
+/* Start collecting output events. Must be balanced with endOutputBatch(). */
+void FP4::beginOutputBatch() {
+    ++s_outputBatchDepth;
+}
+
+/* Flush buffered events when the outermost batch of this thread ends. */
+void FP4::endOutputBatch() {
+    if (s_outputBatchDepth <= 0) {
+        cerr << "FP4: unbalanced endOutputBatch()" << endl;
+        return;
+    }
+
+    if (--s_outputBatchDepth == 0) {
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        if (m_outputPending) {
+            flushOutput();
         }
     }
 }
 
+/* Write all buffered events to the sequencer. */
+void FP4::flushOutput() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+
+    // in non-blocking mode a positive return value is the number of bytes
+    // that could not be written yet. They are retried by
+    // processOutputQueue() when the maximum batch delay expired again.
+    int ret = m_backend->flush();
+    if (ret < 0 && ret != -EAGAIN) {
+        cerr << "FP4: output flush returned failure: " << ret << endl;
+    }
+
+    if (ret > 0 || ret == -EAGAIN) {
+        m_outputPending = true;
+        m_firstPending = monotonicTime();
+        onOutputQueued();
+    }
+    else {
+        m_outputPending = false;
+    }
+}
+
 void FP4::sendRPN(int channel, int msb, int lsb, int value) {
     if (m_outputEnabled) {
-        sendController(channel, 100, lsb);
-        sendController(channel, 101, msb);
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        FP4OutputBatch batch(this);
+        selectParameter(channel, 101, 100, msb, lsb);
         sendController(channel, 6, value);
     }
 }
 
 void FP4::sendNRPN(int channel, int msb, int lsb, int value) {
     if (m_outputEnabled) {
-        sendController(channel, 98, lsb);
-        sendController(channel, 99, msb);
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        FP4OutputBatch batch(this);
+        selectParameter(channel, 99, 98, msb, lsb);
         sendController(channel, 6, value);
     }
 }
 
 void FP4::sendRPNHires(int channel, int msb, int lsb, int value) {
     if (m_outputEnabled) {
-        sendController(channel, 100, lsb);
-        sendController(channel, 101, msb);
-        sendController(channel, 6, (value>>7)&0x7f);
-        sendController(channel, 38, value&0x7f);
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        FP4OutputBatch batch(this);
+        selectParameter(channel, 101, 100, msb, lsb);
+        sendControllerPair(channel, 6, 38, value);
     }
 }
 
 void FP4::sendNRPNHires(int channel, int msb, int lsb, int value) {
     if (m_outputEnabled) {
-        sendController(channel, 98, lsb);
-        sendController(channel, 99, msb);
-        sendController(channel, 6, (value>>7)&0x7f);
-        sendController(channel, 38, value&0x7f);
+        std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+        FP4OutputBatch batch(this);
+        selectParameter(channel, 99, 98, msb, lsb);
+        sendControllerPair(channel, 6, 38, value);
     }
 }
 
@@ -767,45 +1481,169 @@ void FP4::sendIdentityRequest() {
     }
 }
 
+/* Send a DT1 message. When the memory map is enabled, bytes the FP4 is
+   known to hold already are not sent again. */
 void FP4::sendData(unsigned char MSB, unsigned char FSB, unsigned char LSB, unsigned char data[], unsigned int length) {
     if (!m_outputEnabled) {
         return;
     }
 
     trace(TraceSystem, ">> DT1 address: %02x %02x %02x bytes: %i", MSB, FSB, LSB, length);
+    writeData(dt1Address(MSB, FSB, LSB), data, length);
+}
 
-    unsigned char ss[] = {
-        0xf0,
-        0x41, // roland
-        0x10, // device id
-        0x42, // model (GS)
-        0x12, // command (data transfer)
-    };
+void FP4::sendDataByte(unsigned char MSB, unsigned char FSB, unsigned char LSB, unsigned char value) {
+    if (!m_outputEnabled) {
+        return;
+    }
+
+    writeData(dt1Address(MSB, FSB, LSB), &value, 1);
+}
+
+void FP4::writeData(uint32_t address, const uint8_t *data, unsigned int length) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+
+    // a GS reset through DT1 is always sent and resets everything
+    if (address <= GS_RESET_ADDRESS && GS_RESET_ADDRESS < address + length) {
+        sendStagedData();
+        sendDT1(address, data, length);
+        m_memoryMap.clear();
+        return;
+    }
+
+    if (m_transactionDepth > 0) {
+        ++m_transactionReport.writes;
+        m_transactionReport.naiveBytes += length + DT1_MESSAGE_OVERHEAD * ((length + DT1_MAX_DATA - 1) / DT1_MAX_DATA);
 
-    unsigned int bufLen = 8 + length + 1 + 1; // length of total sysex message
-    unsigned char* buf = new unsigned char[bufLen];
-    memcpy(buf, ss, 5);
-    buf[5] = MSB;
-    buf[6] = FSB;
-    buf[7] = LSB;
+        // writes with side effects must not be reordered
+        if (FP4MemoryMap::hasSideEffects(address, length)) {
+            sendStagedData();
+            applyData(address, data, length);
+            flushMemoryMap();
+            return;
+        }
+
+        if (!m_transaction.stage(address, data, length)) {
+            sendStagedData();
+            if (!m_transaction.stage(address, data, length)) {
+                applyData(address, data, length);
+                flushMemoryMap();
+            }
+        }
+        return;
+    }
+
+    applyData(address, data, length);
+    flushMemoryMap();
+}
+
+/* write to the memory map, or send directly if the map is not used for this
+   range. Dirty bytes are sent by flushMemoryMap(). */
+void FP4::applyData(uint32_t address, const uint8_t *data, unsigned int length) {
+    if (!m_memoryMapEnabled || !m_memoryMap.contains(address, length)) {
+        m_memoryMap.invalidate(address, length);
+        sendDT1(address, data, length);
+        return;
+    }
+
+    if (m_memoryMap.write(address, data, length) == 0) {
+        trace(TraceSystem, ">> DT1 unchanged, skipped");
+    }
+}
+
+/* merge and send the writes staged in the current transaction */
+void FP4::sendStagedData() {
+    if (m_transaction.isEmpty()) {
+        return;
+    }
+
+    m_transaction.merge();
+
+    uint32_t address;
+    const uint8_t* data;
+    unsigned int length;
+    while (m_transaction.nextRange(address, data, length)) {
+        applyData(address, data, length);
+    }
+
+    m_transaction.clear();
+    flushMemoryMap();
+}
+
+void FP4::beginDataTransaction() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
 
-    memcpy(&buf[8], data, length);
+    if (m_transactionDepth++ == 0) {
+        memset(&m_transactionReport, 0, sizeof(m_transactionReport));
+    }
+}
+
+/* send everything when the outermost transaction ends. The report covers
+   the whole outermost transaction. */
+DT1TransactionReport FP4::commitDataTransaction() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+
+    if (m_transactionDepth > 0 && --m_transactionDepth == 0) {
+        FP4OutputBatch batch(this);
+        sendStagedData();
+
+        trace(TraceSystem, ">> DT1 transaction: %u writes, %u messages, %u bytes instead of %u",
+              m_transactionReport.writes, m_transactionReport.messages,
+              m_transactionReport.bytes, m_transactionReport.naiveBytes);
+    }
 
-    unsigned int checksum = 0;
-    checksum += MSB + FSB + LSB;
-    for (unsigned i=0; i<length; ++i) {
-        checksum += data[i];
+    return m_transactionReport;
+}
+
+/* send every dirty range of the memory map. Clean gaps shorter than the
+   overhead of a new message are sent along. */
+void FP4::flushMemoryMap() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+
+    FP4MemoryMap::Range range;
+    while (m_memoryMap.takeDirtyRange(range, DT1_MESSAGE_OVERHEAD, DT1_MAX_DATA)) {
+        sendDT1(range.address, m_memoryMap.data(range.address), range.length);
     }
-    checksum = 128 - (checksum % 128);
+}
+
+/* send a message that resets the device. Staged DT1 writes are sent before
+   it, and everything the memory map knows is forgotten. */
+void FP4::sendReset(unsigned char data[], unsigned int length) {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    sendStagedData();
+    sendBytes(data, length);
+    m_memoryMap.clear();
+}
 
-    buf[bufLen-2] = checksum;
-    buf[bufLen-1] = 0xf7;
+/* forget what the FP4 holds, so every parameter and controller is sent again */
+void FP4::invalidateMemoryMap() {
+    std::lock_guard<std::recursive_mutex> lock(m_outputMutex);
+    m_memoryMap.clear();
+    memset(m_sentControllers, -1, sizeof(m_sentControllers));
+}
 
-    sendBytes(buf, bufLen);
+/* Build DT1 messages on the stack. Writes longer than DT1_MAX_DATA are split
+   in messages for consecutive addresses. */
+void FP4::sendDT1(uint32_t address, const uint8_t *data, unsigned int length) {
+    if (m_transactionDepth > 0) {
+        m_transactionReport.messages += (length + DT1_MAX_DATA - 1) / DT1_MAX_DATA;
+        m_transactionReport.bytes += length + DT1_MESSAGE_OVERHEAD * ((length + DT1_MAX_DATA - 1) / DT1_MAX_DATA);
+    }
 
-//    dumpSysEx(buf, bufLen);
+    if (length == 1) {
+        unsigned char buf[DT1_BYTE_MESSAGE_SIZE];
+        fillDT1ByteMessage(buf, dt1AddressByte(address, 0), dt1AddressByte(address, 1),
+                           dt1AddressByte(address, 2), data[0]);
+        sendBytes(buf, DT1_BYTE_MESSAGE_SIZE);
+        return;
+    }
 
-    delete[] buf;
+    unsigned int offset = 0;
+    do {
+        DT1Message message(address + offset);
+        offset += message.append(data + offset, length - offset);
+        sendBytes(message.finish(), message.messageLength());
+    } while (offset < length);
 }
 
 void FP4::sendGM1On() {
@@ -814,7 +1652,7 @@ void FP4::sendGM1On() {
 
     trace(TraceSystem, ">> GM1 On");
     unsigned char ss[] = { 0xf0, 0x7e, 0x7f, 0x09, 0x01, 0xf7 };
-    sendBytes(ss, 6);
+    sendReset(ss, 6);
 }
 
 void FP4::sendGM2On() {
@@ -823,7 +1661,7 @@ void FP4::sendGM2On() {
 
     trace(TraceSystem, ">> GM2 On");
     unsigned char ss[] = { 0xf0, 0x7e, 0x7f, 0x09, 0x03, 0xf7 };
-    sendBytes(ss, 6);
+    sendReset(ss, 6);
 }
 
 void FP4::sendGMOff() {
@@ -832,7 +1670,7 @@ void FP4::sendGMOff() {
 
     trace(TraceSystem, ">> GM Off");
     unsigned char ss[] = { 0xf0, 0x7e, 0x7f, 0x09, 0x02, 0xf7 };
-    sendBytes(ss, 6);
+    sendReset(ss, 6);
 }
 
 void FP4::sendGSReset() {
@@ -850,7 +1688,7 @@ void FP4::sendGSReset() {
         0x00,			// data
         0x41,			// checksum
         0xf7 };
-    sendBytes(ss, 11);
+    sendReset(ss, 11);
 }
 
 void FP4::sendMasterVolume(int volume) {
@@ -897,8 +1735,7 @@ void FP4::sendSystemPanning(int panning) {
         return;
 
     trace(TraceSystem, ">> MASTER PANNING panning: %i", panning);
-    unsigned char data = (unsigned char)(panning + 63 + 1);
-    sendData(0x40, 0x00, 0x06, &data, 1);
+    sendDataByte(0x40, 0x00, 0x06, panning + 63 + 1);
 }
 
 void FP4::sendSystemKeyShift(int tuning) {
@@ -906,8 +1743,7 @@ void FP4::sendSystemKeyShift(int tuning) {
         return;
 
     trace(TraceSystem, ">> MASTER PANNING key shift: %i", tuning);
-    unsigned char data = (unsigned char)(tuning + 24);
-    sendData(0x40, 0x00, 0x05, &data, 1);
+    sendDataByte(0x40, 0x00, 0x05, tuning + 24);
 }
 
 void FP4::sendMasterCoarseTuning(int semiTones) {
@@ -934,8 +1770,7 @@ void FP4::sendSystemReverbMacro(ReverbType type) {
         return;
 
     trace(TraceEffects, ">> SYSTEM REVERB MACRO type: %i", type);
-    unsigned char t = (unsigned  char)type;
-    sendData(0x40, 0x01, 0x30, &t, 1);
+    sendDataByte(0x40, 0x01, 0x30, type);
 }
 
 void FP4::sendSystemReverb(ReverbType type, int preLPF, int level, int time, int delay) {
@@ -959,8 +1794,7 @@ void FP4::sendSystemReverbCharacter(int value) {
         return;
 
     trace(TraceEffects, ">> REVERB CHARACTER value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x31, &data, 1);
+    sendDataByte(0x40, 0x01, 0x31, value);
 }
 
 void FP4::sendSystemReverbPreLPF(int value) {
@@ -968,8 +1802,7 @@ void FP4::sendSystemReverbPreLPF(int value) {
         return;
 
     trace(TraceEffects, ">> REVERB PRE-LPF value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x32, &data, 1);
+    sendDataByte(0x40, 0x01, 0x32, value);
 }
 
 void FP4::sendSystemReverbLevel(int value) {
@@ -977,8 +1810,7 @@ void FP4::sendSystemReverbLevel(int value) {
         return;
 
     trace(TraceEffects, ">> REVERB LEVEL value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x33, &data, 1);
+    sendDataByte(0x40, 0x01, 0x33, value);
 }
 
 void FP4::sendSystemReverbTime(int value) {
@@ -986,8 +1818,7 @@ void FP4::sendSystemReverbTime(int value) {
         return;
 
     trace(TraceEffects, ">> REVERB TIME value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x34, &data, 1);
+    sendDataByte(0x40, 0x01, 0x34, value);
 }
 
 void FP4::sendSystemReverbFeedback(int value) {
@@ -995,8 +1826,7 @@ void FP4::sendSystemReverbFeedback(int value) {
         return;
 
     trace(TraceEffects, ">> REVERB FEEDBACK value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x35, &data, 1);
+    sendDataByte(0x40, 0x01, 0x35, value);
 }
 
 void FP4::sendSystemChorusMacro(ChorusType type) {
@@ -1004,8 +1834,7 @@ void FP4::sendSystemChorusMacro(ChorusType type) {
         return;
 
     trace(TraceEffects, ">> CHORUS MACRO type: %i", type);
-    unsigned char t = (unsigned char)type;
-    sendData(0x40, 0x01, 0x38, &t, 1);
+    sendDataByte(0x40, 0x01, 0x38, type);
 }
 
 void FP4::sendSystemChorus(int preLPF, int level, int feedback, int delay, int rate, int depth, int sendToReverb) {
@@ -1030,8 +1859,7 @@ void FP4::sendSystemChorusPreLPF(int value) {
         return;
 
     trace(TraceEffects, ">> CHORUS PRE-LPF value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x39, &data, 1);
+    sendDataByte(0x40, 0x01, 0x39, value);
 }
 
 void FP4::sendSystemChorusLevel(int value) {
@@ -1039,8 +1867,7 @@ void FP4::sendSystemChorusLevel(int value) {
         return;
 
     trace(TraceEffects, ">> CHORUS LEVEL value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x3a, &data, 1);
+    sendDataByte(0x40, 0x01, 0x3a, value);
 }
 
 void FP4::sendSystemChorusFeedBack(int value) {
@@ -1048,8 +1875,7 @@ void FP4::sendSystemChorusFeedBack(int value) {
         return;
 
     trace(TraceEffects, ">> CHORUS FEEDBACK value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x3b, &data, 1);
+    sendDataByte(0x40, 0x01, 0x3b, value);
 }
 
 void FP4::sendSystemChorusDelay(int value) {
@@ -1057,8 +1883,7 @@ void FP4::sendSystemChorusDelay(int value) {
         return;
 
     trace(TraceEffects, ">> CHORUS DELAY value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x3c, &data, 1);
+    sendDataByte(0x40, 0x01, 0x3c, value);
 }
 
 void FP4::sendSystemChorusRate(int value) {
@@ -1066,8 +1891,7 @@ void FP4::sendSystemChorusRate(int value) {
         return;
 
     trace(TraceEffects, ">> CHORUS RATE value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x3d, &data, 1);
+    sendDataByte(0x40, 0x01, 0x3d, value);
 }
 
 void FP4::sendSystemChorusDepth(int value) {
@@ -1075,8 +1899,7 @@ void FP4::sendSystemChorusDepth(int value) {
         return;
 
     trace(TraceEffects, ">> CHORUS DEPTH value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x3e, &data, 1);
+    sendDataByte(0x40, 0x01, 0x3e, value);
 }
 
 void FP4::sendSystemChorusToReverbLevel(int value) {
@@ -1084,8 +1907,7 @@ void FP4::sendSystemChorusToReverbLevel(int value) {
         return;
 
     trace(TraceEffects, ">> CHORUS TO REVERB LEVEL value: %i", value);
-    unsigned char data = value;
-    sendData(0x40, 0x01, 0x3f, &data, 1);
+    sendDataByte(0x40, 0x01, 0x3f, value);
 }
 
 void FP4::sendEffectEnabled(int channel, bool enabled, int msb, int lsb, int control1, int control2) {
@@ -1118,8 +1940,7 @@ void FP4::sendEffectParameter(int index, int value) {
         return;
 
     trace(TraceEffects, ">> EFFECT SINGLE PARAMETER index: %i value: %i", index, value);
-    uint8_t data = (uint8_t)value;
-    sendData(0x40, 0x03, 0x03 + index, &data, 1);
+    sendDataByte(0x40, 0x03, 0x03 + index, value);
 }
 
 void FP4::sendEffectParameters(int msb, int lsb, int *values, int parameterCount) {
@@ -1148,8 +1969,7 @@ void FP4::sendEffectToReverbLevel(int level) {
         return;
 
     trace(TraceEffects, ">> EFFECT TO REVERB level: %i", level);
-    uint8_t data = (uint8_t)level;
-    sendData(0x40, 0x03, 0x17, &data, 1);
+    sendDataByte(0x40, 0x03, 0x17, level);
 }
 
 void FP4::sendEffectToChorusLevel(int level) {
@@ -1157,8 +1977,7 @@ void FP4::sendEffectToChorusLevel(int level) {
         return;
 
     trace(TraceEffects, ">> EFFECT TO CHORUS level: %i", level);
-    uint8_t data = (uint8_t)level;
-    sendData(0x40, 0x03, 0x18, &data, 1);
+    sendDataByte(0x40, 0x03, 0x18, level);
 }
 
 void FP4::sendEffectWetLevel(int level) {
@@ -1166,28 +1985,40 @@ void FP4::sendEffectWetLevel(int level) {
         return;
 
     trace(TraceEffects, ">> EFFECT WET level: %i", level);
-    uint8_t data = (uint8_t)level;
-    sendData(0x40, 0x03, 0x1a, &data, 1);
+    sendDataByte(0x40, 0x03, 0x1a, level);
 }
 
-/* Pressed notes are stored in FP4::m_notes because the FP4 seems to send duplicate noteon events
-(or maybe it's alsa?) resulting in stuck notes. It is also used in the case multiple keyboards send
-notes on the same channel. If a note is marked as played, don't resend it until a noteoff is sent */
+/* Pressed notes are counted in FP4::m_notes. A note played again while it sounds is retriggered,
+and only the note off matching the last note on is sent, so notes played on the same channel by
+several keyboards, generators or channel mappings don't cut each other off. Duplicate note on
+events of a single input are filtered before they get here, see FP4Qt::onNoteOn. */
 
 void FP4::registerKeyPress(int channel, int note) {
-    m_notes[channel*(128/8) + (note>>3)] |= (uint8_t)(1<<(note&0b111));
+    m_notes.press(KeysDirect, channel, note);
 }
 
-void FP4::registerKeyRelease(int channel, int note) {
-    m_notes[channel*(128/8) + (note>>3)] &= ~(uint8_t)(1<<(note&0b111));
+/* return the number of holds left on the note, or -1 if it wasn't held
+   directly */
+int FP4::registerKeyRelease(int channel, int note) {
+    return m_notes.release(KeysDirect, channel, note);
 }
 
 void FP4::clearKeyStateBuffer() {
-    memset(m_notes, 0, sizeof(m_notes));
+    m_notes.clear();
+}
+
+/* the device released every note of channel by itself, drop the holds so the
+   next note on isn't taken for a retrigger and its note off is sent. */
+void FP4::forgetChannelNotes(int channel) {
+    if (channel < 0 || channel >= 16) {
+        return;
+    }
+
+    m_notes.releaseChannel(channel, [](int) {});
 }
 
 bool FP4::isKeyPressed(int channel, int note) {
-    return (m_notes[channel*(128/8) + (note>>3)] & (1<<(note&0b111))) == (1<<(note&0b111));
+    return m_notes.isSounding(channel, note);
 }
 
 /* Virtual methods to react to incoming MIDI events. */
@@ -1275,6 +2106,9 @@ void FP4::onConnect() {
 void FP4::onReconnect() {
 }
 
+void FP4::onOutputQueued() {
+}
+
 void FP4::onDisconnect() {
 }
 
@@ -63,6 +63,52 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
  * To display a list of ports FP4 can connect to, you can use
  * dumpPortList().
  *
+ * Output can be batched: between beginOutputBatch() and endOutputBatch()
+ * (or during the lifetime of an FP4OutputBatch object) events are collected
+ * in the sequencer output buffer and written with a single flush when the
+ * outermost batch ends. Events are never held longer than the maximum batch
+ * delay: processOutputQueue() flushes them when outputQueueTimeout()
+ * expires, which also retries a flush the device couldn't take at once.
+ * processEvents() batches everything sent while handling one batch of input
+ * events.
+ *
+ * DT1 writes can be grouped in a transaction with beginDataTransaction()
+ * and commitDataTransaction() (or an FP4DataTransaction object). Writes are
+ * then sorted by address and adjacent writes are merged in as few messages
+ * as possible when the outermost transaction is committed. Writes that make
+ * the device reset other parameters (effect type, reverb/chorus macro) are
+ * sent immediately and in order.
+ *
+ * Sysex output can be paced with setSysexBudget(bytesPerMs), so parameter
+ * changes don't delay notes on a slow MIDI link. Sysex messages over budget
+ * are queued. Other events are sent right away, but queued sysex is sent
+ * before them, so they don't overtake a reset and get wiped by it. Call
+ * processOutputQueue() regularly to send them: outputQueueTimeout() returns
+ * the number of ms until the next one is due, or -1. onOutputQueued() is
+ * called when a message is queued or output is buffered.
+ *
+ * Events can be scheduled on an ALSA queue owned by FP4 with sendAtTick(),
+ * sendAtTime() and the send*At() methods. ALSA delivers them when they are
+ * due, so the application doesn't have to wake up for each of them. Tagged
+ * events that are not delivered yet can be removed with cancelScheduled().
+ * Scheduled notes are addressed to FP4's own input port and sent to the
+ * device when they come back, so they are counted with the other holds of
+ * the note: a scheduled note off doesn't cut a note the player still holds.
+ *
+ * Input events are timestamped by ALSA on the output queue. The time between
+ * that timestamp and the moment output caused by the event is submitted is
+ * recorded in latencyStats(). The timestamp follows the event through the
+ * current thread's latency context, see FP4LatencyScope.
+ *
+ * Incoming MIDI clock, start, continue, stop and song position messages are
+ * followed by tempoTracker(). They don't call any callback.
+ *
+ * Events are exchanged with the device through a MidiBackend. By default
+ * this is the ALSA sequencer. Another backend can be passed to the
+ * constructor, for instance a LoopbackBackend to run without a sequencer:
+ * FP4 then takes ownership of it, and connection, port and queue methods do
+ * nothing.
+ *
  * Finally a debugging class that displays incoming events is provided
  * as FP4Debug.
  *
@@ -74,12 +120,23 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 #include <alsa/asoundlib.h>
 #include <string.h>
 #include <vector>
+#include <mutex>
+#include <atomic>
 #include <inttypes.h>
+#include "fp4memorymap.h"
+#include "dt1transaction.h"
+#include "sysexpacer.h"
+#include "latencystats.h"
+#include "tempotracker.h"
+#include "notetracker.h"
+#include "midibackend.h"
 
 #define ALSA_CLIENT_NAME "Stilgar Midi In"
 
 #define FP4_CLIENT_NAME "Roland FP Series"
 
+#define OUTPUT_QUEUE_NAME "Stilgar Midi Out"
+
 // GM2 reverb control
 enum GM2ReverbType {
     GM2ReverbSmallRoom,
@@ -152,6 +209,14 @@ private:
     char* m_name;
 };
 
+// what a DT1 transaction sent, compared to sending every write on its own
+struct DT1TransactionReport {
+    unsigned writes;        // sendData() calls
+    unsigned naiveBytes;    // bytes these calls would have sent one by one
+    unsigned messages;      // sysex messages actually sent
+    unsigned bytes;         // bytes actually sent
+};
+
 class FP4 {
 public:
     enum PortType {
@@ -175,9 +240,16 @@ public:
         TraceAll = -1
     };
 
-    FP4(const char* client_name = ALSA_CLIENT_NAME);
+    FP4(const char* client_name = ALSA_CLIENT_NAME, MidiBackend* backend = 0);
     ~FP4();
 
+    // default maximum time events are held in the output buffer, in us
+    static const int DEFAULT_MAX_BATCH_DELAY = 2000;
+
+    // default output queue tempo
+    static const int DEFAULT_QUEUE_BPM = 120;
+    static const int DEFAULT_QUEUE_PPQ = 96;
+
     // primary connection. handles autoconnect.
     bool open(const char* client_name, int port=0);
     bool open(int m_client_id, int port=0);
@@ -193,6 +265,24 @@ public:
     void enableOutput() { m_outputEnabled=true; }
     void disableOutput() { m_outputEnabled=false; }
 
+    // output batching. batches are tracked per thread and can be nested, the
+    // buffered events are shared.
+    void beginOutputBatch();
+    void endOutputBatch();
+    void flushOutput();
+    void setMaxBatchDelay(int usec) { m_maxBatchDelay = usec; }
+    int maxBatchDelay() const { return m_maxBatchDelay; }
+
+    // sysex pacing
+    void setSysexBudget(double bytesPerMs);
+    double sysexBudget() const;
+    void processOutputQueue();
+    int outputQueueTimeout();
+    int outputPollDescriptors(struct pollfd* pfds, int space);
+    void clearOutputQueue();
+    SysexPacerStats outputStats();
+    void resetOutputStats();
+
     int resolveClientName(const char* client_name, PortType type);
 
     vector< AlsaClientInfo > getPortList(PortType type=Readable);
@@ -220,7 +310,9 @@ public:
     void sendPortamentoControl(int channel, int note);
     void sendAllSoundsOff(int channel);
     void sendAllNotesOff(int channel);
+    void sendNotesOff(int channel);
     void sendBytes(unsigned char data[], unsigned int length);
+    void sendDataByte(unsigned char addrMSB, unsigned char addr, unsigned char addLSB, unsigned char value);
     void sendRPN(int channel, int msb, int lsb, int value);
     void sendNRPN(int channel, int msb, int lsb, int value);
     void sendRPNHires(int channel, int msb, int lsb, int value);
@@ -228,6 +320,37 @@ public:
 
     void sendIdentityRequest();
 
+    // scheduled output on the output queue. the *At methods take a delay in us,
+    // or a queue time (see queueNow()) if relative is false.
+    void sendAtTick(snd_seq_event_t* ev, snd_seq_tick_time_t tick, bool relative=false, int tag=0);
+    void sendAtTime(snd_seq_event_t* ev, uint64_t usec, bool relative=false, int tag=0);
+    void sendNoteOnAt(uint64_t usec, int channel, int note, int velocity, int tag=0, bool relative=true);
+    void sendNoteOffAt(uint64_t usec, int channel, int note, int tag=0, bool relative=true);
+    void sendControllerAt(uint64_t usec, int channel, int cc, int value, int tag=0);
+    void cancelScheduled(int tag);
+    void releaseScheduledNotes(int channel);
+    int allocateScheduleTag();
+
+    int queueId() const { return m_queue; }
+    bool hasQueue() const { return m_queue >= 0; }
+    void setQueueTempo(int bpm, int ppq=DEFAULT_QUEUE_PPQ);
+    snd_seq_tick_time_t queueTick();
+    uint64_t queueTime();
+    uint64_t queueNow() const;
+
+    // input to output latency
+    LatencyStats& latencyStats() { return m_latencyStats; }
+    bool hasInputTimestamps() const { return m_inputTimestamps; }
+
+    // tempo and position of incoming MIDI clock
+    const TempoTracker& tempoTracker() const { return m_tempoTracker; }
+
+    // input event handled by the current thread
+    uint64_t eventTime() const;
+    static LatencyContext latencyContext();
+    static void setLatencyContext(const LatencyContext& context);
+    static void raiseLatencyStage(int stage);
+
     // channel mode messages
     //void sendAllSoundsOff(int channel);
     //void sendResetAllControllers(int channel);
@@ -241,6 +364,16 @@ public:
     // -- FP4 specifics --
     void sendData(unsigned char addrMSB, unsigned char addr, unsigned char addLSB, unsigned char data[], unsigned int length);
 
+    // mirror of the FP4 memory. unchanged DT1 writes are skipped when enabled.
+    void setMemoryMapEnabled(bool enabled) { m_memoryMapEnabled = enabled; }
+    bool memoryMapEnabled() const { return m_memoryMapEnabled; }
+    void invalidateMemoryMap();
+    void flushMemoryMap();
+
+    // group DT1 writes. transactions can be nested.
+    void beginDataTransaction();
+    DT1TransactionReport commitDataTransaction();
+
     void sendGM1On();
     void sendGM2On();
     void sendGMOff();
@@ -290,8 +423,9 @@ public:
 
     // keep track of currently played notes
     void registerKeyPress(int channel, int note);
-    void registerKeyRelease(int channel, int note);
+    int registerKeyRelease(int channel, int note);
     void clearKeyStateBuffer();
+    void forgetChannelNotes(int channel);
     bool isKeyPressed(int channel, int note);
 
     // set trace level
@@ -307,6 +441,7 @@ public:
     virtual void onConnect();
     virtual void onReconnect();
     virtual void onDisconnect();
+    virtual void onOutputQueued();
 
     // any client connections
     virtual void onClientConnect(int m_client_id, int port);
@@ -314,6 +449,7 @@ public:
 
     // accessors
     snd_seq_t* getSequencer() const { return m_seq; }
+    MidiBackend* backend() const { return m_backend; }
 
 protected:
     bool openInput(int m_client_id, int port);
@@ -326,6 +462,21 @@ protected:
 
     void trace(TraceCategory category, const char* format, ...);
 
+    void outputEvent(snd_seq_event_t* ev);
+    void writeEvent(snd_seq_event_t* ev);
+    int sendQueuedSysex(bool force);
+    void recordLatency(const snd_seq_event_t* ev);
+
+    void writeData(uint32_t address, const uint8_t* data, unsigned int length);
+    void applyData(uint32_t address, const uint8_t* data, unsigned int length);
+    void sendStagedData();
+    void sendReset(unsigned char data[], unsigned int length);
+    void sendDT1(uint32_t address, const uint8_t* data, unsigned int length);
+
+    void rememberController(int channel, int cc, int value);
+    void sendControllerPair(int channel, int msbCC, int lsbCC, int value);
+    void selectParameter(int channel, int msbCC, int lsbCC, int msb, int lsb);
+
 private:
     void openClient(void);
     void closeClient(void);
@@ -333,6 +484,7 @@ private:
 
 protected:
     snd_seq_t* m_seq;
+    MidiBackend* m_backend;
 
 private:
     int	m_hin;
@@ -354,11 +506,99 @@ private:
 
     bool m_outputEnabled;
     bool m_wasConnected;
+    int m_maxBatchDelay;
+
+    // events in the output buffer of the backend since m_firstPending,
+    // guarded by m_outputMutex
+    bool m_outputPending;
+    uint64_t m_firstPending;
+
+    bool m_memoryMapEnabled;
+    FP4MemoryMap m_memoryMap;
+
+    // last value sent for each controller, -1 if unknown. High resolution
+    // controllers and RPN/NRPN leave out the messages that wouldn't change
+    // anything.
+    int8_t m_sentControllers[16][128];
+
+    int m_transactionDepth;
+    DT1Transaction m_transaction;
+    DT1TransactionReport m_transactionReport;
+
+    SysexPacer m_sysexPacer;
+
+    int m_queue;
+    std::atomic<int> m_nextScheduleTag;
+
+    // monotonic time at which the output queue started
+    uint64_t m_queueStartMonotonic;
+
+    // incremented by cancelScheduled(), scheduled notes carry the generation
+    // of their tag so the ones that were delivered before they were cancelled
+    // can be dropped.
+    uint32_t m_scheduleGenerations[256];
+    bool m_inputTimestamps;
+    LatencyStats m_latencyStats;
+    TempoTracker m_tempoTracker;
+
+    // serializes sequencer output and m_notes between the MIDI and GUI threads
+    std::recursive_mutex m_outputMutex;
 
 private:
-    uint8_t m_notes[16 * 128/8];
+    void sendScheduledNote(snd_seq_event_t* ev, uint64_t usec, bool relative, int tag);
+    void playScheduledNote(const snd_seq_event_t* ev);
+
+    // notes played directly and notes that come back from the output queue
+    enum KeyHolder {
+        KeysDirect,
+        KeysScheduled,
+        KeyHolderCount
+    };
+
+    NoteTracker<KeyHolderCount> m_notes;
 
     int m_traceMode;
 };
 
+// Batch all output sent during the lifetime of this object
+class FP4OutputBatch {
+public:
+    explicit FP4OutputBatch(FP4* fp4) : m_fp4(fp4) { m_fp4->beginOutputBatch(); }
+    ~FP4OutputBatch() { m_fp4->endOutputBatch(); }
+
+private:
+    FP4OutputBatch(const FP4OutputBatch&);
+    FP4OutputBatch& operator=(const FP4OutputBatch&);
+
+    FP4* m_fp4;
+};
+
+// Group all DT1 writes sent during the lifetime of this object
+class FP4DataTransaction {
+public:
+    explicit FP4DataTransaction(FP4* fp4) : m_fp4(fp4) { m_fp4->beginDataTransaction(); }
+    ~FP4DataTransaction() { m_fp4->commitDataTransaction(); }
+
+private:
+    FP4DataTransaction(const FP4DataTransaction&);
+    FP4DataTransaction& operator=(const FP4DataTransaction&);
+
+    FP4* m_fp4;
+};
+
+// Set the latency context of the current thread during the lifetime of this
+// object, or only raise its stage. The previous context is restored after.
+class FP4LatencyScope {
+public:
+    explicit FP4LatencyScope(const LatencyContext& context) : m_saved(FP4::latencyContext()) { FP4::setLatencyContext(context); }
+    explicit FP4LatencyScope(int stage) : m_saved(FP4::latencyContext()) { FP4::raiseLatencyStage(stage); }
+    ~FP4LatencyScope() { FP4::setLatencyContext(m_saved); }
+
+private:
+    FP4LatencyScope(const FP4LatencyScope&);
+    FP4LatencyScope& operator=(const FP4LatencyScope&);
+
+    LatencyContext m_saved;
+};
+
 #endif
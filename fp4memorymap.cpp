@@ -0,0 +1,221 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "fp4memorymap.h"
+#include "dt1message.h"
+#include <string.h>
+
+// addresses whose write makes the device reset other addresses
+struct MemoryMapSideEffect {
+    uint32_t first;
+    uint32_t last;
+    uint32_t resetFirst;
+    uint32_t resetLast;
+    bool reapply;       // writing the reset range makes the trigger unknown
+};
+
+static const MemoryMapSideEffect s_sideEffects[] = {
+    // reverb macro
+    { dt1Address(0x40, 0x01, 0x30), dt1Address(0x40, 0x01, 0x30),
+      dt1Address(0x40, 0x01, 0x31), dt1Address(0x40, 0x01, 0x37), true },
+    // chorus macro
+    { dt1Address(0x40, 0x01, 0x38), dt1Address(0x40, 0x01, 0x38),
+      dt1Address(0x40, 0x01, 0x39), dt1Address(0x40, 0x01, 0x3f), true },
+    // effect type
+    { dt1Address(0x40, 0x03, 0x00), dt1Address(0x40, 0x03, 0x01),
+      dt1Address(0x40, 0x03, 0x02), dt1Address(0x40, 0x03, 0x1f), true },
+};
+
+#define SIDE_EFFECT_COUNT (sizeof(s_sideEffects) / sizeof(s_sideEffects[0]))
+
+// the channel effect type (40 41+ch 23-24) also selects the system effect
+#define CHANNEL_EFFECT_FIRST_FSB 0x41
+#define CHANNEL_EFFECT_LAST_FSB (0x41 + 15)
+#define CHANNEL_EFFECT_FIRST_LSB 0x23
+#define CHANNEL_EFFECT_LAST_LSB 0x24
+
+FP4MemoryMap::FP4MemoryMap() {
+    clear();
+}
+
+void FP4MemoryMap::clear() {
+    memset(m_values, UNKNOWN, sizeof(m_values));
+    memset(m_dirty, 0, sizeof(m_dirty));
+    m_dirtyCount = 0;
+}
+
+bool FP4MemoryMap::contains(uint32_t address, unsigned length) const {
+    return address >= base() && length <= MEMORY_MAP_SIZE && address - base() <= MEMORY_MAP_SIZE - length;
+}
+
+int FP4MemoryMap::value(uint32_t address) const {
+    if (!contains(address, 1)) {
+        return -1;
+    }
+
+    uint8_t v = m_values[address - base()];
+    return v == UNKNOWN ? -1 : v;
+}
+
+void FP4MemoryMap::setDirty(unsigned index) {
+    if (!isDirtyIndex(index)) {
+        m_dirty[index >> 6] |= (1ULL << (index & 63));
+        ++m_dirtyCount;
+    }
+}
+
+void FP4MemoryMap::clearDirty(unsigned index) {
+    if (isDirtyIndex(index)) {
+        m_dirty[index >> 6] &= ~(1ULL << (index & 63));
+        --m_dirtyCount;
+    }
+}
+
+unsigned FP4MemoryMap::write(uint32_t address, const uint8_t *data, unsigned length) {
+    if (!contains(address, length) || length == 0) {
+        return 0;
+    }
+
+    uint32_t writeLast = address + length - 1;
+    unsigned changed = 0;
+
+    for (unsigned i=0; i<length; ++i) {
+        unsigned index = address + i - base();
+        uint8_t value = data[i] & 0x7f;
+
+        if (m_values[index] == value) {
+            continue;
+        }
+
+        m_values[index] = value;
+        setDirty(index);
+        ++changed;
+
+        applySideEffects(address + i, address, writeLast);
+    }
+
+    return changed;
+}
+
+/* Values that are about to be sent (dirty) are kept, they will be known
+   again once they are flushed. */
+void FP4MemoryMap::invalidate(uint32_t address, unsigned length) {
+    for (unsigned i=0; i<length; ++i) {
+        if (!contains(address + i, 1)) {
+            continue;
+        }
+
+        unsigned index = address + i - base();
+        if (!isDirtyIndex(index)) {
+            m_values[index] = UNKNOWN;
+        }
+    }
+}
+
+void FP4MemoryMap::applySideEffects(uint32_t address, uint32_t writeFirst, uint32_t writeLast) {
+    for (unsigned i=0; i<SIDE_EFFECT_COUNT; ++i) {
+        const MemoryMapSideEffect& effect = s_sideEffects[i];
+
+        if (address >= effect.first && address <= effect.last) {
+            invalidate(effect.resetFirst, effect.resetLast - effect.resetFirst + 1);
+        }
+
+        // the trigger is part of this write, so it is already being sent
+        if (effect.reapply && address >= effect.resetFirst && address <= effect.resetLast
+                && (effect.first > writeLast || effect.last < writeFirst)) {
+            invalidate(effect.first, effect.last - effect.first + 1);
+        }
+    }
+
+    if (isChannelEffectAddress(address)) {
+        uint32_t first = dt1Address(0x40, 0x03, 0x00);
+        uint32_t last = dt1Address(0x40, 0x03, 0x1f);
+        invalidate(first, last - first + 1);
+    }
+}
+
+bool FP4MemoryMap::isChannelEffectAddress(uint32_t address) {
+    uint8_t fsb = dt1AddressByte(address, 1);
+    uint8_t lsb = dt1AddressByte(address, 2);
+    return dt1AddressByte(address, 0) == 0x40
+            && fsb >= CHANNEL_EFFECT_FIRST_FSB && fsb <= CHANNEL_EFFECT_LAST_FSB
+            && lsb >= CHANNEL_EFFECT_FIRST_LSB && lsb <= CHANNEL_EFFECT_LAST_LSB;
+}
+
+bool FP4MemoryMap::hasSideEffects(uint32_t address, unsigned length) {
+    uint32_t last = address + length - 1;
+
+    for (unsigned i=0; i<SIDE_EFFECT_COUNT; ++i) {
+        if (s_sideEffects[i].first <= last && s_sideEffects[i].last >= address) {
+            return true;
+        }
+    }
+
+    for (uint32_t a=address; a<=last; ++a) {
+        if (isChannelEffectAddress(a)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FP4MemoryMap::takeDirtyRange(Range &range, unsigned maxGap, unsigned maxLength) {
+    if (m_dirtyCount == 0 || maxLength == 0) {
+        return false;
+    }
+
+    // find the first dirty byte a word at a time
+    unsigned word = 0;
+    while (m_dirty[word] == 0) {
+        ++word;
+    }
+    unsigned first = (word << 6) + __builtin_ctzll(m_dirty[word]);
+    unsigned last = first;
+
+    // extend while the next dirty byte is close enough
+    unsigned index = first + 1;
+    while (index < MEMORY_MAP_SIZE && index - first < maxLength) {
+        if (isDirtyIndex(index)) {
+            last = index;
+            ++index;
+            continue;
+        }
+
+        unsigned gapEnd = index;
+        while (gapEnd < MEMORY_MAP_SIZE && gapEnd - index < maxGap && !isDirtyIndex(gapEnd) && isKnown(gapEnd)) {
+            ++gapEnd;
+        }
+
+        if (gapEnd >= MEMORY_MAP_SIZE || !isDirtyIndex(gapEnd) || gapEnd - first >= maxLength) {
+            break;
+        }
+
+        index = gapEnd;
+    }
+
+    for (unsigned i=first; i<=last; ++i) {
+        clearDirty(i);
+    }
+
+    range.address = base() + first;
+    range.length = last - first + 1;
+    return true;
+}
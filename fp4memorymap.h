@@ -0,0 +1,104 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Mirror of the FP4 parameter memory (DT1 addresses 40 00 00 - 41 7f 7f).
+
+   Every DT1 write is compared with the mirrored value. Bytes that change (or
+   whose value is unknown) are marked dirty, and only dirty bytes are sent
+   when the map is flushed. Small clean gaps between dirty bytes are sent
+   along when that is cheaper than starting a new message.
+
+   Some addresses have side effects on the device: selecting a reverb or
+   chorus macro or an effect type resets the parameters that belong to it.
+   Writing them makes the affected bytes unknown, so they are sent again.
+   Writing a parameter that belongs to a macro makes the macro unknown, so
+   selecting the same macro again is not skipped.
+*/
+
+#ifndef FP4MEMORYMAP_H
+#define FP4MEMORYMAP_H
+
+#include <inttypes.h>
+
+// first mirrored address msb
+#define MEMORY_MAP_FIRST_MSB 0x40
+
+// number of mirrored address msbs, each is 128*128 bytes
+#define MEMORY_MAP_MSB_COUNT 2
+
+#define MEMORY_MAP_SIZE (MEMORY_MAP_MSB_COUNT << 14)
+
+class FP4MemoryMap {
+public:
+    // a range of addresses to send
+    struct Range {
+        uint32_t address;
+        unsigned length;
+    };
+
+    FP4MemoryMap();
+
+    // forget everything, for instance after a GS reset
+    void clear();
+
+    // true if the whole range is mirrored
+    bool contains(uint32_t address, unsigned length) const;
+
+    // update the mirror, mark changed bytes dirty. returns the number of dirty bytes.
+    unsigned write(uint32_t address, const uint8_t* data, unsigned length);
+
+    // forget the values of a range, so they are sent on the next write
+    void invalidate(uint32_t address, unsigned length);
+
+    bool isDirty() const { return m_dirtyCount > 0; }
+
+    /* get the lowest dirty range and mark it clean. Clean bytes between
+       dirty bytes are included if the gap is at most maxGap bytes. */
+    bool takeDirtyRange(Range& range, unsigned maxGap, unsigned maxLength);
+
+    // mirrored bytes, for sending a range returned by takeDirtyRange
+    const uint8_t* data(uint32_t address) const { return &m_values[address - base()]; }
+
+    // mirrored value or -1 if unknown
+    int value(uint32_t address) const;
+
+    // true if writing the range makes the device reset other addresses
+    static bool hasSideEffects(uint32_t address, unsigned length);
+
+private:
+    static uint32_t base() { return (uint32_t)MEMORY_MAP_FIRST_MSB << 14; }
+
+    bool isKnown(unsigned index) const { return m_values[index] != UNKNOWN; }
+    bool isDirtyIndex(unsigned index) const { return m_dirty[index >> 6] & (1ULL << (index & 63)); }
+    void setDirty(unsigned index);
+    void clearDirty(unsigned index);
+
+    void applySideEffects(uint32_t address, uint32_t writeFirst, uint32_t writeLast);
+    static bool isChannelEffectAddress(uint32_t address);
+
+    // data bytes are 7 bits, so this is never a valid value
+    static const uint8_t UNKNOWN = 0xff;
+
+    uint8_t m_values[MEMORY_MAP_SIZE];
+    uint64_t m_dirty[MEMORY_MAP_SIZE / 64];
+    unsigned m_dirtyCount;
+};
+
+#endif // FP4MEMORYMAP_H
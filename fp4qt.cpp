@@ -19,44 +19,181 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 ******************************************************************************/
 
 #include "fp4qt.h"
+#include "atomtable.h"
 #include "controllerbinding.h"
 #include "channeltransform.h"
 #include "fp4constants.h"
+#include "midithread.h"
+#include "config.h"
 #include <QtWidgets>
 #include <QDebug>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
-/* Macros to keep track of played notes in mapped channels. This is so to
-   make it possible to have multiple input ranges map to the same output
-   range. This array is shared between the ChannelTransform classes.
-*/
-#define REGISTER_MAPPED_NOTE(channelIn, channelOut, note) \
-    m_mappedNotes[channelIn][channelOut][(note>>3)] |= (1<<(note&0b111))
-
-#define UNREGISTER_MAPPED_NOTE(channelIn, channelOut, note) \
-    m_mappedNotes[channelIn][channelOut][(note>>3)] &= ~(1<<(note&0b111))
-
-#define MAPPED_NOTE_IS_ON(channelIn, channelOut, note) \
-    ((m_mappedNotes[channelIn][channelOut][(note>>3)] & (1<<(note&0b111))) == (1<<(note&0b111)))
+// bound widgets are repainted at most once per interval (ms)
+#define BOUND_WIDGET_REPAINT_INTERVAL 16
 
 
 const ControllerInfo ControllerInfo::Invalid;
 const BindingInfo BindingInfo::Invalid;
 
+bool ControllerInfo::isValid() const {
+    if (channel < 0 || channel >= 16 || cc < 0) {
+        return false;
+    }
+
+    switch (type) {
+    case CCType:
+        return cc < 128;
+    case CC14Type:
+        return cc < 32;
+    case RPNType:
+    case NRPNType:
+        return cc < 16384;
+    default:
+        return false;
+    }
+}
+
+BindingInfo::BindingInfo(const BindableWidgetId &widget, int min, int max, bool reversed) :
+    groupAtom(widget.first),
+    nameAtom(widget.second),
+    minValue(min),
+    maxValue(max),
+    reversed(reversed)
+{
+}
+
+BindingInfo::BindingInfo(const QString &group, const QString &name, int min, int max, bool reversed) :
+    groupAtom(AtomTable::bindingNames().atom(group)),
+    nameAtom(AtomTable::bindingNames().atom(name)),
+    minValue(min),
+    maxValue(max),
+    reversed(reversed)
+{
+}
+
+QString BindingInfo::group() const {
+    return AtomTable::bindingNames().string(groupAtom);
+}
+
+QString BindingInfo::name() const {
+    return AtomTable::bindingNames().string(nameAtom);
+}
+
+/* true if a control change on channel+cc is a part of this controller */
+bool ControllerInfo::includesController(int channel, int cc) const {
+    if (channel != this->channel) {
+        return false;
+    }
+
+    switch (type) {
+    case CCType:
+        return cc == this->cc;
+    case CC14Type:
+        return cc == this->cc || cc == this->cc + 32;
+    case RPNType:
+        return cc == 6 || cc == 38 || cc == 100 || cc == 101;
+    case NRPNType:
+        return cc == 6 || cc == 38 || cc == 98 || cc == 99;
+    default:
+        return false;
+    }
+}
+
+/* short name of the controller as shown to the user */
+QString ControllerInfo::description() const {
+    switch (type) {
+    case CC14Type:
+        return QString("%1/%2 (14-bit)").arg(cc).arg(cc + 32);
+    case RPNType:
+        return QString("RPN %1:%2").arg(cc >> 7).arg(cc & 0x7f);
+    case NRPNType:
+        return QString("NRPN %1:%2").arg(cc >> 7).arg(cc & 0x7f);
+    default:
+        return QString::number(cc);
+    }
+}
+
 ChannelMapping::ChannelMapping() :
     keyLow(0),
     keyHigh(0),
     active(false),
     octaveShift(0),
-    transformMode(0)
+    transformMode(0),
+    chordWindow(DEFAULT_CHORD_WINDOW)
 {
 }
 
-FP4Qt::FP4Qt(const char *clientName, QObject *parent) :
+FP4Qt::FP4Qt(const char *clientName, QObject *parent, MidiBackend *backend) :
     QObject(parent),
-    FP4(clientName),
-    m_channelMappingsEnabled(false)
+    FP4(clientName, backend),
+    m_channelMappingsEnabled(false),
+    m_noteSource(NoteSourceInput),
+    m_midiThread(0),
+    m_guiWakeNotifier(0),
+    m_guiWakePending(false),
+    m_outputQueueTimer(0),
+    m_controlRateNotifier(0),
+    m_lastRampId(0),
+    m_generatedControllerRate(0),
+    m_repaintTimer(0),
+    m_pendingRouting(0),
+    m_routing(0)
 {
-    memset(m_mappedNotes, 0, sizeof(m_mappedNotes));
+    memset(m_heldRoutings, 0, sizeof(m_heldRoutings));
+
+    for (int channel=0; channel<16; ++channel) {
+        for (int cc=0; cc<128; ++cc) {
+            m_boundControllers[channel][cc] = false;
+        }
+        for (int cc=0; cc<32; ++cc) {
+            m_boundHiresControllers[channel][cc] = false;
+        }
+        memset(m_ccTable[channel], 0, sizeof(m_ccTable[channel]));
+        memset(m_cc14Table[channel], 0, sizeof(m_cc14Table[channel]));
+        for (int i=0; i<2*16384/32; ++i) {
+            m_boundParameters[channel][i/(16384/32)][i%(16384/32)] = 0;
+        }
+    }
+
+    // the binding table is compiled from m_ccBindings and m_bindingConfigMap
+    connect(this, SIGNAL(bindingAdded(ControllerInfo,BindingInfo)),
+            SLOT(onBindingChanged(ControllerInfo,BindingInfo)));
+    connect(this, SIGNAL(bindingRemoved(ControllerInfo,BindingInfo)),
+            SLOT(onBindingChanged(ControllerInfo,BindingInfo)));
+    connect(this, SIGNAL(bindingUpdated(ControllerInfo,BindingInfo)),
+            SLOT(onBindingChanged(ControllerInfo,BindingInfo)));
+
+    m_repaintTimer = new QTimer(this);
+    m_repaintTimer->setSingleShot(true);
+    m_repaintTimer->setInterval(BOUND_WIDGET_REPAINT_INTERVAL);
+    connect(m_repaintTimer, SIGNAL(timeout()), SLOT(releaseRepaints()));
+
+    // the MIDI thread signals queued events through this eventfd
+    m_guiWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_guiWakeFd >= 0) {
+        m_guiWakeNotifier = new QSocketNotifier(m_guiWakeFd, QSocketNotifier::Read, this);
+        connect(m_guiWakeNotifier, SIGNAL(activated(int)), SLOT(dispatchGuiEvents()));
+    }
+    else {
+        qDebug() << "FP4: cannot create eventfd, MIDI events will be handled in the GUI thread.";
+    }
+
+    m_outputQueueTimer = new QTimer(this);
+    m_outputQueueTimer->setSingleShot(true);
+    connect(m_outputQueueTimer, SIGNAL(timeout()), SLOT(processMidiInGuiThread()));
+
+    // generator ramps are advanced when this timerfd expires
+    m_controlRateFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_controlRateFd >= 0) {
+        m_controlRateNotifier = new QSocketNotifier(m_controlRateFd, QSocketNotifier::Read, this);
+        connect(m_controlRateNotifier, SIGNAL(activated(int)), SLOT(processControlRate()));
+    }
+    else {
+        qDebug() << "FP4: cannot create timerfd, controller generators won't run.";
+    }
 
     ChannelTransformFactory ctf(this);
     m_channelTransforms = ctf.channelTransforms();
@@ -65,22 +202,378 @@ FP4Qt::FP4Qt(const char *clientName, QObject *parent) :
     loadDefaultMappings();
 }
 
+FP4Qt::~FP4Qt() {
+    stopMidiThread();
+
+    qDeleteAll(m_routings);
+
+    if (m_guiWakeFd >= 0) {
+        ::close(m_guiWakeFd);
+    }
+    if (m_controlRateFd >= 0) {
+        ::close(m_controlRateFd);
+    }
+}
+
+/* start processing incoming MIDI events in a separate thread. If realtime is
+   set, the thread tries to use SCHED_FIFO scheduling. */
+void FP4Qt::startMidiThread(bool realtime) {
+    // the MIDI thread can't wake up the GUI, read input like before it existed
+    if (m_guiWakeFd < 0) {
+        if (m_inputNotifiers.isEmpty()) {
+            watchInputDescriptors();
+        }
+        return;
+    }
+
+    if (!m_midiThread) {
+        m_midiThread = new MidiThread(this, this);
+    }
+
+    if (m_midiThread->isRunning()) {
+        return;
+    }
+
+    // the MIDI thread polls the control rate timer itself
+    if (m_controlRateNotifier) {
+        m_controlRateNotifier->setEnabled(false);
+    }
+
+    m_midiThread->setRealtime(realtime);
+    m_midiThread->start();
+}
+
+/* read input in the GUI thread when the backend descriptors are readable,
+   replacing the notifiers of descriptors polled before */
+void FP4Qt::watchInputDescriptors() {
+    // may run in the slot of one of these notifiers
+    foreach (QSocketNotifier* notifier, m_inputNotifiers) {
+        notifier->setEnabled(false);
+        notifier->deleteLater();
+    }
+    m_inputNotifiers.clear();
+
+    struct pollfd pfds[8];
+    int count = backend()->pollDescriptors(pfds, 8);
+    for (int i=0; i<count; ++i) {
+        QSocketNotifier* notifier = new QSocketNotifier(pfds[i].fd, QSocketNotifier::Read, this);
+        connect(notifier, SIGNAL(activated(int)), SLOT(processMidiInGuiThread()));
+        m_inputNotifiers << notifier;
+    }
+}
+
+/* the backend connected again and may use new descriptors. Make whoever
+   reads input poll them. */
+void FP4Qt::refreshInputDescriptors() {
+    if (m_midiThread && m_midiThread->isRunning()) {
+        m_midiThread->refreshInputDescriptors();
+    }
+    else if (!m_inputNotifiers.isEmpty()) {
+        watchInputDescriptors();
+    }
+}
+
+void FP4Qt::stopMidiThread() {
+    if (m_midiThread) {
+        m_midiThread->stop();
+    }
+
+    if (m_controlRateNotifier) {
+        m_controlRateNotifier->setEnabled(true);
+    }
+
+    // nobody sends queued sysex anymore
+    setSysexBudget(0);
+}
+
+/* Read input, and send paced sysex and buffered output that is due, when
+   there is no MIDI thread. The timer is restarted for the next message that
+   is due. */
+void FP4Qt::processMidiInGuiThread() {
+    processEvents();
+    processOutputQueue();
+
+    int timeout = outputQueueTimeout();
+    if (timeout >= 0) {
+        m_outputQueueTimer->start(timeout);
+    }
+}
+
+/* return true if called from the MIDI thread */
+bool FP4Qt::isMidiThread() const {
+    return m_midiThread && QThread::currentThread() == m_midiThread;
+}
+
+/* Feed events that other threads (mostly generators in the GUI thread)
+   injected in the input pipeline. */
+void FP4Qt::processInjectedEvents() {
+    FP4OutputBatch batch(this);
+
+    // notes of other threads are kept apart from the notes of the MIDI input
+    m_noteSource = NoteSourceGenerator;
+
+    QueuedMidiEvent ev;
+    while (m_injectQueue.pop(ev)) {
+        FP4LatencyScope latency(ev.latency);
+
+        switch (ev.type) {
+        case QueuedMidiEvent::NoteOn:
+            onNoteOn(ev.channel, ev.data1, ev.data2);
+            break;
+        case QueuedMidiEvent::NoteOff:
+            onNoteOff(ev.channel, ev.data1);
+            break;
+        case QueuedMidiEvent::Controller:
+            onController(ev.channel, ev.data1, ev.data2);
+            break;
+        default:
+            break;
+        }
+    }
+
+    m_noteSource = NoteSourceInput;
+}
+
+/* Move a controller from one value to another in duration ms, replacing the
+   ramp with the same id. The values are sent as if they were received by
+   onController(). */
+void FP4Qt::startControllerRamp(int id, int channel, int cc, int from, int to, int duration) {
+    ControlRampRequest request;
+    request.stop = false;
+    request.ramp.id = id;
+    request.ramp.channel = channel;
+    request.ramp.cc = cc;
+    request.ramp.from = from;
+    request.ramp.to = to;
+    request.ramp.start = queueNow();
+    request.ramp.duration = duration > 0 ? (uint64_t)duration * 1000 : 0;
+    request.ramp.lastValue = -1;
+    request.ramp.pendingValue = -1;
+    pushRampRequest(request);
+}
+
+void FP4Qt::setGeneratedControllerRate(int messagesPerSecond) {
+    m_generatedControllerRate = messagesPerSecond > 0 ? messagesPerSecond : 0;
+    m_controlRate.setMinInterval(m_generatedControllerRate ? 1000000 / m_generatedControllerRate : 0);
+}
+
+/* stop a ramp where it is */
+void FP4Qt::stopControllerRamp(int id) {
+    ControlRampRequest request;
+    request.stop = true;
+    request.ramp.id = id;
+    pushRampRequest(request);
+}
+
+void FP4Qt::pushRampRequest(const ControlRampRequest& request) {
+    if (m_controlRateFd < 0) {
+        return;
+    }
+
+    if (!m_rampQueue.push(request)) {
+        qDebug() << "FP4: controller ramp queue full. Request lost.";
+        return;
+    }
+
+    // the timer expires right away to pick up the request
+    armControlRate(true);
+}
+
+/* start the control rate timer, or stop it. This can be called from any
+   thread. */
+void FP4Qt::armControlRate(bool armed) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (armed) {
+        spec.it_value.tv_nsec = 1;
+        spec.it_interval.tv_nsec = CONTROL_RATE_INTERVAL * 1000000L;
+    }
+    timerfd_settime(m_controlRateFd, 0, &spec, 0);
+}
+
+/* Apply queued ramp requests and send the current value of every running
+   ramp. Called by the MIDI thread, or by the GUI thread when there is no
+   MIDI thread. The timer is stopped while no ramp runs, so idle generators
+   don't wake anything up. */
+void FP4Qt::processControlRate() {
+    uint64_t expirations;
+    ssize_t rd = ::read(m_controlRateFd, &expirations, sizeof(expirations));
+    Q_UNUSED(rd);
+
+    ControlRampRequest request;
+    while (m_rampQueue.pop(request)) {
+        if (request.stop) {
+            m_controlRate.stop(request.ramp.id);
+        }
+        else if (!m_controlRate.start(request.ramp)) {
+            qDebug() << "FP4: too many controller ramps. Ramp dropped.";
+        }
+    }
+
+    {
+        FP4OutputBatch batch(this);
+        FP4LatencyScope latency(LatencyGenerator);
+
+        m_controlRate.advance(queueNow(), [&](int channel, int cc, int value) {
+            onController(channel, cc, value);
+        });
+    }
+
+    if (m_controlRate.isIdle()) {
+        armControlRate(false);
+
+        // a request may have been queued after the queue was emptied
+        if (!m_rampQueue.isEmpty()) {
+            armControlRate(true);
+        }
+    }
+}
+
+/* If the MIDI thread is running and this is called from another thread, queue
+   the event so it is handled by the MIDI thread. This keeps routing state
+   accessed by a single thread. Return true if the event was queued. */
+bool FP4Qt::injectInMidiThread(int type, int channel, int data1, int data2) {
+    if (!m_midiThread || !m_midiThread->isRunning() || isMidiThread()) {
+        return false;
+    }
+
+    QueuedMidiEvent ev = { type, channel, data1, data2, latencyContext() };
+    if (!ev.latency.timestamp) {
+        // events are timed when they are injected, not when they are handled
+        ev.latency.timestamp = queueNow();
+    }
+    if (!m_injectQueue.push(ev)) {
+        qDebug() << "FP4: MIDI thread input queue full. Event lost.";
+        return true;
+    }
+
+    m_midiThread->wakeUp();
+    return true;
+}
+
+/* Pass an event to the GUI thread. When called from the GUI thread itself
+   the event is dispatched immediately. */
+void FP4Qt::postToGui(int type, int channel, int data1, int data2) {
+    QueuedMidiEvent ev = { type, channel, data1, data2, latencyContext() };
+
+    if (QThread::currentThread() == thread()) {
+        dispatchGuiEvent(ev);
+        return;
+    }
+
+    if (!m_guiQueue.push(ev)) {
+        // the GUI thread is not keeping up. Drop the event rather than
+        // blocking the MIDI thread.
+        return;
+    }
+
+    // only wake up the GUI once per batch of events
+    if (!m_guiWakePending.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t r = ::write(m_guiWakeFd, &one, sizeof(one));
+        Q_UNUSED(r);
+    }
+}
+
+/* called in the GUI thread when the MIDI thread queued events */
+void FP4Qt::dispatchGuiEvents() {
+    uint64_t count;
+    ssize_t r = ::read(m_guiWakeFd, &count, sizeof(count));
+    Q_UNUSED(r);
+
+    // clear before draining so events pushed meanwhile trigger a new wakeup
+    m_guiWakePending = false;
+
+    // bound widgets send data to the FP4 when they are updated
+    FP4OutputBatch batch(this);
+
+    QueuedMidiEvent ev;
+    while (m_guiQueue.pop(ev)) {
+        dispatchGuiEvent(ev);
+    }
+}
+
+/* turn a queued event into the corresponding signal. Output sent by the
+   receivers (generators, bound widgets) is measured from the input event. */
+void FP4Qt::dispatchGuiEvent(const QueuedMidiEvent &ev) {
+    FP4LatencyScope latency(ev.latency);
+
+    switch (ev.type) {
+    case QueuedMidiEvent::NoteOn:
+        raiseLatencyStage(LatencyGenerator);
+        emit noteOnReceived(ev.channel, ev.data1, ev.data2);
+        break;
+    case QueuedMidiEvent::NoteOff:
+        raiseLatencyStage(LatencyGenerator);
+        emit noteOffReceived(ev.channel, ev.data1);
+        break;
+    case QueuedMidiEvent::BankChange:
+        emit bankChangeReceived(ev.channel, ev.data1, ev.data2);
+        break;
+    case QueuedMidiEvent::ProgramChange:
+        emit programChangeReceived(ev.channel, ev.data1);
+        break;
+    case QueuedMidiEvent::Controller:
+        raiseLatencyStage(LatencyGenerator);
+        emit ccReceived(ev.channel, ev.data1, ev.data2);
+        break;
+    case QueuedMidiEvent::BoundController:
+        raiseLatencyStage(LatencyBinding);
+        handleBoundController(ControllerInfo(ev.channel, ev.data1), ev.data2);
+        break;
+    case QueuedMidiEvent::BoundHiresController:
+        raiseLatencyStage(LatencyBinding);
+        handleBoundController(ControllerInfo(ev.channel, ev.data1, ControllerInfo::CC14Type), ev.data2);
+        break;
+    case QueuedMidiEvent::BoundRPN:
+        raiseLatencyStage(LatencyBinding);
+        handleBoundController(ControllerInfo(ev.channel, ev.data1, ControllerInfo::RPNType), ev.data2);
+        break;
+    case QueuedMidiEvent::BoundNRPN:
+        raiseLatencyStage(LatencyBinding);
+        handleBoundController(ControllerInfo(ev.channel, ev.data1, ControllerInfo::NRPNType), ev.data2);
+        break;
+    case QueuedMidiEvent::HiresController:
+        emit hiresControllerReceived(ev.channel, ev.data1, ev.data2);
+        break;
+    case QueuedMidiEvent::RPN:
+        emit rpnReceived(ev.channel, ev.data1, ev.data2);
+        break;
+    case QueuedMidiEvent::NRPN:
+        emit nrpnReceived(ev.channel, ev.data1, ev.data2);
+        break;
+    case QueuedMidiEvent::Connected:
+        emit connected();
+        break;
+    case QueuedMidiEvent::Reconnected:
+        emit reconnected();
+        break;
+    case QueuedMidiEvent::Disconnected:
+        emit disconnected();
+        break;
+    case QueuedMidiEvent::ClientConnected:
+        emit clientConnected(ev.data1, ev.data2);
+        break;
+    case QueuedMidiEvent::ClientDisconnected:
+        emit clientDisconnected(ev.data1, ev.data2);
+        break;
+    }
+}
+
+/* emit sysexReceived in the GUI thread */
+void FP4Qt::deliverSysEx(const QByteArray &data) {
+    emit sysexReceived((const unsigned char*)data.constData(), data.size());
+}
+
 /* return widget associated to a channel+cc */
 QWidget *FP4Qt::controlledWidget(int channel, int cc) {
     return m_ccBindings.value(ControllerInfo(channel, cc));
 }
 
-/* return channel and cc for a known widget or {-1, -1} */
+/* return the controller for a known widget or ControllerInfo::Invalid. If the
+   widget is bound to several controllers, the last bound one is returned. */
 ControllerInfo FP4Qt::controlledWidgetInfo(QWidget *widget) {
-    QMapIterator< ControllerInfo, QWidget* > it(m_ccBindings);
-    while (it.hasNext()) {
-        it.next();
-        if (it.value() == widget) {
-            return it.key();
-        }
-    }
-
-    return ControllerInfo::Invalid;
+    return m_widgetControllers.value(widget, ControllerInfo::Invalid);
 }
 
 /* load default channel mappings, ie: map whole range from incoming channel
@@ -94,17 +587,118 @@ void FP4Qt::loadDefaultMappings() {
             mapping->keyHigh = FP4_HIGHEST_KEY;
             mapping->active = (inChannel == outChannel);
             mapping->transformMode = 0;
+            mapping->chordWindow = DEFAULT_CHORD_WINDOW;
         }
     }
+    updateChannelMappings();
 }
 
-/* get mapping between inChannel and outChannel */
+/* get mapping between inChannel and outChannel. Changes are used for new
+   notes after updateChannelMappings() is called. */
 ChannelMapping *FP4Qt::channelMapping(int inChannel, int outChannel) {
     Q_ASSERT(inChannel >= 0 && inChannel < 16);
     Q_ASSERT(outChannel >= 0 && outChannel < 16);
     return &m_mappings[inChannel][outChannel];
 }
 
+/* Compile m_mappings into a new routing, with the list of outputs of every
+   note on every input channel, and hand it over to the MIDI thread. Must be
+   called after a mapping is changed. Notes that are held keep the routing
+   they were played with, so their note off follows the same route. */
+void FP4Qt::updateChannelMappings() {
+    ChannelRouting* routing = new ChannelRouting;
+    memcpy(routing->mappings, m_mappings, sizeof(m_mappings));
+
+    for (int inChannel=0; inChannel<16; ++inChannel) {
+        for (int note=0; note<128; ++note) {
+            MappedNoteFanOut& fanOut = routing->fanOut[inChannel][note];
+            fanOut.count = 0;
+
+            for (int outChannel=0; outChannel<16; ++outChannel) {
+                const ChannelMapping* mapping = &m_mappings[inChannel][outChannel];
+                if (!mapping->active)
+                    continue;
+                if (note < mapping->keyLow || note > mapping->keyHigh)
+                    continue;
+
+                Q_ASSERT(mapping->transformMode >= 0 && mapping->transformMode < m_channelTransforms.count());
+
+                int shiftedNote = note + 12 * mapping->octaveShift;
+
+                MappedNoteTarget& target = fanOut.targets[fanOut.count++];
+                target.channelOut = outChannel;
+                target.note = (shiftedNote < 0 || shiftedNote > 127) ? -1 : shiftedNote;
+                target.transformMode = mapping->transformMode;
+            }
+        }
+    }
+
+    // a routing that was replaced before the MIDI thread picked it up was
+    // never used
+    ChannelRouting* unused = m_pendingRouting.exchange(routing, std::memory_order_acq_rel);
+    if (unused) {
+        m_routings.removeOne(unused);
+        delete unused;
+    }
+    m_routings.append(routing);
+
+    deleteReleasedRoutings();
+}
+
+/* delete the routings the MIDI thread doesn't use anymore */
+void FP4Qt::deleteReleasedRoutings() {
+    for (int i=m_routings.count()-1; i>=0; --i) {
+        if (m_routings[i]->released.load(std::memory_order_acquire)) {
+            delete m_routings.takeAt(i);
+        }
+    }
+}
+
+/* return the routing for new notes, after switching to the one published
+   last by updateChannelMappings(). Called by the MIDI thread. */
+ChannelRouting* FP4Qt::currentRouting() {
+    if (m_pendingRouting.load(std::memory_order_relaxed)) {
+        ChannelRouting* routing = m_pendingRouting.exchange(0, std::memory_order_acquire);
+        if (routing) {
+            retireRouting(m_routing);
+            m_routing = routing;
+        }
+    }
+    return m_routing;
+}
+
+/* the routing isn't used for new notes anymore */
+void FP4Qt::retireRouting(ChannelRouting* routing) {
+    if (!routing) {
+        return;
+    }
+
+    routing->retired = true;
+    if (routing->holds == 0) {
+        routing->released.store(true, std::memory_order_release);
+    }
+}
+
+/* remember the routing an input note of the current source was played with */
+void FP4Qt::holdRouting(int channelIn, int note, ChannelRouting* routing) {
+    // a retriggered note is released with the newest routing
+    ChannelRouting* previous = m_heldRoutings[m_noteSource][channelIn][note];
+    if (previous) {
+        unholdRouting(previous);
+    }
+
+    ++routing->holds;
+    m_heldRoutings[m_noteSource][channelIn][note] = routing;
+}
+
+/* a note played with the routing was released. The routing may be deleted
+   by the GUI thread after this. */
+void FP4Qt::unholdRouting(ChannelRouting* routing) {
+    if (--routing->holds == 0 && routing->retired) {
+        routing->released.store(true, std::memory_order_release);
+    }
+}
+
 /* if enabled, m_mappings will be used to route incoming note{on,off} messages */
 void FP4Qt::enableChannelMappings(bool enable) {
     m_channelMappingsEnabled = enable;
@@ -122,7 +716,7 @@ void FP4Qt::updateBinding(const ControllerInfo &controller, const BindingInfo &b
         return;
     }
 
-    m_bindingConfigMap[controller] = binding;
+    setBindingConfig(controller, binding);
     emit bindingUpdated(controller, binding);
 }
 
@@ -130,128 +724,453 @@ void FP4Qt::updateBinding(const ControllerInfo &controller, const BindingInfo &b
 /* when a widget is associated to a midibindingbutton, it is registered so
    bindings can be effectuated when settings are loaded */
 void FP4Qt::registerBindableWidget(QWidget *widget) {
-    Q_ASSERT(!widget->property("cc_group").isNull());
-    Q_ASSERT(!widget->property("cc_name").isNull());
+    BindableWidgetId id = bindableWidgetId(widget);
 
-    QString group = widget->property("cc_group").value<QString>();
-    QString name = widget->property("cc_name").value<QString>();
+    m_bindableWidgets.insert(id, widget);
+    connect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(unregisterBindableWidget(QObject*)), Qt::UniqueConnection);
 
-    m_bindableWidgets[group][name] = widget;
-    connect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(unregisterBindableWidget(QObject*)));
+    // bind the controllers configured for this widget
+    foreach (const ControllerInfo& controller, m_namedBindings.values(id)) {
+        bindWidget(controller, widget);
+        updateBoundController(controller);
+    }
+}
 
-    // FIXME: we should really use a bidirectional map structure for efficiency. Then again,
-    //        there will never be many bindings to search.
-    for (auto it=m_bindingConfigMap.constBegin(); it!=m_bindingConfigMap.constEnd(); ++it) {
-        if (it.value().group == group && it.value().name == name) {
-            m_ccBindings.insert(it.key(), widget);
-            connect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(onWidgetDeleted(QObject*)));
-            break;
-        }
+/* bind a widget to a controller, replacing the widget bound before. Keeps
+   m_widgetControllers in sync with m_ccBindings. */
+void FP4Qt::bindWidget(const ControllerInfo &controller, QWidget *widget) {
+    QWidget* oldWidget = m_ccBindings.value(controller, 0);
+    if (oldWidget == widget) {
+        return;
+    }
+
+    if (oldWidget) {
+        m_widgetControllers.remove(oldWidget, controller);
+        dropHeldRepaint(oldWidget);
+    }
+
+    m_ccBindings.insert(controller, widget);
+    m_widgetControllers.insert(widget, controller);
+    connect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(onWidgetDeleted(QObject*)), Qt::UniqueConnection);
+}
+
+void FP4Qt::unbindWidget(const ControllerInfo &controller) {
+    QWidget* widget = m_ccBindings.take(controller);
+    if (widget) {
+        m_widgetControllers.remove(widget, controller);
+        dropHeldRepaint(widget);
+    }
+}
+
+/* set the binding configuration of a controller. Keeps m_namedBindings in
+   sync with m_bindingConfigMap. */
+void FP4Qt::setBindingConfig(const ControllerInfo &controller, const BindingInfo &binding) {
+    auto it = m_bindingConfigMap.constFind(controller);
+    if (it != m_bindingConfigMap.constEnd()) {
+        m_namedBindings.remove(it.value().widgetId(), controller);
+    }
+
+    m_bindingConfigMap.insert(controller, binding);
+    m_namedBindings.insert(binding.widgetId(), controller);
+}
+
+/* remove the binding configuration of a controller and return it */
+BindingInfo FP4Qt::removeBindingConfig(const ControllerInfo &controller) {
+    auto it = m_bindingConfigMap.find(controller);
+    if (it == m_bindingConfigMap.end()) {
+        return BindingInfo();
     }
+
+    BindingInfo binding = it.value();
+    m_bindingConfigMap.erase(it);
+    m_namedBindings.remove(binding.widgetId(), controller);
+    return binding;
 }
 
 /* when a bindable widget is destroyed, be sure to ignore it later on. */
 void FP4Qt::unregisterBindableWidget(QObject* obj) {
     QWidget* widget = qobject_cast<QWidget*>(obj);
     Q_ASSERT(widget);
+
+    // another widget may have been registered with the same name since
+    BindableWidgetId id = bindableWidgetId(widget);
+    auto it = m_bindableWidgets.find(id);
+    if (it != m_bindableWidgets.end() && it.value() == widget) {
+        m_bindableWidgets.erase(it);
+    }
+}
+
+/* return the interned cc_group and cc_name of a bindable widget */
+BindableWidgetId FP4Qt::bindableWidgetId(QObject *widget) {
     Q_ASSERT(!widget->property("cc_group").isNull());
     Q_ASSERT(!widget->property("cc_name").isNull());
 
-    QString group = widget->property("cc_group").value<QString>();
-    QString name = widget->property("cc_name").value<QString>();
+    AtomTable& names = AtomTable::bindingNames();
+    return BindableWidgetId(names.atom(widget->property("cc_group").toString()),
+                            names.atom(widget->property("cc_name").toString()));
+}
 
-    QMap<QString, QMap<QString, QWidget*> >::iterator it=m_bindableWidgets.find(group);
-    if (it == m_bindableWidgets.end()) {
+/* Relay incoming note on events to FP4, and let other objects react to them.
+   The FP4 seems to send duplicate note on events (or maybe it's alsa?). A note
+   played again by the same source before it is released is handled as a note
+   off followed by a note on, so a single note off releases it. */
+void FP4Qt::onNoteOn(int channel, int note, int velocity) {
+    if (injectInMidiThread(QueuedMidiEvent::NoteOn, channel, note, velocity)) {
         return;
     }
 
-    it->remove(name);
-    if (it->size() == 0) {
-        m_bindableWidgets.remove(group);
+    if (m_inputNotes.isHeld(m_noteSource, channel, note)) {
+        onNoteOff(channel, note);
     }
-}
+    m_inputNotes.press(m_noteSource, channel, note);
 
-/* Relay incoming note on events to FP4, and let other objects react to them. */
-void FP4Qt::onNoteOn(int channel, int note, int velocity) {
     if (m_channelMappingsEnabled) {
         handleMappedNoteOn(channel, note, velocity);
     }
     else {
-        emit noteOnReceived(channel, note, velocity);
         sendNoteOn(channel, note, velocity);
+        postToGui(QueuedMidiEvent::NoteOn, channel, note, velocity);
     }
 }
 
 /* Relay incoming note off events to FP4 and let other objects react to them.
-   Notes are removed from the m_notes table, see onNoteOn comment. */
+   FP4 only releases the note when no other source holds it, see onNoteOn
+   comment. */
 void FP4Qt::onNoteOff(int channel, int note) {
-    if (m_channelMappingsEnabled) {
+    if (injectInMidiThread(QueuedMidiEvent::NoteOff, channel, note)) {
+        return;
+    }
+
+    m_inputNotes.release(m_noteSource, channel, note);
+
+    // notes played while mappings were enabled are released the same way
+    if (m_channelMappingsEnabled || m_heldRoutings[m_noteSource][channel][note]) {
         handleMappedNoteOff(channel, note);
     }
     else {
-        emit noteOffReceived(channel, note);
         sendNoteOff(channel, note);
+        postToGui(QueuedMidiEvent::NoteOff, channel, note);
     }
 }
 
-/* Let other objects react to program changes. */
+/* Let other objects react to program changes. A bank select without LSB
+   is completed by the program change. */
 void FP4Qt::onProgramChange(int channel, int pgm) {
 //    qDebug() << "FP4: Program change on channel " << channel << ": " << hex << pgm << dec;
-    emit programChangeReceived(channel, pgm);
+    ParsedController bank;
+    if (m_controllerParser.programChange(channel, bank)) {
+        postParsedController(bank);
+    }
+
+    postToGui(QueuedMidiEvent::ProgramChange, channel, pgm);
 }
 
 /* handle controller events.
    Let other objects react to bank changes.
    Update widgets associated to controller events.
    Let other objects react to other controller events.
+
+   Unbound controllers are forwarded from the MIDI thread directly. Bound
+   controllers are handed to the GUI thread because they update widgets.
+   Messages made of several controllers (bank select, 14-bit controllers,
+   RPN/NRPN) are assembled by m_controllerParser as their parts arrive. The
+   parts of a bound high resolution controller are not forwarded, the bound
+   widget sends the value instead.
 */
 void FP4Qt::onController(int channel, int cc, int value) {
-    if (cc == 0) {
-        snd_seq_event_t* ev;
+    if (injectInMidiThread(QueuedMidiEvent::Controller, channel, cc, value)) {
+        return;
+    }
+
+    ParsedController parsed;
+    bool complete = m_controllerParser.parse(channel, cc, value, parsed);
+
+    // bank select is only reported as a whole
+    if (cc == 0 || cc == 32) {
+        if (complete) {
+            postParsedController(parsed);
+        }
+        return;
+    }
 
-        int err=snd_seq_event_input(m_seq, &ev);
-        if (err == -EAGAIN || err==-ENOSPC) {
-            qDebug() << "FP4: incomplete bank change";
-            return;
+//    qDebug() << "FP4: Controller on channel " << channel << ": " << controller << "=" << value;
+    if (channel >= 0 && channel < 16 && cc >= 0 && cc < 128 && m_boundControllers[channel][cc]) {
+        postToGui(QueuedMidiEvent::BoundController, channel, cc, value);
+    }
+    else {
+        if (!isPartOfBoundController(channel, cc, complete, parsed)) {
+            sendController(channel, cc, value);
+        }
+        postToGui(QueuedMidiEvent::Controller, channel, cc, value);
+    }
+
+    if (complete) {
+        postParsedController(parsed);
+    }
+}
+
+/* let other objects react to assembled controller messages */
+void FP4Qt::postParsedController(const ParsedController &event) {
+    switch (event.type) {
+    case ParsedController::BankSelect:
+        qDebug() << "FP4: bank change on channel " << event.channel << ": " << event.value << " (" <<
+                hex << (event.value >> 7) << ", " << (event.value & 0x7f) << ")" << dec;
+        postToGui(QueuedMidiEvent::BankChange, event.channel, event.value >> 7, event.value & 0x7f);
+        break;
+    case ParsedController::Controller14:
+        if (isControllerBound(ControllerInfo(event.channel, event.number, ControllerInfo::CC14Type))) {
+            postToGui(QueuedMidiEvent::BoundHiresController, event.channel, event.number, event.value);
+        }
+        else {
+            postToGui(QueuedMidiEvent::HiresController, event.channel, event.number, event.value);
         }
+        break;
+    case ParsedController::RPN:
+        if (isControllerBound(ControllerInfo(event.channel, event.number, ControllerInfo::RPNType))) {
+            postToGui(QueuedMidiEvent::BoundRPN, event.channel, event.number, event.value);
+        }
+        else {
+            postToGui(QueuedMidiEvent::RPN, event.channel, event.number, event.value);
+        }
+        break;
+    case ParsedController::NRPN:
+        if (isControllerBound(ControllerInfo(event.channel, event.number, ControllerInfo::NRPNType))) {
+            postToGui(QueuedMidiEvent::BoundNRPN, event.channel, event.number, event.value);
+        }
+        else {
+            postToGui(QueuedMidiEvent::NRPN, event.channel, event.number, event.value);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* true if a control change is a part of a bound 14-bit controller, or the
+   data entry of a bound RPN/NRPN. Parameter selection is always forwarded. */
+bool FP4Qt::isPartOfBoundController(int channel, int cc, bool complete, const ParsedController &parsed) const {
+    if (channel < 0 || channel >= 16) {
+        return false;
+    }
+
+    if (cc == 6 || cc == 38) {
+        if (!complete) {
+            return false;
+        }
+        int type = parsed.type == ParsedController::RPN ? ControllerInfo::RPNType : ControllerInfo::NRPNType;
+        return isControllerBound(ControllerInfo(channel, parsed.number, type));
+    }
+
+    if (cc >= 0 && cc < 64) {
+        return m_boundHiresControllers[channel][cc & 0x1f];
+    }
+
+    return false;
+}
+
+/* true if the controller is bound to a widget. safe from any thread. */
+bool FP4Qt::isControllerBound(const ControllerInfo &controller) const {
+    if (!controller.isValid()) {
+        return false;
+    }
+
+    switch (controller.type) {
+    case ControllerInfo::CCType:
+        return m_boundControllers[controller.channel][controller.cc];
+    case ControllerInfo::CC14Type:
+        return m_boundHiresControllers[controller.channel][controller.cc];
+    default: {
+        int set = controller.type == ControllerInfo::RPNType ? 0 : 1;
+        uint32_t bits = m_boundParameters[controller.channel][set][controller.cc >> 5];
+        return bits & (1u << (controller.cc & 0x1f));
+    }
+    }
+}
+
+/* scale a controller value to the range of its binding and update the bound
+   widget. Runs in the GUI thread. */
+void FP4Qt::handleBoundController(const ControllerInfo &controller, int value) {
+    const BoundControllerEntry* entry = boundControllerEntry(controller);
+    if (entry && entry->widget) {
+        int offset = (int)(((int64_t)value * entry->scale + 0x8000) >> 16);
+        value = entry->reversed ? entry->base - offset : entry->base + offset;
+
+        holdRepaint(entry->widget, value, controller.maximum());
+        updateBoundWidget(entry->widget, value, controller.maximum());
+
+        // emit modified value
+        emitControllerReceived(controller, value);
+    }
+    else {
+        // binding was removed while the event was queued
+        sendControllerValue(controller, value);
+        emitControllerReceived(controller, value);
+    }
+}
 
-        if (ev->type != SND_SEQ_EVENT_CONTROLLER) {
-            qDebug() << "FP4: expected another control change after control change with control==0";
-            qDebug() << "     Missed one event.";
-            return;
+/* The value of a bound widget is set as soon as the controller event arrives,
+   so its handlers send the new value to the FP4 right away. Painting it is held
+   back until the next repaint interval, so a continuous controller doesn't
+   repaint the widget for every event. */
+void FP4Qt::holdRepaint(QWidget *widget, int value, int maximum) {
+    auto it = m_heldRepaints.find(widget);
+    if (it != m_heldRepaints.end()) {
+        it.value() = BoundWidgetValue(value, maximum);
+        return;
+    }
+
+    if (!widget->updatesEnabled()) {
+        // disabled by someone else
+        return;
+    }
+
+    widget->setUpdatesEnabled(false);
+    m_heldRepaints.insert(widget, BoundWidgetValue(value, maximum));
+
+    if (!m_repaintTimer->isActive()) {
+        m_repaintTimer->start();
+    }
+}
+
+/* paint the latest values of the bound widgets. The values were sent when
+   they arrived, so they are shown again with signals blocked. Push buttons
+   are left as they are, showing a value again would click them. */
+void FP4Qt::releaseRepaints() {
+    QHash<QWidget*, BoundWidgetValue> held = m_heldRepaints;
+    m_heldRepaints.clear();
+
+    for (auto it = held.constBegin(); it != held.constEnd(); ++it) {
+        QWidget* widget = it.key();
+        if (!qobject_cast<QPushButton*>(widget)) {
+            bool blocked = widget->blockSignals(true);
+            updateBoundWidget(widget, it.value().value, it.value().maximum);
+            widget->blockSignals(blocked);
         }
+        widget->setUpdatesEnabled(true);
+    }
+}
 
-        qDebug() << "FP4: bank change on channel " << channel << ": " << ((value << 7) + ev->data.control.value) << " (" <<
-                hex << value << ", " << ev->data.control.value << ")" << dec;
+/* forget the held repaint of a widget that is unbound, so a value received
+   while it was bound isn't shown again */
+void FP4Qt::dropHeldRepaint(QWidget *widget) {
+    if (m_heldRepaints.remove(widget)) {
+        widget->setUpdatesEnabled(true);
+    }
+}
+
+/* return the compiled binding of a controller, 0 if it has none. 7-bit and
+   14-bit controllers are looked up in a table, parameters in a map. */
+const BoundControllerEntry *FP4Qt::boundControllerEntry(const ControllerInfo &controller) const {
+    if (!controller.isValid()) {
+        return 0;
+    }
+
+    switch (controller.type) {
+    case ControllerInfo::CCType:
+        return &m_ccTable[controller.channel][controller.cc];
+    case ControllerInfo::CC14Type:
+        return &m_cc14Table[controller.channel][controller.cc];
+    default: {
+        auto it = m_parameterTable.constFind(controller);
+        return it == m_parameterTable.constEnd() ? 0 : &it.value();
+    }
+    }
+}
+
+/* send a controller with the message type it was received with */
+void FP4Qt::sendControllerValue(const ControllerInfo &controller, int value) {
+    switch (controller.type) {
+    case ControllerInfo::CCType:
+        sendController(controller.channel, controller.cc, value);
+        break;
+    case ControllerInfo::CC14Type:
+        sendControllerHires(controller.channel, controller.cc, value);
+        break;
+    case ControllerInfo::RPNType:
+        sendRPNHires(controller.channel, controller.cc >> 7, controller.cc & 0x7f, value);
+        break;
+    case ControllerInfo::NRPNType:
+        sendNRPNHires(controller.channel, controller.cc >> 7, controller.cc & 0x7f, value);
+        break;
+    }
+}
 
-        emit bankChangeReceived(channel, value, ev->data.control.value);
+void FP4Qt::emitControllerReceived(const ControllerInfo &controller, int value) {
+    switch (controller.type) {
+    case ControllerInfo::CCType:
+        emit ccReceived(controller.channel, controller.cc, value);
+        break;
+    case ControllerInfo::CC14Type:
+        emit hiresControllerReceived(controller.channel, controller.cc, value);
+        break;
+    case ControllerInfo::RPNType:
+        emit rpnReceived(controller.channel, controller.cc, value);
+        break;
+    case ControllerInfo::NRPNType:
+        emit nrpnReceived(controller.channel, controller.cc, value);
+        break;
+    }
+}
+
+/* a binding signal was emitted, recompile the controller */
+void FP4Qt::onBindingChanged(const ControllerInfo &controller, const BindingInfo &binding) {
+    Q_UNUSED(binding);
+    updateBoundController(controller);
+}
+
+/* compile the binding of a controller in the binding table, and keep
+   m_boundControllers, m_boundHiresControllers and m_boundParameters in sync
+   with m_ccBindings.
+   The binding range is stretched to the range of the controller so high
+   resolution controllers are scaled without losing steps. */
+void FP4Qt::updateBoundController(const ControllerInfo &controller) {
+    if (!controller.isValid()) {
+        return;
+    }
+
+    BoundControllerEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.widget = m_ccBindings.value(controller, 0);
+
+    auto config = m_bindingConfigMap.constFind(controller);
+    if (entry.widget && config != m_bindingConfigMap.constEnd()) {
+        int maximum = controller.maximum();
+        int low = config.value().minValue * maximum / 127;
+        int high = config.value().maxValue * maximum / 127;
+
+        entry.reversed = config.value().reversed;
+        entry.base = entry.reversed ? high : low;
+        entry.scale = (int)(((int64_t)(high - low) << 16) / maximum);
     }
     else {
-//        qDebug() << "FP4: Controller on channel " << channel << ": " << controller << "=" << value;
-        ControllerInfo controller(channel, cc);
-        QWidget* widget = m_ccBindings.value(controller, 0);
-        if (widget) {
-            Q_ASSERT(m_bindingConfigMap.contains(controller));
-            const BindingInfo& binding = m_bindingConfigMap.value(controller);
-
-            value = (int)((float)value * (((float)binding.maxValue - (float)binding.minValue)/127.f));
-            if (binding.reversed) {
-                value = binding.maxValue - value;
-            }
-            else {
-                value += binding.minValue;
-            }
+        entry.widget = 0;
+    }
 
-            updateBoundWidget(widget, value);
+    bool bound = entry.widget != 0;
 
-            // emit modified value
-            emit ccReceived(channel, cc, value);
+    switch (controller.type) {
+    case ControllerInfo::CCType:
+        m_ccTable[controller.channel][controller.cc] = entry;
+        m_boundControllers[controller.channel][controller.cc] = bound;
+        break;
+    case ControllerInfo::CC14Type:
+        m_cc14Table[controller.channel][controller.cc] = entry;
+        m_boundHiresControllers[controller.channel][controller.cc] = bound;
+        break;
+    default: {
+        int set = controller.type == ControllerInfo::RPNType ? 0 : 1;
+        std::atomic<uint32_t>& bits = m_boundParameters[controller.channel][set][controller.cc >> 5];
+        uint32_t mask = 1u << (controller.cc & 0x1f);
+        if (bound) {
+            m_parameterTable.insert(controller, entry);
+            bits.fetch_or(mask);
         }
         else {
-            sendController(channel, cc, value);
-            emit ccReceived(channel, cc, value);
+            m_parameterTable.remove(controller);
+            bits.fetch_and(~mask);
         }
-
+        break;
+    }
     }
 }
 
@@ -272,7 +1191,13 @@ void FP4Qt::onSysEx(const unsigned char* data, int length) {
     default:
         qDebug() << "FP4: received unknown sysex message:" << endl << "    ";
         dumpSysEx(data, length);
-        emit sysexReceived(data, length);
+        if (QThread::currentThread() == thread()) {
+            emit sysexReceived(data, length);
+        }
+        else {
+            QMetaObject::invokeMethod(this, "deliverSysEx", Qt::QueuedConnection,
+                                      Q_ARG(QByteArray, QByteArray((const char*)data, length)));
+        }
         break;
     }
 }
@@ -290,36 +1215,44 @@ void FP4Qt::onIdentityResponse(const unsigned char* data, int length) {
 
 /* let other objects react to initial connection */
 void FP4Qt::onConnect() {
-    emit connected();
+    refreshInputDescriptors();
+    postToGui(QueuedMidiEvent::Connected);
 }
 
 /* let other objects react to subsequent connections (after a disconnection) */
 void FP4Qt::onReconnect() {
-    emit reconnected();
+    refreshInputDescriptors();
+    postToGui(QueuedMidiEvent::Reconnected);
+}
+
+/* a sysex message or buffered output was held back. Wake up the MIDI thread,
+   or the GUI thread if input is read there, so it sends it when it's due. */
+void FP4Qt::onOutputQueued() {
+    if (m_midiThread && m_midiThread->isRunning() && !isMidiThread()) {
+        m_midiThread->wakeUp();
+    }
+    else if (!m_inputNotifiers.isEmpty()) {
+        QMetaObject::invokeMethod(this, "processMidiInGuiThread", Qt::QueuedConnection);
+    }
 }
 
 /* let other objects react to disconnections */
 void FP4Qt::onDisconnect() {
-    emit disconnected();
+    postToGui(QueuedMidiEvent::Disconnected);
 }
 
 void FP4Qt::onClientConnect(int client_id, int port) {
-    emit clientConnected(client_id, port);
+    postToGui(QueuedMidiEvent::ClientConnected, 0, client_id, port);
 }
 
 void FP4Qt::onClientDisconnect(int client_id, int port) {
-    emit clientDisconnected(client_id, port);
+    postToGui(QueuedMidiEvent::ClientDisconnected, 0, client_id, port);
 }
 
 /* register a controller binding: bind a controller message (channel+cc) to a widget
    that will be updated on incoming CC events. */
 void FP4Qt::addControllerBinding(QWidget *widget, int channel, int cc) {
-    QString group = widget->property("cc_group").value<QString>();
-    Q_ASSERT(!group.isEmpty());
-    QString name = widget->property("cc_name").value<QString>();
-    Q_ASSERT(!name.isEmpty());
-
-    m_ccBindings.insert(ControllerInfo(channel, cc), widget);
+    BindableWidgetId id = bindableWidgetId(widget);
 
     BindingInfo oldBinding;
     ControllerInfo controller(channel, cc);
@@ -328,9 +1261,9 @@ void FP4Qt::addControllerBinding(QWidget *widget, int channel, int cc) {
          oldBinding = m_bindingConfigMap.value(controller);
     }
 
-    BindingInfo binding(group, name);
-    m_bindingConfigMap.insert(controller, binding );
-    connect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(onWidgetDeleted(QObject*)));
+    BindingInfo binding(id);
+    bindWidget(controller, widget);
+    setBindingConfig(controller, binding);
 
     if (replace) {
         emit bindingRemoved(controller, oldBinding);
@@ -340,8 +1273,8 @@ void FP4Qt::addControllerBinding(QWidget *widget, int channel, int cc) {
 }
 
 void FP4Qt::addControllerBinding(const ControllerInfo& controller, const BindingInfo& binding) {
-    Q_ASSERT(!binding.group.isEmpty());
-    Q_ASSERT(!binding.name.isEmpty());
+    Q_ASSERT(!binding.group().isEmpty());
+    Q_ASSERT(!binding.name().isEmpty());
 
     BindingInfo oldBinding;
     bool replace = m_bindingConfigMap.contains(controller);
@@ -349,13 +1282,12 @@ void FP4Qt::addControllerBinding(const ControllerInfo& controller, const Binding
         oldBinding = m_bindingConfigMap.value(controller);
     }
 
-    m_bindingConfigMap[controller] = binding;
+    setBindingConfig(controller, binding);
 
     // bind to widget if present
-    if (m_bindableWidgets.contains(binding.group) && m_bindableWidgets[binding.group].contains(binding.name)) {
-        QWidget* widget = m_bindableWidgets[binding.group][binding.name];
-        m_ccBindings.insert(controller, widget);
-        connect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(onWidgetDeleted(QObject*)));
+    QWidget* widget = m_bindableWidgets.value(binding.widgetId(), 0);
+    if (widget) {
+        bindWidget(controller, widget);
     }
 
     if (replace) {
@@ -368,18 +1300,17 @@ void FP4Qt::addControllerBinding(const ControllerInfo& controller, const Binding
 
 /* add or replace binding */
 void FP4Qt::updateControllerBinding(QWidget *widget, int channel, int cc) {
-    QString group = widget->property("cc_group").value<QString>();
-    Q_ASSERT(!group.isEmpty());
-    QString name = widget->property("cc_name").value<QString>();
-    Q_ASSERT(!name.isEmpty());
+    updateControllerBinding(widget, ControllerInfo(channel, cc));
+}
+
+void FP4Qt::updateControllerBinding(QWidget *widget, const ControllerInfo &controller) {
+    BindableWidgetId id = bindableWidgetId(widget);
 
-    // this replaces widget for channel+cc
-    m_ccBindings.insert(ControllerInfo(channel, cc), widget);
-    connect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(onWidgetDeleted(QObject*)));
+    // this replaces widget for the controller
+    bindWidget(controller, widget);
 
-    BindingInfo binding(group, name, 0, 127, false);
+    BindingInfo binding(id, 0, 127, false);
     BindingInfo oldBinding;
-    ControllerInfo controller(channel, cc);
     bool replace = m_bindingConfigMap.contains(controller);
     if (replace) {
         oldBinding = m_bindingConfigMap.value(controller);
@@ -388,7 +1319,7 @@ void FP4Qt::updateControllerBinding(QWidget *widget, int channel, int cc) {
         binding.reversed = oldBinding.reversed;
     }
 
-    m_bindingConfigMap.insert(controller, binding );
+    setBindingConfig(controller, binding);
 
     if (replace) {
         emit bindingUpdated(controller, binding);
@@ -400,62 +1331,57 @@ void FP4Qt::updateControllerBinding(QWidget *widget, int channel, int cc) {
 
 /* delete a controller binding */
 void FP4Qt::deleteControllerBinding(QWidget *widget) {
-    QMutableMapIterator< ControllerInfo, QWidget* > it(m_ccBindings);
-    while (it.hasNext()) {
-        it.next();
-        const ControllerInfo &controller = it.key();
-        if (it.value() == widget) {
-            QString group = it.value()->property("cc_group").value<QString>();
-            QString name = it.value()->property("cc_name").value<QString>();
-            it.remove();
-            BindingInfo binding = m_bindingConfigMap.value(controller);
-            m_bindingConfigMap.remove(controller);
-            emit bindingRemoved(controller, binding);
-            break;
-        }
+    ControllerInfo controller = controlledWidgetInfo(widget);
+    if (controller != ControllerInfo::Invalid) {
+        deleteControllerBinding(controller);
     }
 }
 
 /* delete a controller binding */
 void FP4Qt::deleteControllerBinding(int channel, int cc) {
-    ControllerInfo controller(channel, cc);
-    m_ccBindings.remove(controller);
+    deleteControllerBinding(ControllerInfo(channel, cc));
+}
 
-    BindingInfo binding = m_bindingConfigMap.value(controller);
-    m_bindingConfigMap.remove(controller);
+void FP4Qt::deleteControllerBinding(const ControllerInfo &controller) {
+    unbindWidget(controller);
+    BindingInfo binding = removeBindingConfig(controller);
 
     emit bindingRemoved(controller, binding);
 }
 
 /* update a widget when an incoming cc event is received.
    QCheckBoxes, QComboBoxes, QSliders and QLabels can be updated.
-   value is between 0 and 127
+   value is between 0 and maximum, which is 127 for 7-bit controllers and
+   16383 for high resolution controllers.
 */
-void FP4Qt::updateBoundWidget(QWidget *widget, int value) {
+void FP4Qt::updateBoundWidget(QWidget *widget, int value, int maximum) {
+    // switches use the 7-bit thresholds
+    int value7 = value * 127 / maximum;
+
     QCheckBox* cb = qobject_cast<QCheckBox*>(widget);
     if (cb) {
-        cb->setChecked(value > 63);
+        cb->setChecked(value7 > 63);
         return;
     }
 
     QComboBox* combo = qobject_cast<QComboBox*>(widget);
     if (combo) {
-        int idx = (float)value/127.0 * (combo->count()-1);
+        int idx = (double)value/maximum * (combo->count()-1);
         combo->setCurrentIndex(idx);
         return;
     }
 
     QSlider* slider = qobject_cast<QSlider*>(widget);
     if (slider) {
-        int idx = slider->minimum() + (float)value/127.0 * (slider->maximum()-slider->minimum());
+        int idx = slider->minimum() + qRound((double)value/maximum * (slider->maximum()-slider->minimum()));
         slider->setValue(idx);
         return;
     }
 
     QSpinBox* spinBox = qobject_cast<QSpinBox*>(widget);
     if (spinBox) {
-        int idx = slider->minimum() + (float)value/127.0 * (slider->maximum()-slider->minimum());
-        slider->setValue(idx);
+        int idx = spinBox->minimum() + qRound((double)value/maximum * (spinBox->maximum()-spinBox->minimum()));
+        spinBox->setValue(idx);
         return;
     }
 
@@ -470,7 +1396,7 @@ void FP4Qt::updateBoundWidget(QWidget *widget, int value) {
         QVariant stateVariant = button->property("midi_push");
         if (!stateVariant.isValid() || !stateVariant.value<bool>()) {
             // was not pressed but is now
-            if (value > 85) {
+            if (value7 > 85) {
                 button->click();
                 button->setDown(true);
                 button->setProperty("midi_push", true);
@@ -478,7 +1404,7 @@ void FP4Qt::updateBoundWidget(QWidget *widget, int value) {
         }
         else {
             // was pressed, but is not anymore
-            if (value < 42) {
+            if (value7 < 42) {
                 button->setDown(false);
                 button->setProperty("midi_push", false);
             }
@@ -496,115 +1422,112 @@ void FP4Qt::updateBoundWidget(QWidget *widget, int value) {
     qDebug() << "Got controller message for unsupported widget type.";
 }
 
-/* When a widget is deleted, remove its cc binding */
+/* When a widget is deleted, remove its cc bindings. The binding configuration
+   is kept, so the bindings are restored when the widget is created again. */
 void FP4Qt::onWidgetDeleted(QObject *obj) {
     QWidget* widget = qobject_cast<QWidget*>(obj);
-    if (!obj) {
+    if (!widget) {
         return;
     }
 
-    QMutableMapIterator< ControllerInfo, QWidget* > it(m_ccBindings);
-    while (it.hasNext()) {
-        it.next();
-        if (it.value() == widget) {
-            it.remove();
-            break;
-        }
+    foreach (const ControllerInfo& controller, m_widgetControllers.values(widget)) {
+        m_ccBindings.remove(controller);
+        updateBoundController(controller);
     }
+    m_widgetControllers.remove(widget);
+    m_heldRepaints.remove(widget);
 }
 
 /* delete all bindings */
 void FP4Qt::clearBindings() {
+    QList<ControllerInfo> controllers = m_ccBindings.keys();
+    foreach (QWidget* widget, m_heldRepaints.keys()) {
+        dropHeldRepaint(widget);
+    }
     m_ccBindings.clear();
+    m_widgetControllers.clear();
+    foreach (const ControllerInfo& controller, controllers) {
+        updateBoundController(controller);
+    }
     m_bindingConfigMap.clear();
+    m_namedBindings.clear();
     emit bindingsCleared();
 }
 
 /* Process incoming noteon if channel mappings are in use. Channel mapping
    transform modes that ignore noteoff events keep track of the played notes in
-   m_mappedNotes. FP4::m_notes cannot be used, because multiple input ranges
-   may map to the same output channel, with another channel mapping transform
-   mode applied. */
+   m_mappedNotes, by input channel. FP4::m_notes cannot be used, because
+   multiple input ranges may map to the same output channel, with another
+   channel mapping transform mode applied. */
 void FP4Qt::handleMappedNoteOn(int channelIn, int note, int velocity) {
-    for (int channelOut=0; channelOut<16; ++channelOut) {
-        // check if there is a mapping from channelIn to channelOut, and if
-        // played note falls in that range
-        ChannelMapping* mapping = channelMapping(channelIn, channelOut);
-        if (!mapping->active)
-            continue;
-        if (note < mapping->keyLow || note > mapping->keyHigh)
-            continue;
+    ChannelRouting* routing = currentRouting();
+    holdRouting(channelIn, note, routing);
+
+    const MappedNoteFanOut& fanOut = routing->fanOut[channelIn][note];
+    for (int i=0; i<fanOut.count; ++i) {
+        const MappedNoteTarget& target = fanOut.targets[i];
 
         // emit note on for mapped note, ignoring octave shift
-        emit noteOnReceived(channelOut, note, velocity);
+        postToGui(QueuedMidiEvent::NoteOn, target.channelOut, note, velocity);
 
-        // is the note still valid after octaveShift ?
-        note += 12 * mapping->octaveShift;
-        if (note < 0)
-            continue;
-        if (note > 127)
+        if (target.note < 0)
             continue;
 
-        Q_ASSERT(mapping->transformMode >= 0 && mapping->transformMode < m_channelTransforms.count());
-        m_channelTransforms[mapping->transformMode]->handleNoteOn(mapping, channelIn, channelOut, note, velocity);
+        FP4LatencyScope latency(LatencyTransform);
+        m_channelTransforms[target.transformMode]->handleNoteOn(&routing->mappings[channelIn][target.channelOut],
+                                                               channelIn, target.channelOut, target.note, velocity);
     }
 }
 
-/* handle noteoff event on a mapped channel */
+/* handle noteoff event on a mapped channel. The note off is routed like the
+   note on was, even if the mappings were changed in between. */
 void FP4Qt::handleMappedNoteOff(int channelIn, int note) {
-    for (int channelOut=0; channelOut<16; ++channelOut) {
-        // check if there is a mapping from channelIn to channelOut, and if
-        // played note falls in that range
-        ChannelMapping* mapping = channelMapping(channelIn, channelOut);
-        if (!mapping->active)
-            continue;
-        if (note < mapping->keyLow || note > mapping->keyHigh)
-            continue;
+    ChannelRouting* held = m_heldRoutings[m_noteSource][channelIn][note];
+    m_heldRoutings[m_noteSource][channelIn][note] = 0;
+
+    ChannelRouting* routing = held ? held : currentRouting();
+
+    const MappedNoteFanOut& fanOut = routing->fanOut[channelIn][note];
+    for (int i=0; i<fanOut.count; ++i) {
+        const MappedNoteTarget& target = fanOut.targets[i];
 
         // emit noteoff for mapped note, ignoring octave shift
-        emit noteOffReceived(channelOut, note);
+        postToGui(QueuedMidiEvent::NoteOff, target.channelOut, note);
 
-        // is the note still valid after octaveShift ?
-        note += 12 * mapping->octaveShift;
-        if (note < 0)
-            continue;
-        if (note > 127)
+        if (target.note < 0)
             continue;
 
-        Q_ASSERT(mapping->transformMode >= 0 && mapping->transformMode < m_channelTransforms.count());
-        m_channelTransforms[mapping->transformMode]->handleNoteOff(mapping, channelIn, channelOut, note);
+        FP4LatencyScope latency(LatencyTransform);
+        m_channelTransforms[target.transformMode]->handleNoteOff(&routing->mappings[channelIn][target.channelOut],
+                                                                channelIn, target.channelOut, target.note);
+    }
+
+    if (held) {
+        unholdRouting(held);
     }
 }
 
 /* send noteoff messages to hardware for all the notes marked as being
-   played in m_mappedNotes for the specified channels and unmark them. */
+   played in m_mappedNotes for the specified channels and unmark them. A note
+   registered several times gets as many note offs, FP4 only sends the last
+   one. Notes played by other input channels keep sounding. */
 void FP4Qt::mappedNotesOff(int channelIn, int channelOut) {
-    const ChannelMapping* mapping = channelMapping(channelIn, channelOut);
-
-    int low = mapping->keyLow + 12 * mapping->octaveShift;
-    int high = mapping->keyHigh + 12 * mapping->octaveShift;
-    if (low < 0) low = 0;
-    if (low > 127) low = 127;
-    if (high < 0) high = 0;
-    if (high > 127) high = 127;
-
-    for (int i=low; i<=high; ++i) {
-        if (MAPPED_NOTE_IS_ON(channelIn, channelOut, i)) {
-            UNREGISTER_MAPPED_NOTE(channelIn, channelOut, i);
-            sendNoteOff(channelOut, i);
+    m_mappedNotes.releaseAll(channelIn, channelOut, [&](int note, int count) {
+        for (int i=0; i<count; ++i) {
+            sendNoteOff(channelOut, note);
         }
-    }
+    });
 }
 
 bool FP4Qt::isMappedNoteOn(int channelIn, int channelOut, int note) {
-    return MAPPED_NOTE_IS_ON(channelIn, channelOut, note);
+    return m_mappedNotes.isHeld(channelIn, channelOut, note);
 }
 
 void FP4Qt::registerMappedNote(int channelIn, int channelOut, int note) {
-    REGISTER_MAPPED_NOTE(channelIn, channelOut, note);
+    m_mappedNotes.press(channelIn, channelOut, note);
 }
 
 void FP4Qt::unregisterMappedNote(int channelIn, int channelOut, int note) {
-    UNREGISTER_MAPPED_NOTE(channelIn, channelOut, note);
+    m_mappedNotes.release(channelIn, channelOut, note);
 }
 
@@ -27,14 +27,36 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 
 #include <QObject>
 #include <QMap>
+#include <QHash>
+#include <QPair>
 #include <inttypes.h>
+#include <atomic>
 #include <QStringList>
 #include "fp4hw.h"
+#include "spscring.h"
+#include "controllerparser.h"
+#include "notetracker.h"
+#include "controlrateengine.h"
 
 class QWidget;
 class QSettings;
+class QSocketNotifier;
+class QTimer;
 class FP4Qt;
 class ChannelTransform;
+class MidiThread;
+
+// where incoming notes come from. Notes of different sources are tracked
+// separately so they don't release each other.
+enum NoteSource {
+    NoteSourceInput,        // MIDI input
+    NoteSourceGenerator,    // injected by other threads
+
+    NoteSourceCount
+};
+
+// default time in ms between notes played as a chord
+#define DEFAULT_CHORD_WINDOW 20
 
 // map a channel + range to a new channel + transpose
 struct ChannelMapping {
@@ -45,42 +67,99 @@ struct ChannelMapping {
     bool active;
     int octaveShift;
     int transformMode;
+    int chordWindow;        // ms, see SmartChannelTransform
+};
+
+// one output of a note played on a mapped input channel
+struct MappedNoteTarget {
+    uint8_t channelOut;
+    int8_t note;                // note after octave shift, -1 if out of range
+    uint8_t transformMode;
 };
 
-// identify a controller
+// outputs of a note played on an input channel, compiled from the mappings
+struct MappedNoteFanOut {
+    uint8_t count;
+    MappedNoteTarget targets[16];
+};
+
+// Immutable copy of the channel mappings used by the MIDI thread. A new one
+// is published every time the mappings are edited, the old one lives on until
+// every note routed with it has been released.
+struct ChannelRouting {
+    ChannelRouting() : holds(0), retired(false), released(false) {}
+
+    ChannelMapping mappings[16][16];
+    MappedNoteFanOut fanOut[16][128];
+
+    int holds;                      // held notes routed with this, MIDI thread only
+    bool retired;                   // replaced by a newer one, MIDI thread only
+    std::atomic<bool> released;     // set by the MIDI thread when it can be deleted
+};
+
+// identify a controller. For 14-bit controllers cc is the number of the MSB
+// controller (0-31), for RPN and NRPN it is the 14-bit parameter number.
 struct ControllerInfo {
-    ControllerInfo() : channel(-1), cc(-1) {}
-    ControllerInfo(int channel, int cc) : channel(channel), cc(cc) {}
+    enum Type {
+        CCType,
+        CC14Type,
+        RPNType,
+        NRPNType
+    };
+
+    ControllerInfo() : channel(-1), cc(-1), type(CCType) {}
+    ControllerInfo(int channel, int cc, int type=CCType) : channel(channel), cc(cc), type(type) {}
 
     int channel;
     int cc;
+    int type;
 
     static const ControllerInfo Invalid;
 
+    bool isHires() const { return type != CCType; }
+
+    // largest value sent by this controller
+    int maximum() const { return type == CCType ? 127 : 16383; }
+
+    bool isValid() const;
+    bool includesController(int channel, int cc) const;
+    QString description() const;
+
     bool operator<(const ControllerInfo& other) const {
-        return ( channel == other.channel )
+        if (channel != other.channel) {
+            return channel < other.channel;
+        }
+        return ( type == other.type )
                 ? ( cc < other.cc )
-                : ( channel < other.channel );
+                : ( type < other.type );
     }
 
     bool operator==(const ControllerInfo& other) const {
-        return cc == other.cc && channel == other.channel;
+        return cc == other.cc && channel == other.channel && type == other.type;
     }
 
     bool operator!=(const ControllerInfo& other) const {
-        return cc != other.cc || channel != other.channel;
+        return !(*this == other);
     }
 };
 
-// binding info to map controller values to widgets values
+// identify a bindable widget by the atoms of its cc_group and cc_name properties
+typedef QPair<int, int> BindableWidgetId;
+
+// binding info to map controller values to widgets values. The range is given
+// in 7-bit steps, and stretched to the range of high resolution controllers.
 struct BindingInfo {
-    BindingInfo() : group(""), name(""), minValue(-1), maxValue(-1), reversed(false) {}
-    BindingInfo(const QString& group, const QString& name, int min=0, int max=127, bool reversed=false) :
-        group(group), name(name), minValue(min), maxValue(max), reversed(reversed)
-    {}
+    BindingInfo() : groupAtom(-1), nameAtom(-1), minValue(-1), maxValue(-1), reversed(false) {}
+    BindingInfo(const QString& group, const QString& name, int min=0, int max=127, bool reversed=false);
+    explicit BindingInfo(const BindableWidgetId& widget, int min=0, int max=127, bool reversed=false);
+
+    QString group() const;
+    QString name() const;
+    BindableWidgetId widgetId() const { return BindableWidgetId(groupAtom, nameAtom); }
 
-    QString group;
-    QString name;
+    // cc_group and cc_name, interned in AtomTable::bindingNames()
+    int groupAtom;
+    int nameAtom;
     int minValue;
     int maxValue;
     bool reversed;
@@ -88,23 +167,120 @@ struct BindingInfo {
     static const BindingInfo Invalid;
 };
 
+// Binding compiled for dispatch: the bound widget and a 16.16 fixed point
+// scale that maps the controller range to the binding range.
+struct BoundControllerEntry {
+    QWidget* widget;
+    int base;           // minimum value, or maximum if reversed
+    int scale;
+    bool reversed;
+};
+
+// Latest controller value received for a bound widget whose repaint is held
+struct BoundWidgetValue {
+    BoundWidgetValue() : value(0), maximum(127) {}
+    BoundWidgetValue(int value, int maximum) : value(value), maximum(maximum) {}
+
+    int value;
+    int maximum;
+};
+
 // Controller to Widget. This is used to send incoming CC events to widgets
 typedef QMap< ControllerInfo, QWidget* > ControllerBindingMap;
 
 // Widget identification (cc_group, cc_name) to Widget. This keeps track of all widgets that
 // are bindable as they are created and destroyed, and is is used to find widgets when
 // a new preset is loaded.
-typedef QMap< QString, QMap< QString, QWidget* > > BindableWidgetsMap;
+typedef QHash< BindableWidgetId, QWidget* > BindableWidgetsMap;
 
 // Controller to Binding information (bound widget, mapping range). This is the binding
 // configuration as saved.
 typedef QMap< ControllerInfo, BindingInfo > BindingConfigMap;
 
+// Reverse indexes: the controllers bound to a widget, and the controllers configured for a
+// (cc_group, cc_name) pair. A widget or name can be bound to several controllers.
+typedef QMultiHash< QWidget*, ControllerInfo > WidgetControllersMap;
+typedef QMultiHash< BindableWidgetId, ControllerInfo > NamedBindingsMap;
+
+// Event passed between the MIDI thread and the GUI thread. Events for the GUI
+// are turned into the FP4Qt signals, events injected by the GUI (generators)
+// are fed to the input handlers in the MIDI thread.
+struct QueuedMidiEvent {
+    enum Type {
+        NoteOn,
+        NoteOff,
+        BankChange,
+        ProgramChange,
+        Controller,
+        BoundController,
+        BoundHiresController,
+        BoundRPN,
+        BoundNRPN,
+        HiresController,
+        RPN,
+        NRPN,
+        Connected,
+        Reconnected,
+        Disconnected,
+        ClientConnected,
+        ClientDisconnected
+    };
+
+    int type;
+    int channel;
+    int data1;
+    int data2;
+    LatencyContext latency;     // input event this event was caused by
+};
+
+// number of events that can be queued in each direction
+#define MIDI_EVENT_QUEUE_SIZE 1024
+
+// request of another thread to start or stop a controller ramp
+struct ControlRampRequest {
+    bool stop;
+    ControlRamp ramp;
+};
+
+// number of ramp requests that can be queued
+#define CONTROL_RAMP_QUEUE_SIZE 256
+
 class FP4Qt : public QObject, public FP4
 {
     Q_OBJECT
 public:
-    explicit FP4Qt(const char* clientName=ALSA_CLIENT_NAME, QObject *parent = 0);
+    explicit FP4Qt(const char* clientName=ALSA_CLIENT_NAME, QObject *parent = 0, MidiBackend* backend = 0);
+    ~FP4Qt();
+
+    // read and route MIDI events in a dedicated thread, or in the GUI thread
+    // if the thread can't be used
+    void startMidiThread(bool realtime);
+    void stopMidiThread();
+    bool isMidiThread() const;
+
+    // true if the controller is bound to a widget. safe from any thread.
+    bool isControllerBound(int channel, int cc) const {
+        return channel >= 0 && channel < 16 && cc >= 0 && cc < 128 && m_boundControllers[channel][cc];
+    }
+    bool isControllerBound(const ControllerInfo& controller) const;
+
+    // called by the MIDI thread to handle events injected by other threads
+    void processInjectedEvents();
+
+    // controller ramps of generators, run by the control rate timer.
+    // Requests must come from the GUI thread.
+    int allocateControllerRamp() { return ++m_lastRampId; }
+    void startControllerRamp(int id, int channel, int cc, int from, int to, int duration);
+    void stopControllerRamp(int id);
+    int controlRateFd() const { return m_controlRateFd; }
+
+    // maximum number of messages per second sent by generators on one
+    // controller, 0 for no limit. The final value of a ramp is always sent.
+    void setGeneratedControllerRate(int messagesPerSecond);
+    int generatedControllerRate() const { return m_generatedControllerRate; }
+    ControlRateStats generatedControllerStats() const { return m_controlRate.stats(); }
+    void resetGeneratedControllerStats() { m_controlRate.resetStats(); }
+    void countThinnedControllers(int count) { m_controlRate.addLimited(count); }
 
     QWidget* controlledWidget(int channel, int cc);
     ControllerInfo controlledWidgetInfo(QWidget* widget);
@@ -113,6 +289,7 @@ public:
 
     void loadDefaultMappings();
     ChannelMapping* channelMapping(int inChannel, int outChannel);
+    void updateChannelMappings();
 
     void enableChannelMappings(bool enable);
     bool channelMappingsEnabled() const;
@@ -126,6 +303,9 @@ signals:
     void bankChangeReceived(int channel, int msb, int lsb);
     void programChangeReceived(int channel, int pgm);
     void ccReceived(int channel, int cc, int value);
+    void hiresControllerReceived(int channel, int cc, int value);
+    void rpnReceived(int channel, int parameter, int value);
+    void nrpnReceived(int channel, int parameter, int value);
     void sysexReceived(const unsigned char* data, int length);
     void connected();
     void reconnected();
@@ -153,6 +333,9 @@ public slots:
     void onReconnect();
     void onDisconnect();
 
+    // paced sysex output is sent by the MIDI thread
+    void onOutputQueued();
+
     // other clients connections
     void onClientConnect(int m_client_id, int port);
     void onClientDisconnect(int m_client_id, int port);
@@ -160,17 +343,31 @@ public slots:
     void addControllerBinding(QWidget* widget, int channel, int cc);
     void addControllerBinding(const ControllerInfo& controller, const BindingInfo& binding);
     void updateControllerBinding(QWidget* widget, int channel, int cc);
+    void updateControllerBinding(QWidget* widget, const ControllerInfo& controller);
     void deleteControllerBinding(QWidget* widget);
     void deleteControllerBinding(int channel, int cc);
+    void deleteControllerBinding(const ControllerInfo& controller);
 
-    void updateBoundWidget(QWidget* widget, int value);
+    void updateBoundWidget(QWidget* widget, int value, int maximum=127);
     void onWidgetDeleted(QObject* obj);
 
     void registerBindableWidget(QWidget* widget);
     void unregisterBindableWidget(QObject* obj);
 
+    static BindableWidgetId bindableWidgetId(QObject* widget);
+
     void updateBinding(const ControllerInfo& controller, const BindingInfo& binding);
 
+    // called when the control rate timer expires
+    void processControlRate();
+
+private slots:
+    void dispatchGuiEvents();
+    void processMidiInGuiThread();
+    void deliverSysEx(const QByteArray& data);
+    void onBindingChanged(const ControllerInfo& controller, const BindingInfo& binding);
+    void releaseRepaints();
+
 protected:
     void handleMappedNoteOn(int channel, int note, int velocity);
     void handleMappedNoteOff(int channel, int note);
@@ -182,15 +379,111 @@ public:
     void unregisterMappedNote(int channelIn, int channelOut, int note);
 
 private:
-    bool m_channelMappingsEnabled;
+    void watchInputDescriptors();
+    void refreshInputDescriptors();
+    void armControlRate(bool armed);
+    void pushRampRequest(const ControlRampRequest& request);
+
+    ChannelRouting* currentRouting();
+    void holdRouting(int channelIn, int note, ChannelRouting* routing);
+    void unholdRouting(ChannelRouting* routing);
+    void retireRouting(ChannelRouting* routing);
+    void deleteReleasedRoutings();
+
+    bool injectInMidiThread(int type, int channel, int data1, int data2=0);
+    void postToGui(int type, int channel=0, int data1=0, int data2=0);
+    void dispatchGuiEvent(const QueuedMidiEvent& ev);
+    void handleBoundController(const ControllerInfo& controller, int value);
+    const BoundControllerEntry* boundControllerEntry(const ControllerInfo& controller) const;
+    void holdRepaint(QWidget* widget, int value, int maximum);
+    void dropHeldRepaint(QWidget* widget);
+    void sendControllerValue(const ControllerInfo& controller, int value);
+    void emitControllerReceived(const ControllerInfo& controller, int value);
+    void postParsedController(const ParsedController& event);
+    bool isPartOfBoundController(int channel, int cc, bool complete, const ParsedController& parsed) const;
+    void updateBoundController(const ControllerInfo& controller);
+
+    void bindWidget(const ControllerInfo& controller, QWidget* widget);
+    void unbindWidget(const ControllerInfo& controller);
+    void setBindingConfig(const ControllerInfo& controller, const BindingInfo& binding);
+    BindingInfo removeBindingConfig(const ControllerInfo& controller);
+
+private:
+    std::atomic<bool> m_channelMappingsEnabled;
+
+    // source of the note events being handled, and the input notes held by
+    // every source. Only used by the MIDI thread.
+    int m_noteSource;
+    NoteTracker<NoteSourceCount> m_inputNotes;
+
+    MidiThread* m_midiThread;
+    SpscRing<QueuedMidiEvent, MIDI_EVENT_QUEUE_SIZE> m_guiQueue;
+    SpscRing<QueuedMidiEvent, MIDI_EVENT_QUEUE_SIZE> m_injectQueue;
+    int m_guiWakeFd;
+    QSocketNotifier* m_guiWakeNotifier;
+    std::atomic<bool> m_guiWakePending;
+
+    // without a MIDI thread, input and paced output are handled by the GUI
+    // thread through these
+    QList<QSocketNotifier*> m_inputNotifiers;
+    QTimer* m_outputQueueTimer;
+
+    // ramps run by whichever thread handles MIDI events, woken up by the
+    // m_controlRateFd timerfd every CONTROL_RATE_INTERVAL while a ramp runs.
+    // The notifier is only enabled while there is no MIDI thread.
+    ControlRateEngine m_controlRate;
+    SpscRing<ControlRampRequest, CONTROL_RAMP_QUEUE_SIZE> m_rampQueue;
+    int m_controlRateFd;
+    QSocketNotifier* m_controlRateNotifier;
+    int m_lastRampId;
+    int m_generatedControllerRate;
+
+    // controllers that are bound to a widget. Written by the GUI thread, read
+    // by the MIDI thread to decide if a CC must be handled by the GUI.
+    std::atomic<bool> m_boundControllers[16][128];
+
+    // same for high resolution controllers, whose parts are not forwarded
+    // when bound. Parameters are a bitset per channel for RPN and NRPN.
+    std::atomic<bool> m_boundHiresControllers[16][32];
+    std::atomic<uint32_t> m_boundParameters[16][2][16384/32];
+
+    // assembles multi-CC messages. Only used by the MIDI thread.
+    ControllerParser m_controllerParser;
+
+    // bindings compiled from m_ccBindings and m_bindingConfigMap, indexed by
+    // channel and controller. Only used by the GUI thread.
+    BoundControllerEntry m_ccTable[16][128];
+    BoundControllerEntry m_cc14Table[16][32];
+    QMap<ControllerInfo, BoundControllerEntry> m_parameterTable;
+
+    // bound widgets whose repaint is held until m_repaintTimer fires, with
+    // their latest value
+    QHash<QWidget*, BoundWidgetValue> m_heldRepaints;
+    QTimer* m_repaintTimer;
 
     ControllerBindingMap m_ccBindings;
     BindableWidgetsMap m_bindableWidgets;
     BindingConfigMap m_bindingConfigMap;
+    WidgetControllersMap m_widgetControllers;
+    NamedBindingsMap m_namedBindings;
 
+    // edited by the GUI thread, published as a ChannelRouting by updateChannelMappings()
     ChannelMapping m_mappings[16][16];
 
-    uint8_t m_mappedNotes[16][16][128/8];
+    // routing handed over to the MIDI thread, picked up by currentRouting()
+    std::atomic<ChannelRouting*> m_pendingRouting;
+
+    // routing used by the MIDI thread for new notes, and the routing every
+    // sounding input note was played with. Only used by the MIDI thread.
+    ChannelRouting* m_routing;
+    ChannelRouting* m_heldRoutings[NoteSourceCount][16][128];
+
+    // every routing that has not been deleted yet. Only used by the GUI thread.
+    QList<ChannelRouting*> m_routings;
+
+    // notes played by channel transforms, by input channel (source) and
+    // output channel
+    NoteTracker<16> m_mappedNotes;
 
     QList<ChannelTransform*> m_channelTransforms;
     QStringList m_channelTransformNames;
@@ -35,6 +35,8 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 #include "bindingmanagerwidget.h"
 #include "performancewindow.h"
 #include "splitswindow.h"
+#include "latencywindow.h"
+#include "rawmidibackend.h"
 #include "fp4constants.h"
 #include "fp4managerapplication.h"
 #include "themeicon.h"
@@ -65,9 +67,15 @@ void FP4Win::init() {
 
     InstrumentWidget::restoreFavourites(settings);
 
+    // the sequencer is used unless the FP-4 is accessed directly
+    MidiBackend* backend = 0;
+    if (m_preferences->useRawMidi()) {
+        backend = new RawMidiBackend(m_preferences->rawMidiDevice().toLocal8Bit().constData(), FP4_CLIENT_NAME);
+    }
+
     // create FP4 object but don't send anything until all settings are
     // restored (also through child widgets).
-    m_fp4 = new FP4Qt(APP_TITLE, this);
+    m_fp4 = new FP4Qt(APP_TITLE, this, backend);
 //    m_fp4->setTraceMode(FP4::TraceAll);
     m_fp4->disableOutput();
     m_connectionTimer = new QTimer(this);
@@ -142,15 +150,18 @@ void FP4Win::initFP4() {
         m_fp4->enableAutoReconnect(FP4_CLIENT_NAME, 0);
     }
 
-    // connect incoming midi events to qt event loop even if no HW is found
+    m_fp4->setMemoryMapEnabled(m_preferences->skipUnchangedParameters());
+
+    // process incoming midi events in the MIDI thread even if no HW is found
     // because we also listen to virtual events like alsa connect/disconnect
     // to make autoconnection work
-    struct pollfd pfd[1];
-    snd_seq_poll_descriptors(m_fp4->getSequencer(), pfd, 1, POLLIN);
-    int seqEventFD = pfd[0].fd;
+    m_fp4->startMidiThread(m_preferences->realtimeMidiThread());
+
+    if (m_preferences->paceSysex()) {
+        m_fp4->setSysexBudget(m_preferences->sysexBytesPerMs());
+    }
 
-    QSocketNotifier* seqEventNotifier = new QSocketNotifier( seqEventFD, QSocketNotifier::Read, this );
-    connect( seqEventNotifier, SIGNAL(activated(int)), this, SLOT(onSeqEvent(int)));
+    m_fp4->setGeneratedControllerRate(m_preferences->generatedControllerRate());
 }
 
 /* restore geometry for this window and all the windows it created. */
@@ -174,6 +185,8 @@ void FP4Win::saveGeometry(QSettings &settings) const {
 
 /* send current settings to hardware on connection */
 void FP4Win::restoreFP4Settings() {
+    FP4OutputBatch batch(m_fp4);
+
     if (m_preferences->restoreMasterVolume()) {
         m_masterWidget->sendAll();
     }
@@ -215,11 +228,6 @@ void FP4Win::sendInitData() {
     }
 }
 
-/* React to midi input */
-void FP4Win::onSeqEvent(int) {
-    m_fp4->processEvents();
-}
-
 /* save everything when the app closes */
 void FP4Win::closeEvent(QCloseEvent *) {
     saveGlobalSettings();
@@ -232,6 +240,7 @@ void FP4Win::closeEvent(QCloseEvent *) {
     delete m_channelsWindow;
     delete m_GSSendWindow;
     delete m_splitsWindow;
+    delete m_latencyWindow;
 }
 
 /* called when the FP4 connects the first time. This can be at startup if
@@ -332,6 +341,12 @@ void FP4Win::showPerformanceWidget() {
     m_performanceWindow->raise();
 }
 
+/* display input to output latency statistics */
+void FP4Win::showLatencyWindow() {
+    m_latencyWindow->show();
+    m_latencyWindow->raise();
+}
+
 /* show information about Qt version etc */
 void FP4Win::showAboutQt() {
     QApplication::aboutQt();
@@ -412,15 +427,24 @@ void FP4Win::showConfigSaveAsDlg() {
                              .arg(QFileInfo(m_currentConfigurationName).fileName()));
 }
 
-/* send all slider / configuration data to the fp4 */
+/* send all slider / configuration data to the fp4. This also resends
+   parameters the FP4 should already have, in case they were changed on the
+   device itself. */
 void FP4Win::sendAll() {
+    FP4OutputBatch batch(m_fp4);
+    m_fp4->invalidateMemoryMap();
+
+    m_fp4->beginDataTransaction();
     sendInitData();
     restoreFP4Settings();
+    m_fp4->commitDataTransaction();
 }
 
-/* send a sounds off message to every channel */
+/* release every sounding note and send a sounds off message to every
+   channel */
 void FP4Win::sendPanic() {
     for (int ch=0; ch<16; ++ch) {
+        m_fp4->sendNotesOff(ch);
         m_fp4->sendAllSoundsOff(ch);
     }
 }
@@ -520,6 +544,8 @@ void FP4Win::buildWindows() {
     m_splitsWindow = new SplitsWindow(m_fp4);
 
     m_performanceWindow = new PerformanceWindow(this);
+
+    m_latencyWindow = new LatencyWindow(m_fp4);
 }
 
 /* create this widget */
@@ -614,6 +640,11 @@ void FP4Win::buildMenu() {
     showAction->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_T));
     showAction->setShortcutContext(Qt::ApplicationShortcut);
 
+    viewMenu->addSeparator();
+
+    QAction* latencyAction = viewMenu->addAction("Latency &statistics", this, SLOT(showLatencyWindow()));
+    latencyAction->setStatusTip("Display the time taken to relay and transform incoming MIDI events.");
+
     /* instrument menu */
 
     QMenu* instrumentMenu = menuBar->addMenu("&Instrument");
@@ -40,6 +40,7 @@ class PreferencesWindow;
 class AutoConnectWindow;
 class ChannelsWindow;
 class GSSendWindow;
+class LatencyWindow;
 class BindingManagerWindow;
 class PerformanceWindow;
 class SplitsWindow;
@@ -81,7 +82,6 @@ protected slots:
     void setInstrument(uint channel, uint instrumentId);
 
     void sendInitData();
-    void onSeqEvent(int);
     void closeEvent(QCloseEvent*);
     void onConnect();
     void onReconnect();
@@ -97,6 +97,7 @@ protected slots:
     void showBindingManager();
     void showSplitsWindow();
     void showPerformanceWidget();
+    void showLatencyWindow();
     void showAboutQt();
     void showAbout();
 
@@ -144,6 +145,7 @@ private:
     BindingManagerWindow* m_bindingManagerWindow;
     SplitsWindow* m_splitsWindow;
     PerformanceWindow* m_performanceWindow;
+    LatencyWindow* m_latencyWindow;
 
     QVBoxLayout* m_vbox;
     QStatusBar* m_statusBar;
@@ -0,0 +1,103 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "harmonizer.h"
+#include <algorithm>
+#include <stdlib.h>
+
+Harmonizer::Harmonizer() :
+    m_root(0)
+{
+    std::fill(m_voiceCount, m_voiceCount + 128, 0);
+}
+
+/* Size of a chord interval in steps of the scale. With 7 degrees it is the
+   diatonic size of the interval: unison 0, second 1, third 2, and so on, the
+   tritone counting as a diminished fifth. Other scales use the nearest degree
+   of the scale built on the lowest chord note, the higher one on a tie, so
+   a fifth is 3 steps of a pentatonic scale. */
+int Harmonizer::intervalSteps(int semitones) const {
+    static const int steps[12] = { 0, 1, 1, 2, 2, 3, 4, 4, 5, 5, 6, 6 };
+
+    int size = m_scale.size();
+    int octave = semitones / 12;
+    int pitchClass = semitones % 12;
+
+    if (size == 7) {
+        return octave * 7 + steps[pitchClass];
+    }
+
+    // degree size is the root an octave up
+    int nearest = 0;
+    int distance = 12;
+    for (int degree=0; degree<=size; ++degree) {
+        int tone = degree < size ? m_scale[degree] : 12;
+        if (abs(tone - pitchClass) <= distance) {
+            nearest = degree;
+            distance = abs(tone - pitchClass);
+        }
+    }
+
+    return octave * size + nearest;
+}
+
+/* degree of the scale at or below a pitch class relative to the root */
+int Harmonizer::degreeAt(int pitchClass) const {
+    int degree = m_scale.size() - 1;
+    while (degree > 0 && m_scale[degree] > pitchClass) {
+        --degree;
+    }
+    return degree;
+}
+
+void Harmonizer::rebuild() {
+    std::fill(m_voiceCount, m_voiceCount + 128, 0);
+
+    if (m_scale.empty() || m_chord.empty()) {
+        return;
+    }
+
+    int lowest = *std::min_element(m_chord.begin(), m_chord.end());
+    std::vector<int> chordSteps;
+    for (size_t i=0; i<m_chord.size(); ++i) {
+        chordSteps.push_back(intervalSteps(m_chord[i] - lowest));
+    }
+
+    int size = m_scale.size();
+
+    for (int note=0; note<128; ++note) {
+        int pitchClass = (note - m_root + 120) % 12;
+        int degree = degreeAt(pitchClass);
+        int chromatic = pitchClass - m_scale[degree];
+        int root = note - pitchClass;
+
+        uint8_t* voices = m_voices[note];
+        uint8_t& count = m_voiceCount[note];
+
+        for (size_t i=0; i<chordSteps.size() && count<HARMONIZER_MAX_VOICES; ++i) {
+            int step = degree + chordSteps[i];
+            int voice = root + (step / size) * 12 + m_scale[step % size] + chromatic;
+            if (voice < 0 || voice > 127 || std::find(voices, voices + count, voice) != voices + count) {
+                continue;
+            }
+            voices[count++] = voice;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Diatonic harmonizer. A chord shape is applied to played notes in scale
+   steps instead of semitones, so a third stays a third of the scale: major
+   on some degrees, minor on others. Notes outside the scale are harmonized
+   like the scale note below them, shifted by the same number of semitones.
+
+   The voices of every MIDI note are computed once, by rebuild(), so
+   harmonizing a note is a table lookup.
+*/
+
+#ifndef HARMONIZER_H
+#define HARMONIZER_H
+
+#include <inttypes.h>
+#include <vector>
+
+// maximum number of voices played for one note
+#define HARMONIZER_MAX_VOICES 8
+
+class Harmonizer {
+public:
+    Harmonizer();
+
+    // root note of the scale, 0 (C) to 11 (B)
+    void setRoot(int root) { m_root = root; }
+    // semitones from the root of each scale degree, ascending and below 12
+    void setScale(const std::vector<int>& scale) { m_scale = scale; }
+    // chord shape as MIDI notes. its lowest note is the played note.
+    void setChord(const std::vector<int>& notes) { m_chord = notes; }
+
+    // compute the table after the root, scale or chord changed
+    void rebuild();
+
+    // voices of a note, returns their number
+    int voices(int note, const uint8_t*& notes) const {
+        notes = m_voices[note & 0x7f];
+        return m_voiceCount[note & 0x7f];
+    }
+
+    // number of scale steps of a chord interval in semitones
+    int intervalSteps(int semitones) const;
+
+private:
+    int degreeAt(int pitchClass) const;
+
+    int m_root;
+    std::vector<int> m_scale;
+    std::vector<int> m_chord;
+
+    uint8_t m_voices[128][HARMONIZER_MAX_VOICES];
+    uint8_t m_voiceCount[128];
+};
+
+#endif // HARMONIZER_H
@@ -20,15 +20,13 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 
 #include "keytimegenerator.h"
 #include "fp4qt.h"
-#include "config.h"
 #include <QtWidgets>
 
 KeyTimeGenerator::KeyTimeGenerator(FP4Qt *fp4, int channel, QWidget *parent) :
     ControllerGenerator(fp4, channel, parent)
 {
-    m_timer = new QTimer;
-    m_timer->setTimerType(Qt::PreciseTimer);
-    connect(m_timer, SIGNAL(timeout()), SLOT(onTimer()));
+    m_rampId = m_fp4->allocateControllerRamp();
+    m_scheduleTag = m_fp4->allocateScheduleTag();
 }
 
 QString KeyTimeGenerator::description() const {
@@ -50,7 +48,7 @@ QWidget *KeyTimeGenerator::buildOptionsWidget() {
     layout->addWidget(channelLabel, 0, 0);
     m_outputChannelSpinBox = new QSpinBox;
     m_outputChannelSpinBox->setRange(1, 16);
-    m_outputChannelSpinBox->setValue(m_channel);
+    m_outputChannelSpinBox->setValue(m_channel+1);
     channelLabel->setBuddy(m_outputChannelSpinBox);
     layout->addWidget(m_outputChannelSpinBox, 0, 1);
 
@@ -69,31 +67,21 @@ QWidget *KeyTimeGenerator::buildOptionsWidget() {
     m_timeSlider->setValue(200);
     timeLabel->setBuddy(m_timeSlider);
     layout->addWidget(m_timeSlider, 2, 1);
-    connect(m_timeSlider, SIGNAL(valueChanged(int)), SLOT(updateTimerProperties(int)));
 
     m_configMap["Output Channel"] = m_outputChannelSpinBox;
-    m_configMap["Output Controller"] = m_outputControllerSpinBox;
+    m_configMap["Output Controller Number"] = m_outputControllerSpinBox;
     m_configMap["Time"] = m_timeSlider;
 
     return widget;
 }
 
-void KeyTimeGenerator::updateTimerProperties(int) {
-    if (m_timeSlider->value() == 0) {
-        m_timer->stop();
+/* "Output Controller" held the controller number itself, the spin box now
+   shows it 1-based like the other generators */
+void KeyTimeGenerator::loadLegacySettings(QSettings& settings) {
+    if (settings.contains("Output Controller Number") || !settings.contains("Output Controller")) {
         return;
     }
-
-    int duration = 10.0f * m_timeSlider->value();
-    float timeStep = (float)duration / 127.0f;
-    if (timeStep < MIN_TIMER_INTERVAL) {
-        m_timer->setInterval(MIN_TIMER_INTERVAL);
-        m_timeIncrement = 127.0f / ((float)duration / (float)MIN_TIMER_INTERVAL);
-    }
-    else {
-        m_timer->setInterval(timeStep);
-        m_timeIncrement = 1.0f;
-    }
+    m_outputControllerSpinBox->setValue(settings.value("Output Controller").toInt() + 1);
 }
 
 void KeyTimeGenerator::onNoteOnEvent(int channel, int note, int velocity) {
@@ -104,40 +92,49 @@ void KeyTimeGenerator::onNoteOnEvent(int channel, int note, int velocity) {
         return;
     }
 
-    m_timer->stop();
+    m_fp4->stopControllerRamp(m_rampId);
+    m_fp4->cancelScheduled(m_scheduleTag);
 
     m_outputChannel = m_outputChannelSpinBox->value()-1;
-    m_controller = m_outputControllerSpinBox->value();
-    m_fp4->onController(m_outputChannel-1, m_controller-1, 0);
+    m_controller = m_outputControllerSpinBox->value()-1;
 
     int duration = 10.0f * m_timeSlider->value();
-    float timeStep = (float)duration / 127.0f;
-    if (timeStep < MIN_TIMER_INTERVAL) {
-        m_timer->setInterval(MIN_TIMER_INTERVAL);
-        m_timeIncrement = 127.0f / ((float)duration / (float)MIN_TIMER_INTERVAL);
-    }
-    else {
-        m_timer->setInterval(timeStep);
-        m_timeIncrement = 1.0f;
+
+    // an unbound controller goes straight to the FP4, let ALSA play the ramp
+    if (m_fp4->hasQueue() && !m_fp4->isControllerBound(m_outputChannel, m_controller)) {
+        scheduleRamp(duration);
+        return;
     }
-    m_timeCount = 0.0f;
-    m_timer->start();
+
+    m_fp4->startControllerRamp(m_rampId, m_outputChannel, m_controller, 0, 127, duration);
 }
 
 void KeyTimeGenerator::onEnabledStateChange(bool enabled) {
     if (!enabled) {
-        m_timer->stop();
+        m_fp4->stopControllerRamp(m_rampId);
+        m_fp4->cancelScheduled(m_scheduleTag);
     }
 }
 
-void KeyTimeGenerator::onTimer() {
-    m_timeCount += m_timeIncrement;
-    if (m_timeCount > 127) {
-        m_timeCount = 127;
+/* schedule every step of the ramp at once, starting at 0 now. duration is in
+   ms. The steps don't go through the control rate engine: short ramps skip
+   values themselves to stay under the generated controller rate, but always
+   end at 127. */
+void KeyTimeGenerator::scheduleRamp(int duration) {
+    FP4OutputBatch batch(m_fp4);
+
+    int steps = 127;
+    int rate = m_fp4->generatedControllerRate();
+    if (rate > 0) {
+        steps = qBound(1, duration * rate / 1000, 127);
+        m_fp4->countThinnedControllers(127 - steps);
     }
-    m_fp4->onController(m_outputChannel, m_controller, m_timeCount);
-    if (m_timeCount >= 127) {
-        m_timer->stop();
+
+    // the first value is queued too, so it can't arrive after the next ones
+    for (int step=0; step<=steps; ++step) {
+        int value = (127 * step + steps / 2) / steps;
+        uint64_t usec = (uint64_t)duration * 1000 * step / steps;
+        m_fp4->sendControllerAt(usec, m_outputChannel, m_controller, value, m_scheduleTag);
     }
 }
 
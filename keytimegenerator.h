@@ -26,7 +26,6 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 class FP4Qt;
 class QSpinBox;
 class QSlider;
-class QTimer;
 
 // use the time elapsed since the last note was played as a controller
 class KeyTimeGenerator : public ControllerGenerator {
@@ -37,21 +36,21 @@ public:
     QString configName() const;
 protected:
     QWidget* buildOptionsWidget();
+    void loadLegacySettings(QSettings& settings);
 protected slots:
-    void updateTimerProperties(int);
     void onNoteOnEvent(int channel, int note, int velocity);
     void onEnabledStateChange(bool enabled);
-    void onTimer();
 private:
+    void scheduleRamp(int duration);
+
     QSpinBox* m_outputChannelSpinBox;
     QSpinBox* m_outputControllerSpinBox;
     QSlider* m_timeSlider;
-    QTimer* m_timer;
 
-    float m_timeCount;
-    float m_timeIncrement;
+    int m_rampId;
     int m_outputChannel;
     int m_controller;
+    int m_scheduleTag;
 };
 
 #endif
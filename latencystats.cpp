@@ -0,0 +1,162 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "latencystats.h"
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+/* values below 8 get a bucket each, above that each power of two is split in
+   8 buckets. */
+unsigned LatencyHistogram::bucketIndex(uint64_t usec) {
+    if (usec < 8) {
+        return usec;
+    }
+
+    unsigned log2 = 63 - __builtin_clzll(usec);
+    unsigned index = (log2 - 2) * 8 + ((usec >> (log2 - 3)) & 7);
+    return index < LATENCY_BUCKET_COUNT ? index : LATENCY_BUCKET_COUNT - 1;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(unsigned index) {
+    if (index < 8) {
+        return index;
+    }
+
+    unsigned log2 = index / 8 + 2;
+    uint64_t sub = index % 8;
+    return ((8 + sub + 1) << (log2 - 3)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t usec) {
+    m_buckets[bucketIndex(usec)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (usec > max && !m_max.compare_exchange_weak(max, usec, std::memory_order_relaxed)) {
+    }
+}
+
+/* samples recorded while resetting may be lost. */
+void LatencyHistogram::reset() {
+    for (unsigned i=0; i<LATENCY_BUCKET_COUNT; ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t total = 0;
+    uint32_t counts[LATENCY_BUCKET_COUNT];
+    for (unsigned i=0; i<LATENCY_BUCKET_COUNT; ++i) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned i=0; i<LATENCY_BUCKET_COUNT; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // the bucket bound can't be higher than the largest sample
+            uint64_t bound = bucketUpperBound(i);
+            uint64_t largest = max();
+            return bound < largest ? bound : largest;
+        }
+    }
+
+    return max();
+}
+
+void LatencyStats::reset() {
+    for (int c=0; c<LatencyClassCount; ++c) {
+        for (int s=0; s<LatencyStageCount; ++s) {
+            m_histograms[c][s].reset();
+        }
+    }
+}
+
+const char *LatencyStats::className(int eventClass) {
+    switch (eventClass) {
+    case LatencyNote:
+        return "note";
+    case LatencyController:
+        return "controller";
+    case LatencySysex:
+        return "sysex";
+    default:
+        return "unknown";
+    }
+}
+
+const char *LatencyStats::stageName(int stage) {
+    switch (stage) {
+    case LatencyDirect:
+        return "direct";
+    case LatencyTransform:
+        return "transform";
+    case LatencyGenerator:
+        return "generator";
+    case LatencyBinding:
+        return "binding";
+    default:
+        return "unknown";
+    }
+}
+
+/* Output looks like:
+   { "unit": "us", "histograms": [
+     { "class": "note", "stage": "direct", "count": 10, "p50": 120, "p99": 300, "max": 310 }
+   ] }
+*/
+void LatencyStats::dump(std::ostream &out) const {
+    out << "{ \"unit\": \"us\", \"histograms\": [";
+
+    bool first = true;
+    for (int c=0; c<LatencyClassCount; ++c) {
+        for (int s=0; s<LatencyStageCount; ++s) {
+            const LatencyHistogram& h = m_histograms[c][s];
+            if (h.count() == 0) {
+                continue;
+            }
+
+            out << (first ? "\n" : ",\n");
+            first = false;
+
+            out << "  { \"class\": \"" << className(c) << "\", \"stage\": \"" << stageName(s) << "\""
+                << ", \"count\": " << h.count()
+                << ", \"p50\": " << h.percentile(50)
+                << ", \"p99\": " << h.percentile(99)
+                << ", \"max\": " << h.max() << " }";
+        }
+    }
+
+    out << "\n] }" << std::endl;
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Measure the time between the moment ALSA timestamped an incoming event and
+   the moment the output it caused is submitted to the sequencer.
+
+   Samples are kept in histograms per output event class (note, controller,
+   sysex) and per processing stage (forwarded directly, through a channel
+   transform, by a generator, by a controller binding). Recording is lock
+   free and can be done from any thread.
+
+   Histogram buckets are logarithmic with 8 buckets per power of two, so
+   percentiles have a resolution of 12.5%.
+*/
+
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+#include <atomic>
+#include <ostream>
+#include <inttypes.h>
+
+// 8 buckets per power of two, up to 2^32 us
+#define LATENCY_BUCKET_COUNT 256
+
+enum LatencyEventClass {
+    LatencyNote,
+    LatencyController,
+    LatencySysex,
+
+    LatencyClassCount
+};
+
+// a stage never goes back to an earlier one: output of a generator is
+// counted as generator output even if it passes through a transform.
+enum LatencyStage {
+    LatencyDirect,
+    LatencyTransform,
+    LatencyGenerator,
+    LatencyBinding,
+
+    LatencyStageCount
+};
+
+// input timestamp and stage of the event being processed by a thread
+struct LatencyContext {
+    bool valid;
+    int stage;
+    uint64_t timestamp;     // queue time in us, 0 if unknown
+};
+
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t usec);
+    void reset();
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    // upper bound of the bucket holding the p-th percentile (0-100), in us
+    uint64_t percentile(double p) const;
+
+    static unsigned bucketIndex(uint64_t usec);
+    static uint64_t bucketUpperBound(unsigned index);
+
+private:
+    std::atomic<uint32_t> m_buckets[LATENCY_BUCKET_COUNT];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_max;
+};
+
+class LatencyStats {
+public:
+    LatencyHistogram& histogram(int eventClass, int stage) { return m_histograms[eventClass][stage]; }
+    const LatencyHistogram& histogram(int eventClass, int stage) const { return m_histograms[eventClass][stage]; }
+
+    void record(int eventClass, int stage, uint64_t usec) { m_histograms[eventClass][stage].record(usec); }
+    void reset();
+
+    // write every histogram with samples as JSON
+    void dump(std::ostream& out) const;
+
+    static const char* className(int eventClass);
+    static const char* stageName(int stage);
+
+private:
+    LatencyHistogram m_histograms[LatencyClassCount][LatencyStageCount];
+};
+
+#endif // LATENCYSTATS_H
@@ -0,0 +1,171 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "latencywindow.h"
+#include "fp4qt.h"
+#include <QtWidgets>
+#include <sstream>
+
+// refresh interval of the table while the window is visible, in ms
+#define LATENCY_REFRESH_INTERVAL 1000
+
+LatencyWindow::LatencyWindow(FP4Qt *fp4, QWidget *parent) :
+    Window("latency-stats", parent),
+    m_fp4(fp4)
+{
+    setTitle("Latency statistics");
+
+    QVBoxLayout* vbox = new QVBoxLayout;
+    setLayout(vbox);
+
+    QLabel* desc = new QLabel("Time between the moment an incoming event was received and the moment the "
+                              "output it caused was sent, in microseconds.");
+    desc->setWordWrap(true);
+    vbox->addWidget(desc);
+
+    if (!m_fp4->hasInputTimestamps()) {
+        QLabel* warning = new QLabel("Input events are not timestamped by ALSA, no latency is measured.");
+        warning->setWordWrap(true);
+        vbox->addWidget(warning);
+    }
+
+    m_table = new QTableWidget(LatencyClassCount * LatencyStageCount, 4);
+    m_table->setHorizontalHeaderLabels(QStringList() << "Count" << "p50" << "p99" << "Max");
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->setSelectionMode(QAbstractItemView::NoSelection);
+
+    QStringList rowLabels;
+    for (int c=0; c<LatencyClassCount; ++c) {
+        for (int s=0; s<LatencyStageCount; ++s) {
+            rowLabels << QString("%1 / %2").arg(LatencyStats::className(c)).arg(LatencyStats::stageName(s));
+
+            for (int column=0; column<4; ++column) {
+                QTableWidgetItem* item = new QTableWidgetItem;
+                item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+                m_table->setItem(c * LatencyStageCount + s, column, item);
+            }
+        }
+    }
+    m_table->setVerticalHeaderLabels(rowLabels);
+    vbox->addWidget(m_table);
+
+    // generator output that was thinned out before reaching the FP4
+    m_controllerStatsLabel = new QLabel;
+    m_controllerStatsLabel->setWordWrap(true);
+    vbox->addWidget(m_controllerStatsLabel);
+
+    // sysex messages held back by the pacer, their wait is not in the table
+    m_sysexStatsLabel = new QLabel;
+    m_sysexStatsLabel->setWordWrap(true);
+    vbox->addWidget(m_sysexStatsLabel);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox;
+    QPushButton* resetButton = buttonBox->addButton("&Reset", QDialogButtonBox::ResetRole);
+    QPushButton* exportButton = buttonBox->addButton("&Export...", QDialogButtonBox::ActionRole);
+    vbox->addWidget(buttonBox);
+
+    connect(resetButton, SIGNAL(clicked()), this, SLOT(resetPressed()));
+    connect(exportButton, SIGNAL(clicked()), this, SLOT(exportPressed()));
+
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setInterval(LATENCY_REFRESH_INTERVAL);
+    connect(m_refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+}
+
+/* only refresh while visible */
+void LatencyWindow::showEvent(QShowEvent *event) {
+    Window::showEvent(event);
+    refresh();
+    m_refreshTimer->start();
+}
+
+void LatencyWindow::hideEvent(QHideEvent *event) {
+    m_refreshTimer->stop();
+    Window::hideEvent(event);
+}
+
+void LatencyWindow::refresh() {
+    const LatencyStats& stats = m_fp4->latencyStats();
+
+    for (int c=0; c<LatencyClassCount; ++c) {
+        for (int s=0; s<LatencyStageCount; ++s) {
+            const LatencyHistogram& histogram = stats.histogram(c, s);
+            int row = c * LatencyStageCount + s;
+
+            if (histogram.count() == 0) {
+                for (int column=0; column<4; ++column) {
+                    m_table->item(row, column)->setText("-");
+                }
+                continue;
+            }
+
+            m_table->item(row, 0)->setText(QString::number(histogram.count()));
+            m_table->item(row, 1)->setText(QString::number(histogram.percentile(50)));
+            m_table->item(row, 2)->setText(QString::number(histogram.percentile(99)));
+            m_table->item(row, 3)->setText(QString::number(histogram.max()));
+        }
+    }
+
+    ControlRateStats controllers = m_fp4->generatedControllerStats();
+    m_controllerStatsLabel->setText(QString("Generated controllers: %1 sent, %2 saved "
+                                            "(%3 unchanged, %4 over the rate limit).")
+                                    .arg(controllers.sent)
+                                    .arg(controllers.unchanged + controllers.limited)
+                                    .arg(controllers.unchanged)
+                                    .arg(controllers.limited));
+
+    SysexPacerStats sysex = m_fp4->outputStats();
+    m_sysexStatsLabel->setText(QString("Sysex: %1 messages (%2 bytes) sent, %3 delayed by pacing "
+                                       "(average %4 us, max %5 us), %6 sent unpaced. "
+                                       "Queue: %7 waiting, at most %8.")
+                               .arg(sysex.messages)
+                               .arg(sysex.bytes)
+                               .arg(sysex.delayedMessages)
+                               .arg(sysex.delayedMessages ? sysex.totalDelay / sysex.delayedMessages : 0)
+                               .arg(sysex.maxDelay)
+                               .arg(sysex.overflows)
+                               .arg(sysex.queueDepth)
+                               .arg(sysex.maxQueueDepth));
+}
+
+void LatencyWindow::resetPressed() {
+    m_fp4->latencyStats().reset();
+    m_fp4->resetGeneratedControllerStats();
+    m_fp4->resetOutputStats();
+    refresh();
+}
+
+void LatencyWindow::exportPressed() {
+    QString fileName = QFileDialog::getSaveFileName(this, "Export latency statistics", QString(), "JSON files (*.json)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    std::ostringstream out;
+    m_fp4->latencyStats().dump(out);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        QMessageBox::warning(this, "Export failed", QString("Cannot write %1").arg(fileName));
+        return;
+    }
+
+    file.write(out.str().c_str());
+}
@@ -0,0 +1,59 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Display input to output latency percentiles per event class and stage,
+   and export them as JSON. Also shows how much generator output was
+   thinned out, and how long paced sysex messages waited. */
+
+#ifndef LATENCYWINDOW_H
+#define LATENCYWINDOW_H
+
+#include "window.h"
+
+class FP4Qt;
+class QLabel;
+class QTableWidget;
+class QTimer;
+
+class LatencyWindow : public Window
+{
+    Q_OBJECT
+public:
+    explicit LatencyWindow(FP4Qt* fp4, QWidget *parent = 0);
+
+protected:
+    void showEvent(QShowEvent* event);
+    void hideEvent(QHideEvent* event);
+
+protected slots:
+    void refresh();
+    void resetPressed();
+    void exportPressed();
+
+private:
+    FP4Qt* m_fp4;
+
+    QTableWidget* m_table;
+    QLabel* m_controllerStatsLabel;
+    QLabel* m_sysexStatsLabel;
+    QTimer* m_refreshTimer;
+};
+
+#endif // LATENCYWINDOW_H
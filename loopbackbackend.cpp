@@ -0,0 +1,303 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "loopbackbackend.h"
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+LoopbackBackend::LoopbackBackend() {
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+}
+
+LoopbackBackend::~LoopbackBackend() {
+    if (m_timerFd >= 0) {
+        ::close(m_timerFd);
+    }
+}
+
+uint64_t LoopbackBackend::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* copy an event and the sysex data it points to */
+void LoopbackBackend::copyEvent(LoopbackEvent &to, const snd_seq_event_t *ev, uint64_t time) {
+    to.time = time;
+    to.event = *ev;
+    to.data.clear();
+
+    // the pointer would not survive copies of the LoopbackEvent, use data
+    if (snd_seq_ev_is_variable(ev)) {
+        const uint8_t* data = (const uint8_t*)ev->data.ext.ptr;
+        to.data.assign(data, data + ev->data.ext.len);
+        to.event.data.ext.ptr = 0;
+    }
+}
+
+/* events are kept sorted by time, events with the same time in the order
+   they were added. */
+static void insertByTime(std::deque<LoopbackEvent>& events, const LoopbackEvent& event) {
+    std::deque<LoopbackEvent>::iterator it = events.end();
+    while (it != events.begin() && (it - 1)->time > event.time) {
+        --it;
+    }
+    events.insert(it, event);
+}
+
+/* Events scheduled in real time on the emulated queue are due at their
+   absolute time, or at time after they are written if it is relative. */
+static bool isScheduled(const snd_seq_event_t* ev) {
+    return ev->queue == LOOPBACK_QUEUE
+            && (ev->flags & SND_SEQ_TIME_STAMP_MASK) == SND_SEQ_TIME_STAMP_REAL;
+}
+
+int LoopbackBackend::output(snd_seq_event_t *ev, bool buffered) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // like the sequencer, stamp the sender
+    LoopbackEvent event;
+    copyEvent(event, ev, now());
+    event.event.source.client = LOOPBACK_CLIENT;
+
+    if (buffered) {
+        m_buffered.push_back(event);
+    }
+    else if (isScheduled(ev)) {
+        schedule(event, event.time);
+    }
+    else {
+        m_output.push_back(event);
+    }
+    return 0;
+}
+
+int LoopbackBackend::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint64_t time = now();
+    for (size_t i=0; i<m_buffered.size(); ++i) {
+        m_buffered[i].time = time;
+        if (isScheduled(&m_buffered[i].event)) {
+            schedule(m_buffered[i], time);
+        }
+        else {
+            m_output.push_back(m_buffered[i]);
+        }
+    }
+    m_buffered.clear();
+
+    deliverDue(time);
+    return 0;
+}
+
+/* insert an event in the emulated queue, with an absolute real time. Called
+   with m_mutex held. */
+void LoopbackBackend::schedule(const LoopbackEvent &event, uint64_t now) {
+    LoopbackEvent scheduled = event;
+    const snd_seq_real_time_t& t = event.event.time.time;
+    scheduled.time = (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+    if (event.event.flags & SND_SEQ_TIME_MODE_MASK) {
+        scheduled.time += now;
+    }
+
+    scheduled.event.flags &= ~SND_SEQ_TIME_MODE_MASK;
+    scheduled.event.time.time.tv_sec = scheduled.time / 1000000;
+    scheduled.event.time.time.tv_nsec = (scheduled.time % 1000000) * 1000;
+
+    insertByTime(m_scheduled, scheduled);
+    rearm();
+}
+
+/* move scheduled events that are due to the input, or to the output if they
+   aren't addressed to this client. Called with m_mutex held. */
+void LoopbackBackend::deliverDue(uint64_t now) {
+    bool delivered = false;
+    while (!m_scheduled.empty() && m_scheduled.front().time <= now) {
+        LoopbackEvent& event = m_scheduled.front();
+        if (event.event.dest.client == LOOPBACK_CLIENT) {
+            insertByTime(m_input, event);
+        }
+        else {
+            m_output.push_back(event);
+        }
+        m_scheduled.pop_front();
+        delivered = true;
+    }
+
+    if (delivered) {
+        rearm();
+    }
+}
+
+/* remove the scheduled events with tag that are not due yet */
+int LoopbackBackend::removeScheduled(int queue, int tag) {
+    if (queue != LOOPBACK_QUEUE) {
+        return -EINVAL;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    deliverDue(now());
+
+    std::deque<LoopbackEvent>::iterator it = m_scheduled.begin();
+    while (it != m_scheduled.end()) {
+        if (it->event.tag == tag) {
+            it = m_scheduled.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    rearm();
+    return 0;
+}
+
+/* only called by the reading thread, so m_current can be handed out */
+int LoopbackBackend::input(snd_seq_event_t **ev) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint64_t expirations;
+    ssize_t r = ::read(m_timerFd, &expirations, sizeof(expirations));
+    (void)r;
+
+    deliverDue(now());
+    if (m_input.empty() || m_input.front().time > now()) {
+        rearm();
+        return -EAGAIN;
+    }
+
+    m_current = m_input.front();
+    m_input.pop_front();
+    if (snd_seq_ev_is_variable(&m_current.event)) {
+        m_current.event.data.ext.ptr = m_current.data.data();
+    }
+
+    rearm();
+
+    *ev = &m_current.event;
+    return 0;
+}
+
+bool LoopbackBackend::inputPending() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    deliverDue(now());
+    return !m_input.empty() && m_input.front().time <= now();
+}
+
+int LoopbackBackend::pollDescriptors(struct pollfd *pfds, int space) {
+    if (space < 1 || m_timerFd < 0) {
+        return 0;
+    }
+
+    pfds[0].fd = m_timerFd;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    return 1;
+}
+
+/* make the timer fire when the first input or scheduled event is due.
+   Called with m_mutex held. */
+void LoopbackBackend::rearm() {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+
+    if (!m_input.empty() || !m_scheduled.empty()) {
+        uint64_t due = UINT64_MAX;
+        if (!m_input.empty()) {
+            due = m_input.front().time;
+        }
+        if (!m_scheduled.empty() && m_scheduled.front().time < due) {
+            due = m_scheduled.front().time;
+        }
+
+        // an absolute time in the past fires at once, but 0 disarms
+        due = due ? due : 1;
+        spec.it_value.tv_sec = due / 1000000;
+        spec.it_value.tv_nsec = (due % 1000000) * 1000;
+    }
+
+    timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, 0);
+}
+
+void LoopbackBackend::inject(const snd_seq_event_t *ev, uint64_t time) {
+    LoopbackEvent event;
+    copyEvent(event, ev, time ? time : now());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    insertByTime(m_input, event);
+    rearm();
+}
+
+void LoopbackBackend::injectNoteOn(int channel, int note, int velocity, uint64_t time) {
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_noteon(&ev, channel, note, velocity);
+    inject(&ev, time);
+}
+
+void LoopbackBackend::injectNoteOff(int channel, int note, uint64_t time) {
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_noteoff(&ev, channel, note, 0);
+    inject(&ev, time);
+}
+
+void LoopbackBackend::injectController(int channel, int cc, int value, uint64_t time) {
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_controller(&ev, channel, cc, value);
+    inject(&ev, time);
+}
+
+void LoopbackBackend::injectSysex(const uint8_t *data, unsigned length, uint64_t time) {
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_sysex(&ev, length, (void*)data);
+    inject(&ev, time);
+}
+
+size_t LoopbackBackend::pendingInputCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_input.size();
+}
+
+std::vector<LoopbackEvent> LoopbackBackend::takeOutput() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    deliverDue(now());
+
+    std::vector<LoopbackEvent> output;
+    output.swap(m_output);
+    return output;
+}
+
+size_t LoopbackBackend::outputCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    deliverDue(now());
+    return m_output.size();
+}
+
+size_t LoopbackBackend::scheduledCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_scheduled.size();
+}
@@ -0,0 +1,107 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* In-memory backend that replaces the MIDI device, so the event pipeline
+   can run without a sequencer or hardware.
+
+   Input is scripted: injected events become readable at a given monotonic
+   time (now by default). Output is captured with the time it was sent,
+   which is the flush time for buffered events. A timerfd becomes readable
+   when the next scripted event is due, so MidiThread wakes up for it.
+
+   The output queue is emulated: events scheduled in real time on
+   LOOPBACK_QUEUE are held until they are due. Then they are captured, or
+   come back as input if they are addressed to LOOPBACK_CLIENT. Events
+   scheduled in ticks are captured at once.
+
+   Injection and capture can be used from any thread.
+*/
+
+#ifndef LOOPBACKBACKEND_H
+#define LOOPBACKBACKEND_H
+
+#include "midibackend.h"
+#include <inttypes.h>
+#include <deque>
+#include <vector>
+#include <mutex>
+
+#define LOOPBACK_QUEUE 0
+#define LOOPBACK_CLIENT 128
+
+// an event with its own copy of sysex data. event.data.ext.ptr is not valid,
+// use data.
+struct LoopbackEvent {
+    uint64_t time;      // monotonic time in us
+    snd_seq_event_t event;
+    std::vector<uint8_t> data;
+};
+
+class LoopbackBackend : public MidiBackend {
+public:
+    LoopbackBackend();
+    ~LoopbackBackend();
+
+    const char* name() const { return "loopback"; }
+
+    int output(snd_seq_event_t* ev, bool buffered);
+    int flush();
+    int input(snd_seq_event_t** ev);
+    bool inputPending();
+    int pollDescriptors(struct pollfd* pfds, int space);
+    int removeScheduled(int queue, int tag);
+    int queue() const { return LOOPBACK_QUEUE; }
+    int client() const { return LOOPBACK_CLIENT; }
+
+    // scripted input. time is monotonic, in us. 0 means now.
+    void inject(const snd_seq_event_t* ev, uint64_t time=0);
+    void injectNoteOn(int channel, int note, int velocity, uint64_t time=0);
+    void injectNoteOff(int channel, int note, uint64_t time=0);
+    void injectController(int channel, int cc, int value, uint64_t time=0);
+    void injectSysex(const uint8_t* data, unsigned length, uint64_t time=0);
+    size_t pendingInputCount() const;
+
+    // captured output
+    std::vector<LoopbackEvent> takeOutput();
+    size_t outputCount();
+    size_t scheduledCount() const;
+
+    static uint64_t now();
+
+private:
+    static void copyEvent(LoopbackEvent& to, const snd_seq_event_t* ev, uint64_t time);
+    void rearm();
+    void schedule(const LoopbackEvent& event, uint64_t now);
+    void deliverDue(uint64_t now);
+
+    mutable std::mutex m_mutex;
+    int m_timerFd;
+
+    std::deque<LoopbackEvent> m_input;
+    LoopbackEvent m_current;
+
+    std::vector<LoopbackEvent> m_buffered;
+    std::vector<LoopbackEvent> m_output;
+
+    // scheduled events by due time
+    std::deque<LoopbackEvent> m_scheduled;
+};
+
+#endif // LOOPBACKBACKEND_H
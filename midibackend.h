@@ -0,0 +1,84 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Transport used by FP4 to exchange events with the MIDI device.
+
+   Events are ALSA sequencer events whatever the backend. Backends only move
+   them: connections, ports and queues are managed by FP4 on the sequencer
+   when there is one. A backend without a sequencer may emulate its output
+   queue, see queue().
+
+   Backends are used by one reader thread, output is serialized by FP4.
+*/
+
+#ifndef MIDIBACKEND_H
+#define MIDIBACKEND_H
+
+#include <alsa/asoundlib.h>
+#include <poll.h>
+
+class MidiBackend {
+public:
+    virtual ~MidiBackend() {}
+
+    // short name for diagnostics
+    virtual const char* name() const = 0;
+
+    // (re)open the device for backends that talk to it directly. returns
+    // true if the backend can be used.
+    virtual bool connect() { return true; }
+
+    // send an event, or keep it until flush() if buffered is set.
+    // returns < 0 on failure.
+    virtual int output(snd_seq_event_t* ev, bool buffered) = 0;
+
+    // send buffered events. returns the number of bytes that could not be
+    // sent yet, or < 0 on failure.
+    virtual int flush() = 0;
+
+    // get the next input event. returns -EAGAIN if there is none. The event
+    // stays valid until the next call.
+    virtual int input(snd_seq_event_t** ev) = 0;
+
+    // true if input() has an event ready without reading from the device
+    virtual bool inputPending() = 0;
+
+    // fill pfds with up to space descriptors that become readable when there
+    // is input. returns the number of descriptors.
+    virtual int pollDescriptors(struct pollfd* pfds, int space) = 0;
+
+    // fill pfds with up to space descriptors that become writable when output
+    // the device didn't take yet can be flushed. returns 0 when no output is
+    // waiting.
+    virtual int outputPollDescriptors(struct pollfd* pfds, int space) { (void)pfds; (void)space; return 0; }
+
+    // remove events with tag that were scheduled on queue and are not
+    // delivered yet. returns < 0 on failure.
+    virtual int removeScheduled(int queue, int tag) { (void)queue; (void)tag; return 0; }
+
+    // Used by FP4 when there is no sequencer. A backend that emulates the
+    // output queue returns its id, events scheduled on it in real time are
+    // delivered when they are due. Queue time is monotonic time. Scheduled
+    // events addressed to client() come back as input.
+    virtual int queue() const { return -1; }
+    virtual int client() const { return -1; }
+};
+
+#endif // MIDIBACKEND_H
@@ -58,15 +58,13 @@ void MidiBindButton::showLearnDialog() {
     int ret=dlg->exec();
 
     if (ret == QDialog::Accepted) {
-        m_fp4->updateControllerBinding(m_target, dlg->channel(), dlg->cc());
+        m_fp4->updateControllerBinding(m_target, dlg->controller());
     }
 }
 
 MidiBindDialog::MidiBindDialog(FP4Qt *fp4, QWidget *target, QWidget *parent) :
     QDialog(parent),
     m_fp4(fp4),
-    m_channel(-1),
-    m_cc(-1),
     m_target(target)
 {
     Q_ASSERT(!target->property("cc_group").isNull());
@@ -103,7 +101,7 @@ MidiBindDialog::MidiBindDialog(FP4Qt *fp4, QWidget *target, QWidget *parent) :
         vbox->addStretch(1);
         QLabel* currentLabel = new QLabel(QString(
             "This widget is currently bound to controller #%2 on channel %1. Pressing Delete will remove the current "
-            "bind and not assign a new one. Pressing Edit will display a binding configuration dialog. Pressing OK will replace the current binding.").arg(currentCC.channel+1).arg(currentCC.cc));
+            "bind and not assign a new one. Pressing Edit will display a binding configuration dialog. Pressing OK will replace the current binding.").arg(currentCC.channel+1).arg(currentCC.description()));
         currentLabel->setWordWrap(true);
         vbox->addWidget(currentLabel);
     }
@@ -130,6 +128,9 @@ MidiBindDialog::MidiBindDialog(FP4Qt *fp4, QWidget *target, QWidget *parent) :
     resize(sizeHint());
 
     connect(fp4, SIGNAL(ccReceived(int,int,int)), SLOT(onCCEvent(int,int,int)));
+    connect(fp4, SIGNAL(hiresControllerReceived(int,int,int)), SLOT(onHiresControllerEvent(int,int,int)));
+    connect(fp4, SIGNAL(rpnReceived(int,int,int)), SLOT(onRPNEvent(int,int,int)));
+    connect(fp4, SIGNAL(nrpnReceived(int,int,int)), SLOT(onNRPNEvent(int,int,int)));
 }
 
 void MidiBindDialog::onCCEvent(int ch, int cc, int val) {
@@ -142,10 +143,32 @@ void MidiBindDialog::onCCEvent(int ch, int cc, int val) {
         return;
     }
 
-    m_controllerLabel->setText(QString("Controller #%2 on channel %1.").arg(ch+1).arg(cc));
+    // once a high resolution controller is seen, its parts are not learned
+    // separately
+    if (m_controller.isHires() && m_controller.includesController(ch, cc)) {
+        return;
+    }
+
+    learn(ControllerInfo(ch, cc), val);
+}
+
+void MidiBindDialog::onHiresControllerEvent(int ch, int cc, int val) {
+    learn(ControllerInfo(ch, cc, ControllerInfo::CC14Type), val);
+}
+
+void MidiBindDialog::onRPNEvent(int ch, int parameter, int val) {
+    learn(ControllerInfo(ch, parameter, ControllerInfo::RPNType), val);
+}
+
+void MidiBindDialog::onNRPNEvent(int ch, int parameter, int val) {
+    learn(ControllerInfo(ch, parameter, ControllerInfo::NRPNType), val);
+}
+
+void MidiBindDialog::learn(const ControllerInfo &controller, int val) {
+    m_controllerLabel->setText(QString("Controller #%2 on channel %1.").arg(controller.channel+1).arg(controller.description()));
+    m_controllerSlider->setRange(0, controller.maximum());
     m_controllerSlider->setValue(val);
-    m_channel=ch;
-    m_cc=cc;
+    m_controller = controller;
     m_okButton->setDisabled(false);
     m_okButton->setFocus();
 }
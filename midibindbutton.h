@@ -30,6 +30,7 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 
 #include <QPushButton>
 #include <QDialog>
+#include "fp4qt.h"
 
 class QLabel;
 class QSlider;
@@ -64,11 +65,15 @@ class MidiBindDialog : public QDialog {
 public:
     explicit MidiBindDialog(FP4Qt *fp4, QWidget *target, QWidget *parent);
 
-    int channel() const { return m_channel; }
-    int cc() const { return m_cc; }
+    int channel() const { return m_controller.channel; }
+    int cc() const { return m_controller.cc; }
+    const ControllerInfo& controller() const { return m_controller; }
 
 protected slots:
     void onCCEvent(int ch, int cc, int val);
+    void onHiresControllerEvent(int ch, int cc, int val);
+    void onRPNEvent(int ch, int parameter, int val);
+    void onNRPNEvent(int ch, int parameter, int val);
     void editBinding();
     void deleteBinding();
 
@@ -79,9 +84,10 @@ private:
     QLabel* m_controllerLabel;
     QSlider* m_controllerSlider;
 
+    void learn(const ControllerInfo& controller, int val);
+
     FP4Qt* m_fp4;
-    int m_channel;
-    int m_cc;
+    ControllerInfo m_controller;
     QWidget* m_target;
 };
 
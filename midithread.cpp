@@ -0,0 +1,186 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "midithread.h"
+#include "fp4qt.h"
+#include <QDebug>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+// maximum number of backend poll descriptors we listen to
+#define MAX_SEQ_POLL_DESCRIPTORS 8
+#define MAX_OUTPUT_POLL_DESCRIPTORS 4
+
+MidiThread::MidiThread(FP4Qt *fp4, QObject *parent) :
+    QThread(parent),
+    m_fp4(fp4),
+    m_realtime(false),
+    m_priority(DEFAULT_PRIORITY),
+    m_stop(false),
+    m_refreshInput(false)
+{
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd < 0) {
+        qDebug() << "MidiThread: cannot create wakeup eventfd:" << strerror(errno);
+    }
+}
+
+MidiThread::~MidiThread() {
+    stop();
+
+    if (m_wakeFd >= 0) {
+        ::close(m_wakeFd);
+    }
+}
+
+void MidiThread::setRealtime(bool realtime, int priority) {
+    m_realtime = realtime;
+    m_priority = priority;
+}
+
+/* interrupt poll() in the thread. This is safe to call from any thread. */
+void MidiThread::wakeUp() {
+    if (m_wakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t r = ::write(m_wakeFd, &one, sizeof(one));
+        Q_UNUSED(r);
+    }
+}
+
+/* A reconnected backend may have opened new descriptors, the old ones are
+   closed. Safe to call from any thread. */
+void MidiThread::refreshInputDescriptors() {
+    m_refreshInput = true;
+    wakeUp();
+}
+
+void MidiThread::stop() {
+    if (!isRunning()) {
+        return;
+    }
+
+    m_stop = true;
+    wakeUp();
+    wait();
+    m_stop = false;
+}
+
+/* try to switch to SCHED_FIFO. This usually requires an rtprio limit in
+   /etc/security/limits.conf, so failure is not fatal. */
+void MidiThread::applyRealtimePriority() {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = m_priority;
+
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err) {
+        qDebug() << "MidiThread: cannot set SCHED_FIFO priority" << m_priority << ":" << strerror(err);
+    }
+}
+
+/* fill pfds with the input descriptors of the backend, followed by the
+   wakeup eventfd and the control rate timer. Returns the number of input
+   descriptors. */
+int MidiThread::setupPollDescriptors(struct pollfd *pfds) {
+    int seqFdCount = m_fp4->backend()->pollDescriptors(pfds, MAX_SEQ_POLL_DESCRIPTORS);
+    if (seqFdCount < 0) {
+        seqFdCount = 0;
+    }
+
+    pfds[seqFdCount].fd = m_wakeFd;
+    pfds[seqFdCount].events = POLLIN;
+
+    // ramps of controller generators
+    pfds[seqFdCount + 1].fd = m_fp4->controlRateFd();
+    pfds[seqFdCount + 1].events = POLLIN;
+
+    return seqFdCount;
+}
+
+void MidiThread::run() {
+    if (m_realtime) {
+        applyRealtimePriority();
+    }
+
+    struct pollfd pfds[MAX_SEQ_POLL_DESCRIPTORS + 2 + MAX_OUTPUT_POLL_DESCRIPTORS];
+    m_refreshInput = false;
+    int seqFdCount = setupPollDescriptors(pfds);
+
+    while (!m_stop) {
+        if (m_refreshInput.exchange(false)) {
+            seqFdCount = setupPollDescriptors(pfds);
+        }
+
+        // wake up when output the device didn't take can be written
+        struct pollfd* outputPfds = pfds + seqFdCount + 2;
+        int outputFdCount = m_fp4->outputPollDescriptors(outputPfds, MAX_OUTPUT_POLL_DESCRIPTORS);
+        if (outputFdCount < 0) {
+            outputFdCount = 0;
+        }
+
+        // wake up when the next paced sysex message is due
+        int r = poll(pfds, seqFdCount + 2 + outputFdCount, m_fp4->outputQueueTimeout());
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qDebug() << "MidiThread: poll failed:" << strerror(errno);
+            break;
+        }
+
+        // stop polling descriptors of a device that went away
+        for (int i=0; i<seqFdCount; ++i) {
+            if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                pfds[i].fd = -1;
+            }
+        }
+
+        if (pfds[seqFdCount].revents & POLLIN) {
+            uint64_t count;
+            ssize_t rd = ::read(m_wakeFd, &count, sizeof(count));
+            Q_UNUSED(rd);
+        }
+
+        if (m_stop) {
+            break;
+        }
+
+        // events injected by other threads are handled first, they were
+        // generated before anything that is still in the sequencer fifo
+        m_fp4->processInjectedEvents();
+        m_fp4->processEvents();
+        if (pfds[seqFdCount + 1].revents & POLLIN) {
+            m_fp4->processControlRate();
+        }
+        m_fp4->processOutputQueue();
+
+        for (int i=0; i<outputFdCount; ++i) {
+            if (outputPfds[i].revents & POLLOUT) {
+                m_fp4->flushOutput();
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,77 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Read, route and send MIDI events outside of the GUI thread, so note
+   forwarding does not depend on what the user interface is doing.
+
+   The thread waits on the poll descriptors of the MIDI backend and on a wakeup
+   eventfd. The wakeup is used to stop the thread and to process events that
+   other threads injected in the FP4Qt pipeline, and to poll the descriptors
+   of a backend that reconnected. The poll timeout is used to
+   send paced sysex output when it is due. The control rate timerfd of FP4Qt
+   runs the controller ramps of generators.
+*/
+
+#ifndef MIDITHREAD_H
+#define MIDITHREAD_H
+
+#include <QThread>
+#include <atomic>
+
+class FP4Qt;
+
+class MidiThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit MidiThread(FP4Qt* fp4, QObject* parent=0);
+    ~MidiThread();
+
+    // request SCHED_FIFO scheduling. must be called before start().
+    void setRealtime(bool realtime, int priority=DEFAULT_PRIORITY);
+    bool isRealtime() const { return m_realtime; }
+
+    // wake the thread up from another thread
+    void wakeUp();
+
+    // poll the input descriptors of the backend again, after it reconnected
+    void refreshInputDescriptors();
+
+    // stop the thread and wait for it to finish
+    void stop();
+
+    static const int DEFAULT_PRIORITY = 70;
+
+protected:
+    void run();
+
+private:
+    void applyRealtimePriority();
+    int setupPollDescriptors(struct pollfd* pfds);
+
+    FP4Qt* m_fp4;
+    int m_wakeFd;
+    bool m_realtime;
+    int m_priority;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_refreshInput;
+};
+
+#endif // MIDITHREAD_H
@@ -0,0 +1,142 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Count how many times each source holds every note of every channel. A note
+   keeps sounding until every source that pressed it released it, so sources
+   that play the same note don't cut each other off.
+
+   Besides the counts, a bit mask of held notes is kept per source and
+   channel, and one of sounding notes per channel, so the notes to release
+   are found a 64-bit word at a time instead of checking every note.
+
+   Not thread safe.
+*/
+
+#ifndef NOTETRACKER_H
+#define NOTETRACKER_H
+
+#include <inttypes.h>
+#include <string.h>
+
+template<int SourceCount>
+class NoteTracker {
+public:
+    NoteTracker() { clear(); }
+
+    /* add a hold of source on a note. Return the number of holds of all
+       sources the note had before. */
+    int press(int source, int channel, int note) {
+        int total = m_totals[channel][note];
+        uint8_t& count = m_counts[source][channel][note];
+        if (count == 255) {
+            return total;
+        }
+
+        ++count;
+        ++m_totals[channel][note];
+        m_held[source][channel][note>>6] |= bit(note);
+        m_sounding[channel][note>>6] |= bit(note);
+        return total;
+    }
+
+    /* remove a hold of source on a note. Return the number of holds of all
+       sources left, or -1 if the source didn't hold the note. */
+    int release(int source, int channel, int note) {
+        uint8_t& count = m_counts[source][channel][note];
+        if (count == 0) {
+            return -1;
+        }
+
+        if (--count == 0) {
+            m_held[source][channel][note>>6] &= ~bit(note);
+        }
+        if (--m_totals[channel][note] == 0) {
+            m_sounding[channel][note>>6] &= ~bit(note);
+        }
+        return m_totals[channel][note];
+    }
+
+    /* remove every hold of source on a channel. f(note, count) is called for
+       every note the source held, with the number of holds removed. */
+    template<typename F>
+    void releaseAll(int source, int channel, F f) {
+        for (int word=0; word<2; ++word) {
+            uint64_t held = m_held[source][channel][word];
+            m_held[source][channel][word] = 0;
+
+            while (held) {
+                int note = word*64 + __builtin_ctzll(held);
+                held &= held - 1;
+
+                int count = m_counts[source][channel][note];
+                m_counts[source][channel][note] = 0;
+                m_totals[channel][note] -= count;
+                if (m_totals[channel][note] == 0) {
+                    m_sounding[channel][note>>6] &= ~bit(note);
+                }
+                f(note, count);
+            }
+        }
+    }
+
+    /* remove every hold on a channel. f(note) is called for every note that
+       was sounding. */
+    template<typename F>
+    void releaseChannel(int channel, F f) {
+        for (int word=0; word<2; ++word) {
+            uint64_t sounding = m_sounding[channel][word];
+            m_sounding[channel][word] = 0;
+
+            while (sounding) {
+                int note = word*64 + __builtin_ctzll(sounding);
+                sounding &= sounding - 1;
+                f(note);
+            }
+        }
+
+        for (int source=0; source<SourceCount; ++source) {
+            memset(m_counts[source][channel], 0, sizeof(m_counts[source][channel]));
+            memset(m_held[source][channel], 0, sizeof(m_held[source][channel]));
+        }
+        memset(m_totals[channel], 0, sizeof(m_totals[channel]));
+    }
+
+    int count(int source, int channel, int note) const { return m_counts[source][channel][note]; }
+    int holds(int channel, int note) const { return m_totals[channel][note]; }
+    bool isHeld(int source, int channel, int note) const { return m_held[source][channel][note>>6] & bit(note); }
+    bool isSounding(int channel, int note) const { return m_sounding[channel][note>>6] & bit(note); }
+
+    void clear() {
+        memset(m_counts, 0, sizeof(m_counts));
+        memset(m_totals, 0, sizeof(m_totals));
+        memset(m_held, 0, sizeof(m_held));
+        memset(m_sounding, 0, sizeof(m_sounding));
+    }
+
+private:
+    static uint64_t bit(int note) { return (uint64_t)1 << (note & 63); }
+
+    uint8_t m_counts[SourceCount][16][128];
+    uint16_t m_totals[16][128];
+    uint64_t m_held[SourceCount][16][2];
+    uint64_t m_sounding[16][2];
+};
+
+#endif // NOTETRACKER_H
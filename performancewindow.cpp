@@ -20,6 +20,7 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 
 #include "performancewindow.h"
 #include "fp4win.h"
+#include "fp4qt.h"
 #include "midibindbutton.h"
 #include "config.h"
 #include "fp4managerapplication.h"
@@ -1542,6 +1543,11 @@ PerformanceWindow::PerformanceWindow(FP4Win *fp4Win, QWidget *parent) :
 {
     setTitle("Performance");
 
+    m_beatTimer = new QTimer(this);
+    m_beatTimer->setSingleShot(true);
+    m_beatTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_beatTimer, SIGNAL(timeout()), SLOT(onBeat()));
+
     m_songs = new SongListModel(); // this);
 
     m_configurations = new ConfigurationListModel;
@@ -1588,31 +1594,68 @@ void PerformanceWindow::setPerformanceMode(bool performanceMode) {
 }
 
 void PerformanceWindow::rewind() {
-    m_timeline->rewind();
+    changeFrameOnBeat(&TimeLineModel::rewind);
 }
 
 void PerformanceWindow::nextFrame() {
-    m_timeline->nextFrame();
+    changeFrameOnBeat(&TimeLineModel::nextFrame);
 }
 
 void PerformanceWindow::previousFrame() {
-    m_timeline->previousFrame();
+    changeFrameOnBeat(&TimeLineModel::previousFrame);
 }
 
 void PerformanceWindow::nextFrameInSong() {
-    m_timeline->nextFrameInSong();
+    changeFrameOnBeat(&TimeLineModel::nextFrameInSong);
 }
 
 void PerformanceWindow::previousFrameInSong() {
-    m_timeline->previousFrameInSong();
+    changeFrameOnBeat(&TimeLineModel::previousFrameInSong);
 }
 
 void PerformanceWindow::nextSong() {
-    m_timeline->nextSong();
+    changeFrameOnBeat(&TimeLineModel::nextSong);
 }
 
 void PerformanceWindow::previousSong() {
-    m_timeline->previousSong();
+    changeFrameOnBeat(&TimeLineModel::previousSong);
+}
+
+/* If beat sync is on and MIDI clock is running, wait for the next beat
+   predicted by the tempo tracker with a single timer instead of following
+   every clock tick. Changes asked before the beat are all applied on it, so
+   pressing next twice moves two frames. Without a running clock the frame
+   changes right away, after the changes still waiting. */
+void PerformanceWindow::changeFrameOnBeat(FrameChange change) {
+    const FP4Qt* fp4 = m_fp4Win->fp4();
+    uint64_t now = fp4->queueNow();
+    uint64_t beat = m_beatSyncCheckBox->isChecked() ? fp4->tempoTracker().nextBeatTime(now) : 0;
+
+    m_pendingFrameChanges.append(change);
+
+    if (beat == 0) {
+        m_beatTimer->stop();
+        applyFrameChanges();
+        return;
+    }
+
+    if (!m_beatTimer->isActive()) {
+        m_beatTimer->start((beat - now + 999) / 1000);
+    }
+}
+
+void PerformanceWindow::onBeat() {
+    applyFrameChanges();
+}
+
+/* apply the waiting frame changes in order */
+void PerformanceWindow::applyFrameChanges() {
+    QList<FrameChange> changes = m_pendingFrameChanges;
+    m_pendingFrameChanges.clear();
+
+    foreach (FrameChange change, changes) {
+        (m_timeline->*change)();
+    }
 }
 
 void PerformanceWindow::closeEvent(QCloseEvent *) {
@@ -1621,6 +1664,7 @@ void PerformanceWindow::closeEvent(QCloseEvent *) {
     QSettings settings;
     settings.beginGroup("Shows");
     settings.setValue("Current", m_currentShow);
+    settings.setValue("SyncToBeat", m_beatSyncCheckBox->isChecked());
     settings.endGroup();
 }
 
@@ -1922,6 +1966,12 @@ QWidget *PerformanceWindow::buildTimeLineWidget() {
     m_performanceModeCheckBox = new QCheckBox("&Activate Show Mode");
     hbox->addWidget(m_performanceModeCheckBox);
 
+    m_beatSyncCheckBox = new QCheckBox("Sync to &beat");
+    m_beatSyncCheckBox->setToolTip("Change frames on the next beat of incoming MIDI clock");
+    QSettings settings;
+    m_beatSyncCheckBox->setChecked(settings.value("Shows/SyncToBeat", false).toBool());
+    hbox->addWidget(m_beatSyncCheckBox);
+
     QPushButton* rewindButton = new QPushButton("&Rewind");
     rewindButton->setProperty("cc_group", "Performance");
     rewindButton->setProperty("cc_name", "Rewind");
@@ -1991,13 +2041,13 @@ QWidget *PerformanceWindow::buildTimeLineWidget() {
     editLayout->addWidget(clearButton);
 
     connect(m_performanceModeCheckBox, SIGNAL(clicked(bool)), m_timeline, SLOT(setPerformanceMode(bool)));
-    connect(rewindButton, SIGNAL(clicked(bool)), m_timeline, SLOT(rewind()));
-    connect(prevButton, SIGNAL(clicked()), m_timeline, SLOT(previousFrame()));
-    connect(nextButton, SIGNAL(clicked()), m_timeline, SLOT(nextFrame()));
-    connect(prevInSongButton, SIGNAL(clicked()), m_timeline, SLOT(previousFrameInSong()));
-    connect(nextInSongButton, SIGNAL(clicked()), m_timeline, SLOT(nextFrameInSong()));
-    connect(prevSongButton, SIGNAL(clicked()), m_timeline, SLOT(previousSong()));
-    connect(nextSongButton, SIGNAL(clicked()), m_timeline, SLOT(nextSong()));
+    connect(rewindButton, SIGNAL(clicked(bool)), SLOT(rewind()));
+    connect(prevButton, SIGNAL(clicked()), SLOT(previousFrame()));
+    connect(nextButton, SIGNAL(clicked()), SLOT(nextFrame()));
+    connect(prevInSongButton, SIGNAL(clicked()), SLOT(previousFrameInSong()));
+    connect(nextInSongButton, SIGNAL(clicked()), SLOT(nextFrameInSong()));
+    connect(prevSongButton, SIGNAL(clicked()), SLOT(previousSong()));
+    connect(nextSongButton, SIGNAL(clicked()), SLOT(nextSong()));
 
     connect(m_timeline, SIGNAL(currentFrameChanged(int)), SLOT(onCurrentFrameChanged(int)));
 
@@ -345,6 +345,7 @@ protected slots:
     void deleteFrame(int idx);
 
     void onCurrentFrameChanged(int idx);
+    void onBeat();
 
 protected:
     void populateShowCombo();
@@ -355,6 +356,11 @@ protected:
     QString askShowName(QString defaultName="");
     void maybeSaveShow();
 
+    // change frame now, or on the next beat of incoming MIDI clock
+    typedef void (TimeLineModel::*FrameChange)();
+    void changeFrameOnBeat(FrameChange change);
+    void applyFrameChanges();
+
 private:
     QWidget* buildLoadBar();
     QWidget* buildConfigurationWidget();
@@ -370,6 +376,7 @@ private:
     TimelineView* m_timeLineView;
     QComboBox* m_showCombo;
     QCheckBox* m_performanceModeCheckBox;
+    QCheckBox* m_beatSyncCheckBox;
     QPushButton* m_saveShowButton;
     QPushButton* m_deleteShowButton;
     ConfigurationListView* m_configurationListView;
@@ -377,6 +384,10 @@ private:
     QSplitter* m_splitter;
 
     QString m_currentShow;
+
+    // frame changes waiting for the next beat, in the order they were asked
+    QTimer* m_beatTimer;
+    QList<FrameChange> m_pendingFrameChanges;
 };
 
 #endif // SHOWWIDGET_H
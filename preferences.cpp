@@ -19,6 +19,7 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 ******************************************************************************/
 
 #include "preferences.h"
+#include "config.h"
 #include <QSettings>
 
 Preferences::Preferences(QObject *parent) :
@@ -40,6 +41,13 @@ void Preferences::loadSettings(QSettings &settings) {
     m_useGM2Banks = settings.value("useGM2Banks", true).value<bool>();
     m_sendGSReset = settings.value("sendGSReset", true).value<bool>();
     m_sendLocalOn = settings.value("sendLocalOn", true).value<bool>();
+    m_realtimeMidiThread = settings.value("realtimeMidiThread", false).value<bool>();
+    m_skipUnchangedParameters = settings.value("skipUnchangedParameters", true).value<bool>();
+    m_paceSysex = settings.value("paceSysex", true).value<bool>();
+    m_sysexBytesPerMs = settings.value("sysexBytesPerMs", DEFAULT_SYSEX_BYTES_PER_MS).value<int>();
+    m_generatedControllerRate = settings.value("generatedControllerRate", DEFAULT_GENERATED_CONTROLLER_RATE).value<int>();
+    m_useRawMidi = settings.value("useRawMidi", false).value<bool>();
+    m_rawMidiDevice = settings.value("rawMidiDevice", "").value<QString>();
     settings.endGroup();
 }
 
@@ -58,6 +66,13 @@ void Preferences::saveSettings(QSettings &settings) const {
     settings.setValue("UseGM2Banks", m_useGM2Banks);
     settings.setValue("sendGSReset", m_sendGSReset);
     settings.setValue("sendLocalOn", m_sendLocalOn);
+    settings.setValue("realtimeMidiThread", m_realtimeMidiThread);
+    settings.setValue("skipUnchangedParameters", m_skipUnchangedParameters);
+    settings.setValue("paceSysex", m_paceSysex);
+    settings.setValue("sysexBytesPerMs", m_sysexBytesPerMs);
+    settings.setValue("generatedControllerRate", m_generatedControllerRate);
+    settings.setValue("useRawMidi", m_useRawMidi);
+    settings.setValue("rawMidiDevice", m_rawMidiDevice);
     settings.endGroup();
 }
 
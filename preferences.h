@@ -22,6 +22,7 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 #define PREFERENCES_H
 
 #include <QObject>
+#include <QString>
 
 class QSettings;
 
@@ -47,6 +48,13 @@ public:
     bool useGM2Banks() const { return m_useGM2Banks; }
     bool sendGSReset() const { return m_sendGSReset; }
     bool sendLocalOn() const { return m_sendLocalOn; }
+    bool realtimeMidiThread() const { return m_realtimeMidiThread; }
+    bool skipUnchangedParameters() const { return m_skipUnchangedParameters; }
+    bool paceSysex() const { return m_paceSysex; }
+    int sysexBytesPerMs() const { return m_sysexBytesPerMs; }
+    int generatedControllerRate() const { return m_generatedControllerRate; }
+    bool useRawMidi() const { return m_useRawMidi; }
+    QString rawMidiDevice() const { return m_rawMidiDevice; }
 
 public slots:
     void setIgnoreHWCheck(bool v) { m_ignoreHWCheck=v; }
@@ -62,6 +70,13 @@ public slots:
     void setUseGM2Banks(bool v) { m_useGM2Banks=v; }
     void setSendGSReset(bool v) { m_sendGSReset=v; }
     void setSendLocalOn(bool v) { m_sendLocalOn=v; }
+    void setRealtimeMidiThread(bool v) { m_realtimeMidiThread=v; }
+    void setSkipUnchangedParameters(bool v) { m_skipUnchangedParameters=v; }
+    void setPaceSysex(bool v) { m_paceSysex=v; }
+    void setSysexBytesPerMs(int v) { m_sysexBytesPerMs=v; }
+    void setGeneratedControllerRate(int v) { m_generatedControllerRate=v; }
+    void setUseRawMidi(bool v) { m_useRawMidi=v; }
+    void setRawMidiDevice(const QString& v) { m_rawMidiDevice=v; }
 
 private:
     bool m_ignoreHWCheck;
@@ -77,6 +92,13 @@ private:
     bool m_useGM2Banks;
     bool m_sendGSReset;
     bool m_sendLocalOn;
+    bool m_realtimeMidiThread;
+    bool m_skipUnchangedParameters;
+    bool m_paceSysex;
+    int m_sysexBytesPerMs;
+    int m_generatedControllerRate;
+    bool m_useRawMidi;
+    QString m_rawMidiDevice;
 };
 
 #endif // PREFERENCES_H
@@ -73,6 +73,27 @@ PreferencesWindow::PreferencesWindow(Preferences *prefs, QWidget *parent) :
     addOption(layout, "Send &GS Reset on startup", "",
               SLOT(setSendGSReset(bool)),
               prefs->sendGSReset());
+    addOption(layout, "Use real-time &MIDI thread priority", "Run the MIDI thread with SCHED_FIFO priority so "
+              "notes are forwarded without delay when the system is busy. This requires real-time privileges "
+              "for your user. Takes effect after a restart.",
+              SLOT(setRealtimeMidiThread(bool)),
+              prefs->realtimeMidiThread());
+    addOption(layout, "Skip &unchanged parameters", "Remember the parameters that were sent to the FP-4 and "
+              "don't send them again if they didn't change. This makes loading presets faster. "
+              "\"Resend all\" always sends everything. Takes effect after a restart.",
+              SLOT(setSkipUnchangedParameters(bool)),
+              prefs->skipUnchangedParameters());
+    addOption(layout, "Send parameter changes &behind notes", "Limit the rate at which effect and system "
+              "parameters are sent, so notes are never delayed by a preset or frame change. The rate can "
+              "be set with the sysexBytesPerMs setting. Takes effect after a restart.",
+              SLOT(setPaceSysex(bool)),
+              prefs->paceSysex());
+    addOption(layout, "Connect to the FP-4 &directly", "Exchange MIDI data with the FP-4 through its rawmidi "
+              "device instead of the ALSA sequencer. This lowers latency, but other applications can't use the "
+              "FP-4 and it can't be reconnected without a restart. The device can be set with the rawMidiDevice "
+              "setting, it is detected if empty. Takes effect after a restart.",
+              SLOT(setUseRawMidi(bool)),
+              prefs->useRawMidi());
 }
 
 void PreferencesWindow::addOption(QGridLayout *layout, const QString &name, const QString &desc,
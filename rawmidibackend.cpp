@@ -0,0 +1,463 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "rawmidibackend.h"
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+
+RawMidiBackend::RawMidiBackend(const char *device, const char *cardName) :
+    m_in(0),
+    m_out(0),
+    m_outStatus(0),
+    m_bytesWritten(0),
+    m_statusBytesSaved(0),
+    m_readPos(0),
+    m_readLength(0),
+    m_inStatus(0),
+    m_inCount(0),
+    m_inSysex(false)
+{
+    m_device = strdup(device ? device : "");
+    m_cardName = strdup(cardName ? cardName : "");
+    m_outBuffer.reserve(4096);
+    snd_seq_ev_clear(&m_event);
+}
+
+RawMidiBackend::~RawMidiBackend() {
+    close();
+    free(m_device);
+    free(m_cardName);
+}
+
+bool RawMidiBackend::connect() {
+    if (isOpen()) {
+        return true;
+    }
+
+    char found[32];
+    const char* device = m_device;
+    if (!*device) {
+        if (!findDevice(m_cardName, found, sizeof(found))) {
+            return false;
+        }
+        device = found;
+    }
+
+    int err = snd_rawmidi_open(&m_in, &m_out, device, SND_RAWMIDI_NONBLOCK);
+    if (err < 0) {
+        cerr << "RawMidiBackend: cannot open " << device << ": " << snd_strerror(err) << endl;
+        m_in = 0;
+        m_out = 0;
+        return false;
+    }
+
+    cerr << "RawMidiBackend: using " << device << endl;
+
+    // nothing is known about the state of the device's parser
+    m_outBuffer.clear();
+    m_outStatus = 0;
+    m_readPos = m_readLength = 0;
+    m_inStatus = 0;
+    m_inCount = 0;
+    m_inSysex = false;
+
+    return true;
+}
+
+void RawMidiBackend::close() {
+    if (m_in) {
+        snd_rawmidi_close(m_in);
+        m_in = 0;
+    }
+
+    if (m_out) {
+        snd_rawmidi_close(m_out);
+        m_out = 0;
+    }
+}
+
+/* return the first rawmidi device of the first card with cardName in its name */
+bool RawMidiBackend::findDevice(const char *cardName, char *device, int size) {
+    int card = -1;
+    while (snd_card_next(&card) >= 0 && card >= 0) {
+        char* name = 0;
+        if (snd_card_get_name(card, &name) < 0) {
+            continue;
+        }
+
+        bool match = strstr(name, cardName) != 0;
+        free(name);
+        if (!match) {
+            continue;
+        }
+
+        char ctlName[16];
+        snprintf(ctlName, sizeof(ctlName), "hw:%d", card);
+
+        snd_ctl_t* ctl;
+        if (snd_ctl_open(&ctl, ctlName, 0) < 0) {
+            continue;
+        }
+
+        int dev = -1;
+        int err = snd_ctl_rawmidi_next_device(ctl, &dev);
+        snd_ctl_close(ctl);
+
+        if (err >= 0 && dev >= 0) {
+            snprintf(device, size, "hw:%d,%d", card, dev);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Serialize a short message in bytes. Returns the number of bytes, 0 for
+   events that have no MIDI equivalent. */
+int RawMidiBackend::encode(const snd_seq_event_t *ev, uint8_t *bytes) {
+    uint8_t status;
+    uint8_t data[2];
+    int dataLength = 2;
+
+    switch (ev->type) {
+    case SND_SEQ_EVENT_NOTEOFF:
+        status = 0x80;
+        data[0] = ev->data.note.note;
+        data[1] = ev->data.note.velocity;
+        break;
+    case SND_SEQ_EVENT_NOTEON:
+        status = 0x90;
+        data[0] = ev->data.note.note;
+        data[1] = ev->data.note.velocity;
+        break;
+    case SND_SEQ_EVENT_KEYPRESS:
+        status = 0xa0;
+        data[0] = ev->data.note.note;
+        data[1] = ev->data.note.velocity;
+        break;
+    case SND_SEQ_EVENT_CONTROLLER:
+        status = 0xb0;
+        data[0] = ev->data.control.param;
+        data[1] = ev->data.control.value;
+        break;
+    case SND_SEQ_EVENT_PGMCHANGE:
+        status = 0xc0;
+        data[0] = ev->data.control.value;
+        dataLength = 1;
+        break;
+    case SND_SEQ_EVENT_CHANPRESS:
+        status = 0xd0;
+        data[0] = ev->data.control.value;
+        dataLength = 1;
+        break;
+    case SND_SEQ_EVENT_PITCHBEND: {
+        int value = ev->data.control.value + 8192;
+        status = 0xe0;
+        data[0] = value & 0x7f;
+        data[1] = (value >> 7) & 0x7f;
+        break;
+    }
+
+    // real-time messages don't touch running status
+    case SND_SEQ_EVENT_CLOCK:
+        bytes[0] = 0xf8;
+        return 1;
+    case SND_SEQ_EVENT_START:
+        bytes[0] = 0xfa;
+        return 1;
+    case SND_SEQ_EVENT_CONTINUE:
+        bytes[0] = 0xfb;
+        return 1;
+    case SND_SEQ_EVENT_STOP:
+        bytes[0] = 0xfc;
+        return 1;
+
+    default:
+        return 0;
+    }
+
+    status |= ev->data.note.channel & 0x0f;
+
+    int length = 0;
+    if (status != m_outStatus) {
+        bytes[length++] = status;
+        m_outStatus = status;
+    }
+    else {
+        ++m_statusBytesSaved;
+    }
+
+    for (int i=0; i<dataLength; ++i) {
+        bytes[length++] = data[i] & 0x7f;
+    }
+
+    return length;
+}
+
+/* Events are appended to the output buffer. Unbuffered events are written
+   right away with everything before them. Returns -EAGAIN if the buffer is
+   full, so the caller can flush and retry. */
+int RawMidiBackend::output(snd_seq_event_t *ev, bool buffered) {
+    if (!m_out) {
+        return -ENODEV;
+    }
+
+    if (ev->type == SND_SEQ_EVENT_SYSEX) {
+        const uint8_t* data = (const uint8_t*)ev->data.ext.ptr;
+        unsigned int length = ev->data.ext.len;
+
+        if (m_outBuffer.size() + length > RAWMIDI_OUTPUT_BUFFER_SIZE && !m_outBuffer.empty()) {
+            return -EAGAIN;
+        }
+
+        m_outBuffer.insert(m_outBuffer.end(), data, data + length);
+        m_outStatus = 0;
+    }
+    else {
+        uint8_t bytes[3];
+        uint8_t savedStatus = m_outStatus;
+        int length = encode(ev, bytes);
+        if (length == 0) {
+            return 0;
+        }
+
+        if (m_outBuffer.size() + length > RAWMIDI_OUTPUT_BUFFER_SIZE) {
+            m_outStatus = savedStatus;
+            return -EAGAIN;
+        }
+
+        m_outBuffer.insert(m_outBuffer.end(), bytes, bytes + length);
+    }
+
+    if (!buffered) {
+        int ret = flush();
+        return ret < 0 ? ret : 0;
+    }
+
+    return 0;
+}
+
+int RawMidiBackend::flush() {
+    if (m_outBuffer.empty()) {
+        return 0;
+    }
+
+    if (!m_out) {
+        m_outBuffer.clear();
+        return -ENODEV;
+    }
+
+    ssize_t written = snd_rawmidi_write(m_out, m_outBuffer.data(), m_outBuffer.size());
+    if (written == -EAGAIN) {
+        return m_outBuffer.size();
+    }
+
+    if (written < 0) {
+        // the bytes are lost, the device must get a status byte again
+        m_outBuffer.clear();
+        m_outStatus = 0;
+        return written;
+    }
+
+    m_bytesWritten += written;
+    m_outBuffer.erase(m_outBuffer.begin(), m_outBuffer.begin() + written);
+    return m_outBuffer.size();
+}
+
+/* Parse buffered bytes until an event is complete, reading from the device
+   when they run out. A read error closes the device. */
+int RawMidiBackend::input(snd_seq_event_t **ev) {
+    while (true) {
+        while (m_readPos < m_readLength) {
+            if (parseByte(m_readBuffer[m_readPos++])) {
+                *ev = &m_event;
+                return 0;
+            }
+        }
+
+        if (!m_in) {
+            return -EAGAIN;
+        }
+
+        ssize_t length = snd_rawmidi_read(m_in, m_readBuffer, sizeof(m_readBuffer));
+        if (length == 0 || length == -EAGAIN) {
+            return -EAGAIN;
+        }
+
+        if (length < 0) {
+            cerr << "RawMidiBackend: read failed: " << snd_strerror(length) << endl;
+            close();
+            return -ENODEV;
+        }
+
+        m_readPos = 0;
+        m_readLength = length;
+    }
+}
+
+bool RawMidiBackend::inputPending() {
+    return m_readPos < m_readLength;
+}
+
+int RawMidiBackend::pollDescriptors(struct pollfd *pfds, int space) {
+    if (!m_in) {
+        return 0;
+    }
+
+    int count = snd_rawmidi_poll_descriptors_count(m_in);
+    if (count > space) {
+        count = space;
+    }
+
+    return snd_rawmidi_poll_descriptors(m_in, pfds, count);
+}
+
+/* the output descriptors, while bytes wait in the output buffer */
+int RawMidiBackend::outputPollDescriptors(struct pollfd *pfds, int space) {
+    if (!m_out || m_outBuffer.empty()) {
+        return 0;
+    }
+
+    int count = snd_rawmidi_poll_descriptors_count(m_out);
+    if (count > space) {
+        count = space;
+    }
+
+    count = snd_rawmidi_poll_descriptors(m_out, pfds, count);
+    for (int i=0; i<count; ++i) {
+        pfds[i].events = POLLOUT;
+        pfds[i].revents = 0;
+    }
+    return count;
+}
+
+/* feed one byte to the parser. Returns true if m_event holds a new event. */
+bool RawMidiBackend::parseByte(uint8_t byte) {
+    // real-time messages can appear anywhere
+    if (byte >= 0xf8) {
+        snd_seq_ev_clear(&m_event);
+        switch (byte) {
+        case 0xf8:
+            m_event.type = SND_SEQ_EVENT_CLOCK;
+            return true;
+        case 0xfa:
+            m_event.type = SND_SEQ_EVENT_START;
+            return true;
+        case 0xfb:
+            m_event.type = SND_SEQ_EVENT_CONTINUE;
+            return true;
+        case 0xfc:
+            m_event.type = SND_SEQ_EVENT_STOP;
+            return true;
+        default:
+            // active sensing and reset
+            return false;
+        }
+    }
+
+    if (byte == 0xf0) {
+        m_inSysex = true;
+        m_inStatus = 0;
+        m_sysex.clear();
+        m_sysex.push_back(byte);
+        return false;
+    }
+
+    if (byte == 0xf7) {
+        if (!m_inSysex) {
+            return false;
+        }
+
+        m_inSysex = false;
+        m_sysex.push_back(byte);
+
+        snd_seq_ev_clear(&m_event);
+        snd_seq_ev_set_sysex(&m_event, m_sysex.size(), m_sysex.data());
+        return true;
+    }
+
+    if (byte & 0x80) {
+        // a status byte ends an unterminated sysex
+        m_inSysex = false;
+        m_inCount = 0;
+
+        // system common messages are not passed on, and cancel running status
+        m_inStatus = byte < 0xf0 ? byte : 0;
+        return false;
+    }
+
+    if (m_inSysex) {
+        if (m_sysex.size() < RAWMIDI_MAX_SYSEX_SIZE) {
+            m_sysex.push_back(byte);
+        }
+        return false;
+    }
+
+    if (!m_inStatus) {
+        return false;
+    }
+
+    m_inData[m_inCount++] = byte;
+
+    int type = m_inStatus & 0xf0;
+    int needed = (type == 0xc0 || type == 0xd0) ? 1 : 2;
+    if (m_inCount < needed) {
+        return false;
+    }
+
+    // keep the status for the next message
+    m_inCount = 0;
+    setChannelEvent();
+    return true;
+}
+
+/* turn the parsed channel message in m_event */
+void RawMidiBackend::setChannelEvent() {
+    int channel = m_inStatus & 0x0f;
+
+    snd_seq_ev_clear(&m_event);
+    switch (m_inStatus & 0xf0) {
+    case 0x80:
+        snd_seq_ev_set_noteoff(&m_event, channel, m_inData[0], m_inData[1]);
+        break;
+    case 0x90:
+        snd_seq_ev_set_noteon(&m_event, channel, m_inData[0], m_inData[1]);
+        break;
+    case 0xa0:
+        snd_seq_ev_set_keypress(&m_event, channel, m_inData[0], m_inData[1]);
+        break;
+    case 0xb0:
+        snd_seq_ev_set_controller(&m_event, channel, m_inData[0], m_inData[1]);
+        break;
+    case 0xc0:
+        snd_seq_ev_set_pgmchange(&m_event, channel, m_inData[0]);
+        break;
+    case 0xd0:
+        snd_seq_ev_set_chanpress(&m_event, channel, m_inData[0]);
+        break;
+    case 0xe0:
+        snd_seq_ev_set_pitchbend(&m_event, channel, (m_inData[0] | (m_inData[1] << 7)) - 8192);
+        break;
+    }
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Exchange MIDI bytes with the FP-4 rawmidi device, without going through
+   the sequencer.
+
+   Output is serialized with running status: the status byte of a channel
+   message is left out when it is the same as the previous one, which saves
+   a third of the bytes in controller streams. Sysex and system common
+   messages cancel running status, real-time messages don't.
+
+   Input bytes are parsed into sequencer events, with running status,
+   real-time bytes in the middle of messages and sysex messages split over
+   several reads. Active sensing is dropped.
+
+   Writes are non-blocking. Bytes the device doesn't accept yet stay in the
+   output buffer and are retried on the next flush, which MidiThread does
+   as soon as outputPollDescriptors() become writable.
+*/
+
+#ifndef RAWMIDIBACKEND_H
+#define RAWMIDIBACKEND_H
+
+#include "midibackend.h"
+#include <inttypes.h>
+#include <vector>
+
+// largest number of bytes waiting to be written
+#define RAWMIDI_OUTPUT_BUFFER_SIZE 65536
+
+// largest incoming sysex message
+#define RAWMIDI_MAX_SYSEX_SIZE 65536
+
+class RawMidiBackend : public MidiBackend {
+public:
+    // device is an ALSA rawmidi name like "hw:1,0,0". If empty, the first
+    // card whose name contains cardName is used.
+    RawMidiBackend(const char* device, const char* cardName);
+    ~RawMidiBackend();
+
+    const char* name() const { return "rawmidi"; }
+
+    bool connect();
+    void close();
+    bool isOpen() const { return m_in || m_out; }
+
+    int output(snd_seq_event_t* ev, bool buffered);
+    int flush();
+    int input(snd_seq_event_t** ev);
+    bool inputPending();
+    int pollDescriptors(struct pollfd* pfds, int space);
+    int outputPollDescriptors(struct pollfd* pfds, int space);
+
+    // bytes written to the device, and status bytes left out
+    uint64_t bytesWritten() const { return m_bytesWritten; }
+    uint64_t statusBytesSaved() const { return m_statusBytesSaved; }
+
+    // find the rawmidi device of a sound card by name
+    static bool findDevice(const char* cardName, char* device, int size);
+
+private:
+    int encode(const snd_seq_event_t* ev, uint8_t* bytes);
+    bool parseByte(uint8_t byte);
+    void setChannelEvent();
+
+    char* m_device;
+    char* m_cardName;
+
+    snd_rawmidi_t* m_in;
+    snd_rawmidi_t* m_out;
+
+    // output
+    std::vector<uint8_t> m_outBuffer;
+    uint8_t m_outStatus;
+    uint64_t m_bytesWritten;
+    uint64_t m_statusBytesSaved;
+
+    // input
+    uint8_t m_readBuffer[256];
+    int m_readPos;
+    int m_readLength;
+
+    uint8_t m_inStatus;
+    uint8_t m_inData[2];
+    int m_inCount;
+    bool m_inSysex;
+    std::vector<uint8_t> m_sysex;
+
+    snd_seq_event_t m_event;
+};
+
+#endif // RAWMIDIBACKEND_H
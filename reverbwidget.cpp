@@ -49,6 +49,8 @@ bool ReverbWidget::advancedMode() const {
 }
 
 void ReverbWidget::sendAll() {
+    FP4DataTransaction transaction(FP4App()->fp4());
+
     if (advancedMode()) {
         //ReverbType type, int preLPF, int level, int time, int delay
         int type = parameterValue(REVERB_CHARACTER);
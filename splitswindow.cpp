@@ -126,11 +126,13 @@ void SplitsWindow::restoreSettings(QSettings& settings) {
                 mapping->active = settings.value("active", false).toBool();
                 mapping->octaveShift = settings.value("octaveShift", 0).toInt();
                 mapping->transformMode = settings.value("transformMode", 0).toInt();
+                mapping->chordWindow = settings.value("chordWindow", DEFAULT_CHORD_WINDOW).toInt();
                 settings.endGroup();
             }
             settings.endGroup();
         }
         settings.endGroup();
+        m_fp4->updateChannelMappings();
     }
     setCurrentInputChannel(0);
 }
@@ -160,6 +162,9 @@ void SplitsWindow::saveSettings(QSettings& settings) const {
             if (mapping->transformMode != 0) {
                 settings.setValue("transformMode", mapping->transformMode);
             }
+            if (mapping->chordWindow != DEFAULT_CHORD_WINDOW) {
+                settings.setValue("chordWindow", mapping->chordWindow);
+            }
             settings.endGroup();
         }
         settings.endGroup();
@@ -193,6 +198,7 @@ void SplitsWindow::setCurrentOutputChannel(int outChannel) {
     m_enableChannelCheckBox->setChecked(mapping->active);
     m_octaveShiftCombo->setCurrentIndex(octaveShiftToComboIndex(mapping->octaveShift));
     m_transformModeCombo->setCurrentIndex((int)mapping->transformMode);
+    m_chordWindowSpinBox->setValue(mapping->chordWindow);
     m_keyLowLabel->setText(QString("%1 (%2)").arg(MusicTheory::noteFullName(mapping->keyLow)).arg(mapping->keyLow));
     m_keyHighLabel->setText(QString("%1 (%2)").arg(MusicTheory::noteFullName(mapping->keyHigh)).arg(mapping->keyHigh));
 
@@ -205,6 +211,7 @@ void SplitsWindow::setCurrentOutputChannel(int outChannel) {
 void SplitsWindow::setCurrentActiveState(bool active) {
     ChannelMapping* mapping = currentMapping();
     mapping->active = active;
+    m_fp4->updateChannelMappings();
 
     m_enableChannelCheckBox->setChecked(active);
     m_keyboardRangeWidgets[currentOutputChannel()]->setActive(active);
@@ -218,6 +225,7 @@ void SplitsWindow::setCurrentRange(int keyLow, int keyHigh) {
     ChannelMapping* mapping = currentMapping();
     mapping->keyLow = keyLow;
     mapping->keyHigh = keyHigh;
+    m_fp4->updateChannelMappings();
 
     m_keyLowLabel->setText(QString("%1 (%2)").arg(MusicTheory::noteFullName(keyLow)).arg(keyLow));
     m_keyHighLabel->setText(QString("%1 (%2)").arg(MusicTheory::noteFullName(keyHigh)).arg(keyHigh));
@@ -229,6 +237,7 @@ void SplitsWindow::setCurrentOctaveShift(int octaveShift) {
     ChannelMapping* mapping = currentMapping();
     if (mapping->octaveShift != octaveShift) {
         mapping->octaveShift = octaveShift;
+        m_fp4->updateChannelMappings();
         m_octaveShiftCombo->setCurrentIndex(octaveShiftToComboIndex(octaveShift));
     }
 }
@@ -237,10 +246,20 @@ void SplitsWindow::setCurrentTransformMode(int mode) {
     ChannelMapping* mapping = currentMapping();
     if (mapping->transformMode != mode) {
         mapping->transformMode = mode;
+        m_fp4->updateChannelMappings();
         m_transformModeCombo->setCurrentIndex(mode);
     }
 }
 
+void SplitsWindow::setCurrentChordWindow(int msec) {
+    ChannelMapping* mapping = currentMapping();
+    if (mapping->chordWindow != msec) {
+        mapping->chordWindow = msec;
+        m_fp4->updateChannelMappings();
+        m_chordWindowSpinBox->setValue(msec);
+    }
+}
+
 void SplitsWindow::onOctaveShiftComboChanged(int index) {
     setCurrentOctaveShift(octaveShiftFromComboIndex(index));
 }
@@ -449,6 +468,15 @@ QWidget *SplitsWindow::buildControlPane() {
     modeLabel->setBuddy(m_transformModeCombo);
     vbox->addWidget(m_transformModeCombo);
 
+    QLabel* chordWindowLabel = new QLabel("C&hord window:");
+    vbox->addWidget(chordWindowLabel);
+    m_chordWindowSpinBox = new QSpinBox;
+    m_chordWindowSpinBox->setRange(1, 500);
+    m_chordWindowSpinBox->setSuffix(" ms");
+    m_chordWindowSpinBox->setToolTip("In Smart mode, notes played within this time are played as a chord.");
+    chordWindowLabel->setBuddy(m_chordWindowSpinBox);
+    vbox->addWidget(m_chordWindowSpinBox);
+
     m_keyLowLabel = new QLabel;
     vbox->addWidget(m_keyLowLabel);
 
@@ -469,6 +497,7 @@ QWidget *SplitsWindow::buildControlPane() {
     connect(m_enableChannelCheckBox, SIGNAL(clicked(bool)), SLOT(setCurrentActiveState(bool)));
     connect(m_octaveShiftCombo, SIGNAL(activated(int)), SLOT(onOctaveShiftComboChanged(int)));
     connect(m_transformModeCombo, SIGNAL(activated(int)), SLOT(setCurrentTransformMode(int)));
+    connect(m_chordWindowSpinBox, SIGNAL(valueChanged(int)), SLOT(setCurrentChordWindow(int)));
 
     return widget;
 }
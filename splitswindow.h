@@ -30,6 +30,7 @@ class KeyboardWidget;
 class KeyboardRangeWidget;
 class QComboBox;
 class QCheckBox;
+class QSpinBox;
 class QLabel;
 class QSettings;
 
@@ -63,6 +64,7 @@ protected slots:
     void setCurrentRange(int keyLow, int keyHigh);
     void setCurrentOctaveShift(int octaveShift);
     void setCurrentTransformMode(int mode);
+    void setCurrentChordWindow(int msec);
 
     void onOctaveShiftComboChanged(int index);
     void onKeyboardRangeWidgetGotFocus(int channel);
@@ -100,6 +102,7 @@ private:
     QCheckBox* m_enableChannelCheckBox;
     QComboBox* m_octaveShiftCombo;
     QComboBox* m_transformModeCombo;
+    QSpinBox* m_chordWindowSpinBox;
     QWidget* m_transformWidget;
 
     QLabel* m_keyLowLabel;
@@ -0,0 +1,79 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Fixed size lock-free ring buffer for exactly one producer thread and one
+   consumer thread. This is used to pass events between the MIDI thread and
+   the GUI thread without taking locks or allocating memory.
+
+   Size must be a power of two. One slot is always kept free, so the ring
+   holds at most Size-1 elements.
+*/
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <stddef.h>
+
+template<typename T, size_t Size>
+class SpscRing {
+    static_assert((Size & (Size-1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : m_head(0), m_tail(0) {}
+
+    // producer side. returns false if the ring is full.
+    bool push(const T& value) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t next = (head + 1) & (Size - 1);
+        if (next == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        m_buffer[head] = value;
+        m_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side. returns false if the ring is empty.
+    bool pop(T& value) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = m_buffer[tail];
+        m_tail.store((tail + 1) & (Size - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const {
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+
+private:
+    T m_buffer[Size];
+
+    // keep producer and consumer indexes on separate cache lines
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,167 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "sysexpacer.h"
+#include <string.h>
+#include <math.h>
+
+SysexPacer::SysexPacer() :
+    m_first(0),
+    m_count(0),
+    m_bytesPerMs(0),
+    m_tokens(0),
+    m_lastRefill(0)
+{
+    resetStats();
+}
+
+void SysexPacer::setBytesPerMs(double bytesPerMs) {
+    m_bytesPerMs = bytesPerMs > 0 ? bytesPerMs : 0;
+    m_tokens = capacity();
+}
+
+double SysexPacer::capacity() const {
+    return m_bytesPerMs * SYSEX_BURST_MS;
+}
+
+void SysexPacer::refill(uint64_t now) {
+    if (now > m_lastRefill) {
+        m_tokens += (now - m_lastRefill) * m_bytesPerMs / 1000.;
+        if (m_tokens > capacity()) {
+            m_tokens = capacity();
+        }
+    }
+    m_lastRefill = now;
+}
+
+bool SysexPacer::canSend(unsigned length, uint64_t now) {
+    if (!isEnabled()) {
+        return true;
+    }
+
+    refill(now);
+
+    double needed = length < capacity() ? length : capacity();
+    return m_tokens >= needed;
+}
+
+void SysexPacer::consume(unsigned length) {
+    if (isEnabled()) {
+        m_tokens -= length;
+    }
+
+    ++m_stats.messages;
+    m_stats.bytes += length;
+}
+
+bool SysexPacer::enqueue(const uint8_t *data, unsigned length, uint64_t now) {
+    if (m_count >= SYSEX_QUEUE_SLOTS || length > SYSEX_SLOT_SIZE) {
+        return false;
+    }
+
+    Slot& slot = m_slots[(m_first + m_count) % SYSEX_QUEUE_SLOTS];
+    slot.queued = now;
+    slot.length = length;
+    memcpy(slot.data, data, length);
+    ++m_count;
+
+    if (m_count > m_stats.maxQueueDepth) {
+        m_stats.maxQueueDepth = m_count;
+    }
+    m_stats.queueDepth = m_count;
+
+    return true;
+}
+
+bool SysexPacer::front(const uint8_t *&data, unsigned &length, uint64_t now) {
+    if (m_count == 0) {
+        return false;
+    }
+
+    const Slot& slot = m_slots[m_first];
+    if (!canSend(slot.length, now)) {
+        return false;
+    }
+
+    data = slot.data;
+    length = slot.length;
+    return true;
+}
+
+bool SysexPacer::peek(const uint8_t *&data, unsigned &length) const {
+    if (m_count == 0) {
+        return false;
+    }
+
+    data = m_slots[m_first].data;
+    length = m_slots[m_first].length;
+    return true;
+}
+
+void SysexPacer::pop(uint64_t now) {
+    if (m_count == 0) {
+        return;
+    }
+
+    const Slot& slot = m_slots[m_first];
+    consume(slot.length);
+
+    uint64_t delay = now > slot.queued ? now - slot.queued : 0;
+    ++m_stats.delayedMessages;
+    m_stats.totalDelay += delay;
+    if (delay > m_stats.maxDelay) {
+        m_stats.maxDelay = delay;
+    }
+
+    m_first = (m_first + 1) % SYSEX_QUEUE_SLOTS;
+    --m_count;
+    m_stats.queueDepth = m_count;
+}
+
+int SysexPacer::timeout(uint64_t now) {
+    if (m_count == 0) {
+        return -1;
+    }
+
+    if (!isEnabled()) {
+        return 0;
+    }
+
+    refill(now);
+
+    unsigned length = m_slots[m_first].length;
+    double needed = length < capacity() ? length : capacity();
+    if (m_tokens >= needed) {
+        return 0;
+    }
+
+    return (int)ceil((needed - m_tokens) / m_bytesPerMs);
+}
+
+void SysexPacer::clear() {
+    m_first = 0;
+    m_count = 0;
+    m_stats.queueDepth = 0;
+}
+
+void SysexPacer::resetStats() {
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.queueDepth = m_count;
+}
@@ -0,0 +1,117 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Hold back sysex messages so they don't use more than a fixed number of
+   bytes per millisecond of the MIDI link. Notes and controllers are never
+   queued. FP4 sends the queued messages before them, so they don't pass in
+   front of a pending reset.
+
+   The budget is a token bucket: it fills up at bytesPerMs and holds at most
+   SYSEX_BURST_MS worth of bytes. A message can be sent once the bucket
+   holds as many bytes as the message (or is full, for large messages), and
+   the bucket may go negative.
+
+   Time is passed in by the caller, in microseconds.
+*/
+
+#ifndef SYSEXPACER_H
+#define SYSEXPACER_H
+
+#include <inttypes.h>
+
+// number of messages that can be queued
+#define SYSEX_QUEUE_SLOTS 128
+
+// maximum size of a queued message. larger messages are not paced.
+#define SYSEX_SLOT_SIZE 256
+
+// burst size of the budget, in milliseconds of budget
+#define SYSEX_BURST_MS 4
+
+// statistics of paced sysex output
+struct SysexPacerStats {
+    unsigned queueDepth;        // messages waiting now
+    unsigned maxQueueDepth;     // highest number of messages waiting
+    uint64_t messages;          // messages sent
+    uint64_t bytes;             // bytes sent
+    uint64_t delayedMessages;   // messages that had to wait
+    uint64_t totalDelay;        // sum of waiting times, in us
+    uint64_t maxDelay;          // longest waiting time, in us
+    uint64_t overflows;         // messages sent unpaced because the queue was full
+};
+
+class SysexPacer {
+public:
+    SysexPacer();
+
+    // 0 disables pacing
+    void setBytesPerMs(double bytesPerMs);
+    double bytesPerMs() const { return m_bytesPerMs; }
+    bool isEnabled() const { return m_bytesPerMs > 0; }
+
+    bool isEmpty() const { return m_count == 0; }
+
+    // true if a message of this size can be sent right away
+    bool canSend(unsigned length, uint64_t now);
+
+    // take bytes from the budget for a message that is sent
+    void consume(unsigned length);
+
+    // queue a message. returns false if it doesn't fit.
+    bool enqueue(const uint8_t* data, unsigned length, uint64_t now);
+
+    // get the first queued message if it can be sent. Call pop() after sending it.
+    bool front(const uint8_t*& data, unsigned& length, uint64_t now);
+    void pop(uint64_t now);
+
+    // get the first queued message regardless of the budget
+    bool peek(const uint8_t*& data, unsigned& length) const;
+
+    // milliseconds until the first queued message can be sent, -1 if none
+    int timeout(uint64_t now);
+
+    void clear();
+
+    const SysexPacerStats& stats() const { return m_stats; }
+    void resetStats();
+    void countOverflow() { ++m_stats.overflows; }
+
+private:
+    void refill(uint64_t now);
+    double capacity() const;
+
+    struct Slot {
+        uint64_t queued;
+        uint16_t length;
+        uint8_t data[SYSEX_SLOT_SIZE];
+    };
+
+    Slot m_slots[SYSEX_QUEUE_SLOTS];
+    unsigned m_first;
+    unsigned m_count;
+
+    double m_bytesPerMs;
+    double m_tokens;
+    uint64_t m_lastRefill;
+
+    SysexPacerStats m_stats;
+};
+
+#endif // SYSEXPACER_H
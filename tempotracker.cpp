@@ -0,0 +1,218 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+#include "tempotracker.h"
+#include <math.h>
+
+// tick period limits in us
+#define MIN_CLOCK_PERIOD (60000000.0 / (MAX_CLOCK_TEMPO * MIDI_CLOCK_PPQ))
+#define MAX_CLOCK_PERIOD (60000000.0 / (MIN_CLOCK_TEMPO * MIDI_CLOCK_PPQ))
+
+TempoTracker::TempoTracker() :
+    m_sequence(0),
+    m_publishedLocked(false),
+    m_publishedRunning(false),
+    m_publishedPeriod(0),
+    m_publishedTickTime(0),
+    m_publishedTickIndex(-1)
+{
+    reset();
+}
+
+void TempoTracker::reset() {
+    m_state.locked = false;
+    m_state.running = false;
+    m_state.period = 0;
+    m_state.tickTime = 0;
+    m_state.tickIndex = -1;
+    m_lastClock = 0;
+    m_nextTickIndex = 0;
+    publish();
+}
+
+/* a clock tick was received at time */
+void TempoTracker::clock(uint64_t time) {
+    double interval = m_lastClock ? (double)time - (double)m_lastClock : 0;
+
+    if (m_lastClock == 0 || interval > MAX_CLOCK_PERIOD * CLOCK_DROPOUT_TICKS
+            || (m_state.locked && interval > m_state.period * CLOCK_DROPOUT_TICKS)) {
+        // first tick, or clock came back after a while: the tempo is unknown
+        m_state.locked = false;
+        m_state.tickTime = time;
+    }
+    else if (!m_state.locked) {
+        // the first interval is the initial guess, the loop refines it
+        m_state.tickTime = time;
+        if (interval >= MIN_CLOCK_PERIOD && interval <= MAX_CLOCK_PERIOD) {
+            m_state.period = interval;
+            m_state.locked = true;
+        }
+    }
+    else {
+        double predicted = m_state.tickTime + m_state.period;
+        double error = (double)time - predicted;
+
+        m_state.tickTime = predicted + CLOCK_PHASE_GAIN * error;
+        m_state.period += CLOCK_PERIOD_GAIN * error;
+
+        if (m_state.period < MIN_CLOCK_PERIOD) {
+            m_state.period = MIN_CLOCK_PERIOD;
+        }
+        else if (m_state.period > MAX_CLOCK_PERIOD) {
+            m_state.period = MAX_CLOCK_PERIOD;
+        }
+    }
+
+    m_lastClock = time;
+
+    if (m_state.running) {
+        m_state.tickIndex = m_nextTickIndex++;
+    }
+
+    publish();
+}
+
+/* the next tick is the start of the song */
+void TempoTracker::start() {
+    m_nextTickIndex = 0;
+    m_state.tickIndex = -1;
+    m_state.running = true;
+    publish();
+}
+
+/* the next tick continues from the current song position */
+void TempoTracker::resume() {
+    m_state.tickIndex = m_nextTickIndex - 1;
+    m_state.running = true;
+    publish();
+}
+
+void TempoTracker::stop() {
+    m_state.running = false;
+    publish();
+}
+
+/* song position pointer, in sixteenth notes */
+void TempoTracker::setSongPosition(int sixteenths) {
+    m_nextTickIndex = (int64_t)sixteenths * (MIDI_CLOCK_PPQ / 4);
+    m_state.tickIndex = m_nextTickIndex - 1;
+    publish();
+}
+
+bool TempoTracker::isLocked() const {
+    return load().locked;
+}
+
+bool TempoTracker::isRunning() const {
+    return load().running;
+}
+
+double TempoTracker::tempo() const {
+    State state = load();
+    if (!state.locked) {
+        return 0;
+    }
+    return 60000000.0 / (state.period * MIDI_CLOCK_PPQ);
+}
+
+uint64_t TempoTracker::beatDuration() const {
+    State state = load();
+    if (!state.locked) {
+        return 0;
+    }
+    return (uint64_t)(state.period * MIDI_CLOCK_PPQ + 0.5);
+}
+
+/* The position is extrapolated at most one tick past the last tick, so it
+   doesn't run ahead when clock stops coming in. */
+bool TempoTracker::position(uint64_t now, double &beats) const {
+    State state = load();
+    if (!state.locked || !state.running) {
+        return false;
+    }
+
+    double ticks = ((double)now - state.tickTime) / state.period;
+    if (ticks < 0) {
+        ticks = 0;
+    }
+    else if (ticks > 1) {
+        ticks = 1;
+    }
+
+    beats = (state.tickIndex + ticks) / MIDI_CLOCK_PPQ;
+    return true;
+}
+
+double TempoTracker::beatPhase(uint64_t now) const {
+    double beats;
+    if (!position(now, beats)) {
+        return 0;
+    }
+    return beats - floor(beats);
+}
+
+uint64_t TempoTracker::nextBeatTime(uint64_t now) const {
+    State state = load();
+    if (!state.locked || !state.running) {
+        return 0;
+    }
+
+    double beats;
+    position(now, beats);
+
+    double nextTick = (floor(beats) + 1) * MIDI_CLOCK_PPQ;
+    double time = state.tickTime + (nextTick - state.tickIndex) * state.period;
+    if (time < (double)now) {
+        return now;
+    }
+    return (uint64_t)time;
+}
+
+/* seqlock read: retry while the MIDI thread is publishing */
+TempoTracker::State TempoTracker::load() const {
+    State state;
+    uint32_t before, after;
+    do {
+        before = m_sequence.load(std::memory_order_acquire);
+        state.locked = m_publishedLocked.load(std::memory_order_relaxed);
+        state.running = m_publishedRunning.load(std::memory_order_relaxed);
+        state.period = m_publishedPeriod.load(std::memory_order_relaxed);
+        state.tickTime = m_publishedTickTime.load(std::memory_order_relaxed);
+        state.tickIndex = m_publishedTickIndex.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = m_sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    return state;
+}
+
+void TempoTracker::publish() {
+    uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_publishedLocked.store(m_state.locked, std::memory_order_relaxed);
+    m_publishedRunning.store(m_state.running, std::memory_order_relaxed);
+    m_publishedPeriod.store(m_state.period, std::memory_order_relaxed);
+    m_publishedTickTime.store(m_state.tickTime, std::memory_order_relaxed);
+    m_publishedTickIndex.store(m_state.tickIndex, std::memory_order_relaxed);
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
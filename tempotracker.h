@@ -0,0 +1,117 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Follow the tempo and position of incoming MIDI clock.
+
+   MIDI clock sends 24 ticks per quarter note. Tick arrival times jitter by
+   up to a few ms, so they are filtered by a second order phase locked loop:
+   each tick is compared to the time it was predicted at, and the error
+   corrects both the tick time and the tick period a little. The result is
+   a steady tempo and beat phase that still follows tempo changes within a
+   couple of beats.
+
+   Ticks only count song position between a start or continue and a stop,
+   like a sequencer would. Tempo is followed as long as clock comes in.
+
+   Clock is fed by the MIDI thread and can be read by any thread without
+   locking. Time is passed in by the caller, in microseconds.
+*/
+
+#ifndef TEMPOTRACKER_H
+#define TEMPOTRACKER_H
+
+#include <inttypes.h>
+#include <atomic>
+
+// MIDI clock ticks per quarter note
+#define MIDI_CLOCK_PPQ 24
+
+// tempo range that can be followed, in quarter notes per minute
+#define MIN_CLOCK_TEMPO 20
+#define MAX_CLOCK_TEMPO 400
+
+// phase and period correction of the loop, per tick
+#define CLOCK_PHASE_GAIN 0.2
+#define CLOCK_PERIOD_GAIN 0.01
+
+// a gap of this many tick periods drops the lock, as if clock was unplugged
+#define CLOCK_DROPOUT_TICKS 8
+
+class TempoTracker {
+public:
+    TempoTracker();
+
+    // called for incoming realtime messages
+    void clock(uint64_t time);
+    void start();
+    void resume();
+    void stop();
+    void setSongPosition(int sixteenths);
+    void reset();
+
+    // true once the tempo of incoming clock is known
+    bool isLocked() const;
+    // true between start or continue and stop
+    bool isRunning() const;
+
+    // quarter notes per minute, 0 if not locked
+    double tempo() const;
+    // length of a quarter note in us, 0 if not locked
+    uint64_t beatDuration() const;
+
+    /* position in quarter notes since the song started, extrapolated to time
+       now. Returns false if the clock is not locked and running. */
+    bool position(uint64_t now, double& beats) const;
+
+    // fraction of the current quarter note at time now, in [0,1)
+    double beatPhase(uint64_t now) const;
+
+    // time of the next quarter note after now, 0 if unknown
+    uint64_t nextBeatTime(uint64_t now) const;
+
+private:
+    // loop state consistent with itself, as seen by readers
+    struct State {
+        bool locked;
+        bool running;
+        double period;      // us per tick
+        double tickTime;    // us, filtered time of the last tick
+        int64_t tickIndex;  // song position of the last tick, in ticks
+    };
+
+    State load() const;
+    void publish();
+
+    // MIDI thread state
+    State m_state;
+    uint64_t m_lastClock;       // unfiltered time of the last tick, 0 if none
+    int64_t m_nextTickIndex;
+
+    // m_state as published to readers. Odd m_sequence means an update is in
+    // progress.
+    std::atomic<uint32_t> m_sequence;
+    std::atomic<bool> m_publishedLocked;
+    std::atomic<bool> m_publishedRunning;
+    std::atomic<double> m_publishedPeriod;
+    std::atomic<double> m_publishedTickTime;
+    std::atomic<int64_t> m_publishedTickIndex;
+};
+
+#endif // TEMPOTRACKER_H
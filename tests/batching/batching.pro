@@ -0,0 +1,6 @@
+TARGET = batchingtest
+
+include(../tests.pri)
+
+SOURCES += \
+    batchingtest.cpp
@@ -0,0 +1,102 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Batched output is never held longer than the maximum batch delay, flushes
+   the device couldn't take are retried, and events written directly by
+   another thread don't overtake a batch. */
+
+#include "check.h"
+#include <thread>
+#include <unistd.h>
+
+/* a backend that can't take the next flushes */
+class StallingBackend : public LoopbackBackend {
+public:
+    StallingBackend() : m_stalls(0) {}
+
+    int flush() {
+        if (m_stalls > 0) {
+            --m_stalls;
+            return -EAGAIN;
+        }
+        return LoopbackBackend::flush();
+    }
+
+    int m_stalls;
+};
+
+/* a lone event in a long batch goes out when the batch delay expired */
+static void testBatchDelay(FP4& fp4, StallingBackend* backend) {
+    fp4.beginOutputBatch();
+    fp4.sendController(0, 7, 100);
+    CHECK_EQUAL(takeOutput(backend), "");
+
+    int timeout = fp4.outputQueueTimeout();
+    CHECK(timeout >= 0 && timeout <= 2);
+
+    usleep(3000);
+    fp4.processOutputQueue();
+    CHECK_EQUAL(takeOutput(backend), "cc7=100");
+    CHECK(fp4.outputQueueTimeout() == -1);
+
+    fp4.endOutputBatch();
+    CHECK_EQUAL(takeOutput(backend), "");
+}
+
+/* a flush that failed is retried */
+static void testRetry(FP4& fp4, StallingBackend* backend) {
+    backend->m_stalls = 1;
+
+    fp4.beginOutputBatch();
+    fp4.sendController(0, 10, 64);
+    fp4.endOutputBatch();
+    CHECK_EQUAL(takeOutput(backend), "");
+    CHECK(fp4.outputQueueTimeout() >= 0);
+
+    usleep(3000);
+    fp4.processOutputQueue();
+    CHECK_EQUAL(takeOutput(backend), "cc10=64");
+}
+
+/* output of a thread outside a batch comes after the batch of another */
+static void testOrder(FP4& fp4, StallingBackend* backend) {
+    fp4.beginOutputBatch();
+    fp4.sendController(0, 91, 1);
+
+    std::thread other([&fp4]() { fp4.sendController(0, 93, 2); });
+    other.join();
+    CHECK_EQUAL(takeOutput(backend), "cc91=1 cc93=2");
+
+    fp4.sendController(0, 91, 3);
+    fp4.endOutputBatch();
+    CHECK_EQUAL(takeOutput(backend), "cc91=3");
+}
+
+int main() {
+    StallingBackend* backend = new StallingBackend;
+    FP4 fp4("batchingtest", backend);
+    fp4.setMaxBatchDelay(2000);
+
+    testBatchDelay(fp4, backend);
+    testRetry(fp4, backend);
+    testOrder(fp4, backend);
+
+    return checkResult("batching");
+}
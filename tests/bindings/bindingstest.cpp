@@ -0,0 +1,201 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Controller bindings are indexed by controller, by widget and by widget
+   name. The indexes must agree after binding, rebinding, deleting and
+   recreating widgets, and bound controllers received from a LoopbackBackend
+   must reach the widget at once instead of the output, with the repaint
+   held until the next repaint interval. The MIDI thread is not started,
+   events are handled by calling processEvents() in the GUI thread. */
+
+#include "check.h"
+#include "fp4qt.h"
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QPushButton>
+#include <QSlider>
+
+static QSlider* createSlider(const char* name) {
+    QSlider* slider = new QSlider;
+    slider->setRange(0, 127);
+    slider->setProperty("cc_group", "test");
+    slider->setProperty("cc_name", name);
+    return slider;
+}
+
+/* run the Qt event loop for ms milliseconds */
+static void processGuiEvents(int ms) {
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < ms) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, ms);
+    }
+}
+
+/* both directions of a binding are found */
+static void testBind(FP4Qt& fp4) {
+    QSlider* volume = createSlider("volume");
+    fp4.registerBindableWidget(volume);
+    fp4.addControllerBinding(volume, 0, 7);
+
+    CHECK(fp4.controlledWidget(0, 7) == volume);
+    CHECK(fp4.controlledWidgetInfo(volume) == ControllerInfo(0, 7));
+
+    // the last bound controller of a widget is reported
+    fp4.addControllerBinding(volume, 1, 7);
+    CHECK(fp4.controlledWidgetInfo(volume) == ControllerInfo(1, 7));
+
+    fp4.deleteControllerBinding(1, 7);
+    CHECK(fp4.controlledWidget(1, 7) == 0);
+    CHECK(fp4.controlledWidgetInfo(volume) == ControllerInfo(0, 7));
+
+    delete volume;
+    fp4.clearBindings();
+}
+
+/* a controller bound to another widget is removed from the old widget */
+static void testRebind(FP4Qt& fp4) {
+    QSlider* first = createSlider("first");
+    QSlider* second = createSlider("second");
+    fp4.registerBindableWidget(first);
+    fp4.registerBindableWidget(second);
+
+    fp4.addControllerBinding(first, 0, 10);
+    fp4.updateControllerBinding(second, 0, 10);
+
+    CHECK(fp4.controlledWidget(0, 10) == second);
+    CHECK(fp4.controlledWidgetInfo(second) == ControllerInfo(0, 10));
+    CHECK(fp4.controlledWidgetInfo(first) == ControllerInfo::Invalid);
+
+    delete first;
+    delete second;
+    fp4.clearBindings();
+}
+
+/* a deleted widget is unbound, and bound again by name when a widget with
+   the same name is registered */
+static void testRecreate(FP4Qt& fp4) {
+    QSlider* pan = createSlider("pan");
+    fp4.registerBindableWidget(pan);
+    fp4.addControllerBinding(pan, 2, 10);
+
+    delete pan;
+    CHECK(fp4.controlledWidget(2, 10) == 0);
+    CHECK(!fp4.isControllerBound(ControllerInfo(2, 10)));
+
+    pan = createSlider("pan");
+    fp4.registerBindableWidget(pan);
+    CHECK(fp4.controlledWidget(2, 10) == pan);
+    CHECK(fp4.controlledWidgetInfo(pan) == ControllerInfo(2, 10));
+    CHECK(fp4.isControllerBound(ControllerInfo(2, 10)));
+
+    delete pan;
+    fp4.clearBindings();
+}
+
+/* a bound controller sets the widget at once, so its handlers run for every
+   value, and the widget is repainted on the next repaint interval. Other
+   controllers go to the output. */
+static void testIncoming(FP4Qt& fp4, LoopbackBackend* backend) {
+    QSlider* expression = createSlider("expression");
+    fp4.registerBindableWidget(expression);
+    fp4.addControllerBinding(expression, 0, 11);
+
+    int changes = 0;
+    QObject::connect(expression, &QSlider::valueChanged, [&changes]() { ++changes; });
+
+    backend->injectController(0, 11, 90);
+    backend->injectController(0, 11, 100);
+    backend->injectController(0, 12, 50);
+    fp4.processEvents();
+    CHECK(expression->value() == 100);
+    CHECK(changes == 2);
+    CHECK(!expression->updatesEnabled());
+    CHECK_EQUAL(takeOutput(backend), "cc12=50");
+
+    // showing the latest value again doesn't run the handlers
+    processGuiEvents(50);
+    CHECK(expression->value() == 100);
+    CHECK(changes == 2);
+    CHECK(expression->updatesEnabled());
+
+    delete expression;
+    fp4.clearBindings();
+}
+
+/* a binding deleted while its widget's repaint is held doesn't write to the
+   widget anymore */
+static void testDeleteHeld(FP4Qt& fp4, LoopbackBackend* backend) {
+    QSlider* balance = createSlider("balance");
+    fp4.registerBindableWidget(balance);
+    fp4.addControllerBinding(balance, 0, 8);
+
+    backend->injectController(0, 8, 70);
+    fp4.processEvents();
+    CHECK(!balance->updatesEnabled());
+
+    fp4.deleteControllerBinding(0, 8);
+    CHECK(balance->updatesEnabled());
+
+    balance->setValue(10);
+    processGuiEvents(50);
+    CHECK(balance->value() == 10);
+
+    delete balance;
+    fp4.clearBindings();
+}
+
+/* push buttons see every value, a press and release between two repaint
+   intervals still clicks */
+static void testButton(FP4Qt& fp4, LoopbackBackend* backend) {
+    QPushButton* button = new QPushButton;
+    button->setProperty("cc_group", "test");
+    button->setProperty("cc_name", "button");
+    fp4.registerBindableWidget(button);
+    fp4.addControllerBinding(button, 0, 80);
+
+    int clicks = 0;
+    QObject::connect(button, &QPushButton::clicked, [&clicks]() { ++clicks; });
+
+    backend->injectController(0, 80, 127);
+    backend->injectController(0, 80, 0);
+    fp4.processEvents();
+    CHECK(clicks == 1);
+
+    delete button;
+    fp4.clearBindings();
+}
+
+int main(int argc, char* argv[]) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    LoopbackBackend* backend = new LoopbackBackend;
+    FP4Qt fp4("bindingstest", 0, backend);
+
+    testBind(fp4);
+    testRebind(fp4);
+    testRecreate(fp4);
+    testIncoming(fp4, backend);
+    testDeleteHeld(fp4, backend);
+    testButton(fp4, backend);
+
+    return checkResult("bindings");
+}
@@ -0,0 +1,133 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Checks shared by the tests. A test is a console program that runs the
+   event pipeline of FP4 on a LoopbackBackend and returns the number of
+   failed checks, so "make check" fails when one of them does.
+*/
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "loopbackbackend.h"
+#include "fp4hw.h"
+#include <poll.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static int s_checkFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++s_checkFailures; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+    do { \
+        std::string a = (actual), e = (expected); \
+        if (a != e) { \
+            fprintf(stderr, "%s:%d: check failed: %s is \"%s\", expected \"%s\"\n", \
+                    __FILE__, __LINE__, #actual, a.c_str(), e.c_str()); \
+            ++s_checkFailures; \
+        } \
+    } while (0)
+
+static inline int checkResult(const char* test) {
+    if (s_checkFailures) {
+        fprintf(stderr, "%s: %i checks failed\n", test, s_checkFailures);
+    }
+    else {
+        printf("%s: passed\n", test);
+    }
+    return s_checkFailures;
+}
+
+/* captured output as text, for instance "on60 off60 cc123=0 pc5". Events on the
+   first channel leave the channel out, others are written "on60/2". */
+static inline std::string describe(const std::vector<LoopbackEvent>& events) {
+    std::string text;
+    char buffer[32];
+    for (size_t i=0; i<events.size(); ++i) {
+        const snd_seq_event_t& ev = events[i].event;
+        int channel;
+        switch (ev.type) {
+        case SND_SEQ_EVENT_NOTEON:
+            channel = ev.data.note.channel;
+            snprintf(buffer, sizeof(buffer), "on%i", ev.data.note.note);
+            break;
+        case SND_SEQ_EVENT_NOTEOFF:
+            channel = ev.data.note.channel;
+            snprintf(buffer, sizeof(buffer), "off%i", ev.data.note.note);
+            break;
+        case SND_SEQ_EVENT_CONTROLLER:
+            channel = ev.data.control.channel;
+            snprintf(buffer, sizeof(buffer), "cc%i=%i", (int)ev.data.control.param, ev.data.control.value);
+            break;
+        case SND_SEQ_EVENT_PGMCHANGE:
+            channel = ev.data.control.channel;
+            snprintf(buffer, sizeof(buffer), "pc%i", ev.data.control.value);
+            break;
+        case SND_SEQ_EVENT_SYSEX:
+            channel = 0;
+            snprintf(buffer, sizeof(buffer), "sysex%u", ev.data.ext.len);
+            break;
+        default:
+            channel = 0;
+            snprintf(buffer, sizeof(buffer), "event%i", ev.type);
+            break;
+        }
+
+        if (!text.empty()) {
+            text += " ";
+        }
+        text += buffer;
+        if (channel) {
+            snprintf(buffer, sizeof(buffer), "/%i", channel + 1);
+            text += buffer;
+        }
+    }
+    return text;
+}
+
+static inline std::string takeOutput(LoopbackBackend* backend) {
+    return describe(backend->takeOutput());
+}
+
+/* handle input of the backend for ms milliseconds, like MidiThread does */
+static inline void runFor(FP4& fp4, LoopbackBackend* backend, int ms) {
+    uint64_t end = LoopbackBackend::now() + ms * 1000;
+    for (;;) {
+        uint64_t now = LoopbackBackend::now();
+        if (now >= end) {
+            break;
+        }
+
+        struct pollfd pfd;
+        int count = backend->pollDescriptors(&pfd, 1);
+        poll(&pfd, count, (end - now + 999) / 1000);
+        fp4.processEvents();
+    }
+}
+
+#endif // CHECK_H
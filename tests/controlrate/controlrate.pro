@@ -0,0 +1,7 @@
+TARGET = controlratetest
+
+include(../tests.pri)
+
+SOURCES += \
+    controlratetest.cpp \
+    $$PWD/../../controlrateengine.cpp
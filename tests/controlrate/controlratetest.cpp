@@ -0,0 +1,109 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Ramps of the control rate engine, and how their output is thinned. Time is
+   passed in by the test, ticks are 5 ms apart like CONTROL_RATE_INTERVAL. */
+
+#include "check.h"
+#include "controlrateengine.h"
+
+#define TICK 5000
+
+static ControlRamp ramp(int id, int cc, int from, int to, uint64_t start, uint64_t duration) {
+    ControlRamp ramp = { id, 0, cc, from, to, start, duration, -1, -1 };
+    return ramp;
+}
+
+/* advance from time from to time to, and return what was sent as
+   "value@ms ..." */
+static std::string run(ControlRateEngine& engine, uint64_t from, uint64_t to) {
+    std::string sent;
+    char buffer[32];
+    for (uint64_t now=from; now<=to; now+=TICK) {
+        engine.advance(now, [&](int, int, int value) {
+            snprintf(buffer, sizeof(buffer), "%s%i@%i", sent.empty() ? "" : " ", value, (int)(now / 1000));
+            sent += buffer;
+        });
+    }
+    return sent;
+}
+
+/* without a rate limit a ramp sends every value it reaches, and ends */
+static void testRamp() {
+    ControlRateEngine engine;
+    engine.start(ramp(1, 7, 0, 4, 0, 20000));
+
+    CHECK_EQUAL(run(engine, 0, 30000), "0@0 1@5 2@10 3@15 4@20");
+    CHECK(engine.isIdle());
+    CHECK(engine.stats().sent == 5);
+}
+
+/* values held back by the rate limit count as limited once, when they are
+   replaced, not on every tick they wait */
+static void testLimited() {
+    ControlRateEngine engine;
+    engine.setMinInterval(20000);
+
+    // every tick has a new value, three of them are replaced before each send
+    engine.start(ramp(1, 7, 0, 127, 0, 100000));
+    CHECK_EQUAL(run(engine, 0, 120000), "0@0 25@20 51@40 76@60 102@80 127@100");
+    CHECK(engine.stats().limited == 15);
+
+    // a slow ramp waits on the same value, which is then sent
+    engine.resetStats();
+    engine.start(ramp(2, 8, 0, 2, 200000, 100000));
+    engine.setMinInterval(60000);
+    CHECK_EQUAL(run(engine, 200000, 330000), "0@200 1@260 2@320");
+    CHECK(engine.stats().limited == 0);
+    CHECK(engine.isIdle());
+}
+
+/* a ramp without duration sets the controller under the rate limit. A value
+   that is replaced or stopped before it is sent is dropped. */
+static void testSet() {
+    ControlRateEngine engine;
+    engine.setMinInterval(20000);
+
+    engine.start(ramp(1, 11, 10, 10, 0, 0));
+    CHECK_EQUAL(run(engine, 0, 0), "10@0");
+
+    engine.start(ramp(1, 11, 20, 20, 5000, 0));
+    CHECK_EQUAL(run(engine, 5000, 5000), "");
+    CHECK(!engine.isIdle());
+
+    engine.start(ramp(1, 11, 30, 30, 10000, 0));
+    CHECK(engine.stats().limited == 1);
+    CHECK_EQUAL(run(engine, 10000, 25000), "30@20");
+    CHECK(engine.isIdle());
+
+    engine.start(ramp(1, 11, 40, 40, 25000, 0));
+    CHECK_EQUAL(run(engine, 25000, 25000), "");
+    engine.stop(1);
+    CHECK(engine.stats().limited == 2);
+    CHECK(engine.isIdle());
+}
+
+int main() {
+    testRamp();
+    testLimited();
+    testSet();
+
+    return checkResult("controlrate");
+}
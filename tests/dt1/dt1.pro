@@ -0,0 +1,6 @@
+TARGET = dt1test
+
+include(../tests.pri)
+
+SOURCES += \
+    dt1test.cpp
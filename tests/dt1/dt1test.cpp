@@ -0,0 +1,102 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* DT1 messages sent by FP4 are captured by a LoopbackBackend and compared
+   byte by byte, checksum included. Sysex pacing is disabled, so every
+   message is captured when it is sent. */
+
+#include "check.h"
+#include "dt1message.h"
+
+/* captured sysex messages as hex, one "f0 41 ... f7" per message, separated
+   by " | " */
+static std::string sysexOutput(LoopbackBackend* backend) {
+    std::vector<LoopbackEvent> events = backend->takeOutput();
+    std::string text;
+    char buffer[4];
+    for (size_t i=0; i<events.size(); ++i) {
+        if (events[i].event.type != SND_SEQ_EVENT_SYSEX) {
+            continue;
+        }
+        if (!text.empty()) {
+            text += " | ";
+        }
+        for (size_t j=0; j<events[i].data.size(); ++j) {
+            snprintf(buffer, sizeof(buffer), j ? " %02x" : "%02x", events[i].data[j]);
+            text += buffer;
+        }
+    }
+    return text;
+}
+
+/* single byte writes take the fixed size path */
+static void testDataByte(FP4& fp4, LoopbackBackend* backend) {
+    fp4.sendDataByte(0x40, 0x00, 0x06, 0x40);
+    CHECK_EQUAL(sysexOutput(backend), "f0 41 10 42 12 40 00 06 40 7a f7");
+}
+
+/* a sum that is a multiple of 128 has checksum 0, not 0x80 */
+static void testChecksumWraps(FP4& fp4, LoopbackBackend* backend) {
+    fp4.sendDataByte(0x40, 0x01, 0x30, 0x0f);
+    CHECK_EQUAL(sysexOutput(backend), "f0 41 10 42 12 40 01 30 0f 00 f7");
+
+    unsigned char data[] = { 0x00, 0x7f, 0x01 };
+    fp4.sendData(0x40, 0x01, 0x31, data, 3);
+    CHECK_EQUAL(sysexOutput(backend), "f0 41 10 42 12 40 01 31 00 7f 01 0e f7");
+}
+
+/* writes longer than DT1_MAX_DATA are split at consecutive addresses, and
+   every message has its own checksum */
+static void testSplit(FP4& fp4, LoopbackBackend* backend) {
+    unsigned char data[DT1_MAX_DATA + 2];
+    memset(data, 0x01, sizeof(data));
+
+    fp4.sendData(0x48, 0x00, 0x00, data, sizeof(data));
+    std::vector<LoopbackEvent> events = backend->takeOutput();
+    CHECK(events.size() == 2);
+    if (events.size() != 2) {
+        return;
+    }
+
+    const std::vector<uint8_t>& first = events[0].data;
+    const std::vector<uint8_t>& second = events[1].data;
+    CHECK(first.size() == DT1_MAX_MESSAGE_SIZE);
+    CHECK(second.size() == DT1_MESSAGE_OVERHEAD + 2);
+
+    // 48 00 00 + 128 * 01, then 48 01 00 + 2 * 01
+    CHECK(first[5] == 0x48 && first[6] == 0x00 && first[7] == 0x00);
+    CHECK(first[first.size() - 2] == dt1Checksum(0x48 + DT1_MAX_DATA));
+    CHECK(second[5] == 0x48 && second[6] == 0x01 && second[7] == 0x00);
+    CHECK(second[second.size() - 2] == dt1Checksum(0x48 + 0x01 + 2));
+    CHECK(first.back() == 0xf7 && second.back() == 0xf7);
+}
+
+int main() {
+    LoopbackBackend* backend = new LoopbackBackend;
+    FP4 fp4("dt1test", backend);
+    fp4.setSysexBudget(0);
+    fp4.setMemoryMapEnabled(false);
+
+    testDataByte(fp4, backend);
+    testChecksumWraps(fp4, backend);
+    testSplit(fp4, backend);
+
+    return checkResult("dt1");
+}
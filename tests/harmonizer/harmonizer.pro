@@ -0,0 +1,7 @@
+TARGET = harmonizertest
+
+include(../tests.pri)
+
+SOURCES += \
+    harmonizertest.cpp \
+    $$PWD/../../harmonizer.cpp
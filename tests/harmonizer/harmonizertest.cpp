@@ -0,0 +1,151 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* The harmonizer moves a chord shape along the scale, in steps of the scale
+   it was given, whatever its size. */
+
+#include "check.h"
+#include "harmonizer.h"
+
+/* voices of a note as text, for instance "60 64 67" */
+static std::string voices(const Harmonizer& harmonizer, int note) {
+    const uint8_t* notes;
+    int count = harmonizer.voices(note, notes);
+
+    std::string text;
+    char buffer[8];
+    for (int i=0; i<count; ++i) {
+        snprintf(buffer, sizeof(buffer), i ? " %i" : "%i", notes[i]);
+        text += buffer;
+    }
+    return text;
+}
+
+static std::vector<int> notes(int a, int b, int c) {
+    std::vector<int> list;
+    list.push_back(a);
+    list.push_back(b);
+    list.push_back(c);
+    return list;
+}
+
+/* a major triad in C major is major, minor or diminished by degree */
+static void testMajorScale() {
+    static const int major[] = { 0, 2, 4, 5, 7, 9, 11 };
+
+    Harmonizer harmonizer;
+    harmonizer.setRoot(0);
+    harmonizer.setScale(std::vector<int>(major, major + 7));
+    harmonizer.setChord(notes(48, 52, 55));
+    harmonizer.rebuild();
+
+    CHECK_EQUAL(voices(harmonizer, 60), "60 64 67");
+    CHECK_EQUAL(voices(harmonizer, 62), "62 65 69");
+    CHECK_EQUAL(voices(harmonizer, 71), "71 74 77");
+    CHECK_EQUAL(voices(harmonizer, 0), "0 4 7");
+
+    // outside the scale: like the note below, a semitone up
+    CHECK_EQUAL(voices(harmonizer, 61), "61 65 68");
+
+    // voices above 127 are left out
+    CHECK_EQUAL(voices(harmonizer, 127), "127");
+
+    CHECK(harmonizer.intervalSteps(4) == 2);
+    CHECK(harmonizer.intervalSteps(7) == 4);
+    CHECK(harmonizer.intervalSteps(16) == 9);
+}
+
+/* intervals keep their diatonic size: a minor triad in a major scale is
+   stacked in thirds, not seconds */
+static void testMinorTriad() {
+    static const int major[] = { 0, 2, 4, 5, 7, 9, 11 };
+
+    Harmonizer harmonizer;
+    harmonizer.setRoot(0);
+    harmonizer.setScale(std::vector<int>(major, major + 7));
+    harmonizer.setChord(notes(48, 51, 55));
+    harmonizer.rebuild();
+
+    CHECK(harmonizer.intervalSteps(3) == 2);
+    CHECK_EQUAL(voices(harmonizer, 60), "60 64 67");
+    CHECK_EQUAL(voices(harmonizer, 62), "62 65 69");
+    CHECK_EQUAL(voices(harmonizer, 69), "69 72 76");
+}
+
+/* in Lydian a perfect fourth is still a fourth, the raised one on the root */
+static void testLydianFourth() {
+    static const int lydian[] = { 0, 2, 4, 6, 7, 9, 11 };
+
+    Harmonizer harmonizer;
+    harmonizer.setRoot(0);
+    harmonizer.setScale(std::vector<int>(lydian, lydian + 7));
+    harmonizer.setChord(notes(48, 53, 60));
+    harmonizer.rebuild();
+
+    CHECK(harmonizer.intervalSteps(5) == 3);
+    CHECK_EQUAL(voices(harmonizer, 60), "60 66 72");
+    CHECK_EQUAL(voices(harmonizer, 62), "62 67 74");
+}
+
+/* the root moves the scale */
+static void testRoot() {
+    static const int minor[] = { 0, 2, 3, 5, 7, 8, 10 };
+
+    Harmonizer harmonizer;
+    harmonizer.setRoot(9);
+    harmonizer.setScale(std::vector<int>(minor, minor + 7));
+    harmonizer.setChord(notes(48, 52, 55));
+    harmonizer.rebuild();
+
+    CHECK_EQUAL(voices(harmonizer, 57), "57 60 64");
+    CHECK_EQUAL(voices(harmonizer, 64), "64 67 71");
+}
+
+/* intervals are counted in steps of a scale that has no 7 degrees */
+static void testPentatonic() {
+    static const int pentatonic[] = { 0, 2, 4, 7, 9 };
+
+    Harmonizer harmonizer;
+    harmonizer.setRoot(0);
+    harmonizer.setScale(std::vector<int>(pentatonic, pentatonic + 5));
+    harmonizer.setChord(notes(48, 52, 55));
+    harmonizer.rebuild();
+
+    CHECK(harmonizer.intervalSteps(7) == 3);
+    CHECK(harmonizer.intervalSteps(12) == 5);
+
+    CHECK_EQUAL(voices(harmonizer, 60), "60 64 67");
+    CHECK_EQUAL(voices(harmonizer, 62), "62 67 69");
+    CHECK_EQUAL(voices(harmonizer, 69), "69 74 76");
+
+    // a minor third is nearest to the third degree, a seventh to the octave
+    CHECK(harmonizer.intervalSteps(3) == 2);
+    CHECK(harmonizer.intervalSteps(11) == 5);
+}
+
+int main() {
+    testMajorScale();
+    testMinorTriad();
+    testLydianFourth();
+    testRoot();
+    testPentatonic();
+
+    return checkResult("harmonizer");
+}
@@ -0,0 +1,6 @@
+TARGET = notestest
+
+include(../tests.pri)
+
+SOURCES += \
+    notestest.cpp
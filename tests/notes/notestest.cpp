@@ -0,0 +1,128 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* FP4 counts the holds of every sounding note, so a note played twice is
+   only released by the last note off, and the channel mode messages drop
+   the holds of the notes they stop. NoteTracker is also checked on its own
+   for several sources. */
+
+#include "check.h"
+#include "notetracker.h"
+
+/* the note off is sent when the last hold is released */
+static void testHolds(FP4& fp4, LoopbackBackend* backend) {
+    fp4.sendNoteOn(0, 60, 100);
+    CHECK_EQUAL(takeOutput(backend), "on60");
+
+    // a second note on retriggers the note
+    fp4.sendNoteOn(0, 60, 100);
+    CHECK_EQUAL(takeOutput(backend), "off60 on60");
+
+    fp4.sendNoteOff(0, 60);
+    CHECK_EQUAL(takeOutput(backend), "");
+    CHECK(fp4.isKeyPressed(0, 60));
+
+    fp4.sendNoteOff(0, 60);
+    CHECK_EQUAL(takeOutput(backend), "off60");
+    CHECK(!fp4.isKeyPressed(0, 60));
+
+    // a note off for a note that isn't tracked is still sent
+    fp4.sendNoteOff(0, 60);
+    CHECK_EQUAL(takeOutput(backend), "off60");
+}
+
+/* one note off per sounding note, whatever the number of holds */
+static void testNotesOff(FP4& fp4, LoopbackBackend* backend) {
+    fp4.sendNoteOn(0, 1, 100);
+    fp4.sendNoteOn(0, 100, 100);
+    fp4.sendNoteOn(0, 100, 100);
+    fp4.sendNoteOn(1, 50, 100);
+    backend->takeOutput();
+
+    fp4.sendNotesOff(0);
+    CHECK_EQUAL(takeOutput(backend), "off1 off100");
+
+    fp4.sendNotesOff(0);
+    CHECK_EQUAL(takeOutput(backend), "");
+
+    fp4.sendNotesOff(1);
+    CHECK_EQUAL(takeOutput(backend), "off50/2");
+}
+
+/* All Notes Off and All Sounds Off drop the holds of the channel, so the
+   next note on is not a retrigger and a single note off releases it */
+static void testChannelMode(FP4& fp4, LoopbackBackend* backend) {
+    fp4.sendNoteOn(0, 60, 100);
+    fp4.sendNoteOn(0, 60, 100);
+    backend->takeOutput();
+
+    fp4.sendAllNotesOff(0);
+    CHECK_EQUAL(takeOutput(backend), "cc123=0");
+    CHECK(!fp4.isKeyPressed(0, 60));
+
+    fp4.sendNoteOn(0, 60, 100);
+    CHECK_EQUAL(takeOutput(backend), "on60");
+    fp4.sendNoteOff(0, 60);
+    CHECK_EQUAL(takeOutput(backend), "off60");
+
+    fp4.sendNoteOn(1, 62, 100);
+    fp4.sendAllSoundsOff(1);
+    fp4.sendNoteOn(1, 62, 100);
+    fp4.sendNoteOff(1, 62);
+    CHECK_EQUAL(takeOutput(backend), "on62/2 cc120=0/2 on62/2 off62/2");
+}
+
+/* holds are counted per source, releaseAll() only drops those of one source */
+static void testTrackerSources() {
+    NoteTracker<4> tracker;
+
+    CHECK(tracker.press(3, 1, 5) == 0);
+    CHECK(tracker.press(3, 1, 5) == 1);
+    CHECK(tracker.press(2, 1, 5) == 2);
+    CHECK(tracker.press(3, 1, 70) == 0);
+
+    std::string released;
+    char buffer[32];
+    tracker.releaseAll(3, 1, [&](int note, int count) {
+        snprintf(buffer, sizeof(buffer), "%s%ix%i", released.empty() ? "" : " ", note, count);
+        released += buffer;
+    });
+    CHECK_EQUAL(released, "5x2 70x1");
+
+    CHECK(tracker.holds(1, 5) == 1);
+    CHECK(tracker.isSounding(1, 5));
+    CHECK(!tracker.isSounding(1, 70));
+
+    CHECK(tracker.release(3, 1, 5) == -1);
+    CHECK(tracker.release(2, 1, 5) == 0);
+    CHECK(!tracker.isSounding(1, 5));
+}
+
+int main() {
+    LoopbackBackend* backend = new LoopbackBackend;
+    FP4 fp4("notestest", backend);
+
+    testHolds(fp4, backend);
+    testNotesOff(fp4, backend);
+    testChannelMode(fp4, backend);
+    testTrackerSources();
+
+    return checkResult("notes");
+}
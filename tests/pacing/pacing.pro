@@ -0,0 +1,6 @@
+TARGET = pacingtest
+
+include(../tests.pri)
+
+SOURCES += \
+    pacingtest.cpp
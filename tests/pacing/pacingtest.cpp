@@ -0,0 +1,67 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Sysex over the budget is queued, but channel messages don't overtake it.
+   The messages FP4Win::sendInitData() and restoreFP4Settings() send are
+   replayed with the default budget. */
+
+#include "check.h"
+#include "config.h"
+#include <unistd.h>
+
+/* the GS reset doesn't fit in the budget left by the identity request. It
+   must still reach the piano before the settings it would wipe. */
+static void testInitData(FP4& fp4, LoopbackBackend* backend) {
+    fp4.sendIdentityRequest();
+    fp4.sendGSReset();
+    CHECK_EQUAL(takeOutput(backend), "sysex6");
+
+    fp4.sendLocalControl(0, false);
+    fp4.sendBankChange(0, 0, 0);
+    fp4.sendProgramChange(0, 5);
+    fp4.sendController(0, 7, 100);
+    CHECK_EQUAL(takeOutput(backend), "sysex11 cc122=0 cc0=0 cc32=0 pc5 cc7=100");
+    CHECK(fp4.outputQueueTimeout() == -1);
+}
+
+/* sysex alone is still paced */
+static void testPaced(FP4& fp4, LoopbackBackend* backend) {
+    usleep(10000);
+
+    fp4.sendGSReset();
+    fp4.sendGSReset();
+    CHECK_EQUAL(takeOutput(backend), "sysex11");
+    CHECK(fp4.outputQueueTimeout() >= 0);
+
+    usleep(10000);
+    fp4.processOutputQueue();
+    CHECK_EQUAL(takeOutput(backend), "sysex11");
+}
+
+int main() {
+    LoopbackBackend* backend = new LoopbackBackend;
+    FP4 fp4("pacingtest", backend);
+    fp4.setSysexBudget(DEFAULT_SYSEX_BYTES_PER_MS);
+
+    testInitData(fp4, backend);
+    testPaced(fp4, backend);
+
+    return checkResult("pacing");
+}
@@ -0,0 +1,6 @@
+TARGET = parameterstest
+
+include(../tests.pri)
+
+SOURCES += \
+    parameterstest.cpp
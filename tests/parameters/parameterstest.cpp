@@ -0,0 +1,70 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* FP4 remembers the controllers it sent, so parameter selections and
+   14-bit MSBs the FP4 already holds are not sent again. Every message that
+   changes them must be remembered, or a later message is sent to the wrong
+   parameter. */
+
+#include "check.h"
+
+/* the pitch range leaves the null RPN selected */
+static void testPitchRange(FP4& fp4, LoopbackBackend* backend) {
+    fp4.sendRPN(0, 0, 0, 10);
+    CHECK_EQUAL(takeOutput(backend), "cc100=0 cc101=0 cc6=10");
+
+    fp4.sendRPN(0, 0, 0, 11);
+    CHECK_EQUAL(takeOutput(backend), "cc6=11");
+
+    // RPN 0 is the pitch range, it is selected already
+    fp4.sendPitchRange(0, 2);
+    CHECK_EQUAL(takeOutput(backend), "cc6=2 cc38=0 cc100=127 cc101=127");
+
+    fp4.sendRPN(0, 0, 0, 12);
+    CHECK_EQUAL(takeOutput(backend), "cc100=0 cc101=0 cc6=12");
+
+    fp4.sendPitchRange(0, 30);
+    CHECK_EQUAL(takeOutput(backend), "cc6=24 cc38=0 cc100=127 cc101=127");
+
+    fp4.sendPitchRange(0, 3);
+    CHECK_EQUAL(takeOutput(backend), "cc100=0 cc101=0 cc6=3 cc38=0 cc100=127 cc101=127");
+}
+
+/* a bank change sets the bank select MSB and LSB */
+static void testBankChange(FP4& fp4, LoopbackBackend* backend) {
+    fp4.sendControllerHires(1, 0, (1 << 7) | 2);
+    CHECK_EQUAL(takeOutput(backend), "cc0=1/2 cc32=2/2");
+
+    fp4.sendBankChange(1, 3, 4);
+    CHECK_EQUAL(takeOutput(backend), "cc0=3/2 cc32=4/2");
+
+    fp4.sendControllerHires(1, 0, (1 << 7) | 2);
+    CHECK_EQUAL(takeOutput(backend), "cc0=1/2 cc32=2/2");
+}
+
+int main() {
+    LoopbackBackend* backend = new LoopbackBackend;
+    FP4 fp4("parameterstest", backend);
+
+    testPitchRange(fp4, backend);
+    testBankChange(fp4, backend);
+
+    return checkResult("parameters");
+}
@@ -0,0 +1,6 @@
+TARGET = schedulingtest
+
+include(../tests.pri)
+
+SOURCES += \
+    schedulingtest.cpp
@@ -0,0 +1,115 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* Notes scheduled on the output queue come back to FP4 when they are due and
+   are counted with the notes played directly, and cancelled tags don't play
+   anymore. The output queue is emulated by LoopbackBackend. */
+
+#include "check.h"
+#include <unistd.h>
+
+/* a scheduled note off doesn't cut a note the player holds */
+static void testPlayerHoldsNote(FP4& fp4, LoopbackBackend* backend) {
+    int tag = fp4.allocateScheduleTag();
+
+    fp4.sendNoteOn(0, 60, 100);
+    fp4.sendNoteOnAt(2000, 0, 60, 90, tag);
+    fp4.sendNoteOffAt(6000, 0, 60, tag);
+    CHECK_EQUAL(takeOutput(backend), "on60");
+
+    runFor(fp4, backend, 20);
+    CHECK_EQUAL(takeOutput(backend), "off60 on60");
+    CHECK(fp4.isKeyPressed(0, 60));
+
+    fp4.sendNoteOff(0, 60);
+    CHECK_EQUAL(takeOutput(backend), "off60");
+    CHECK(!fp4.isKeyPressed(0, 60));
+}
+
+/* a note off of the player doesn't cut a scheduled note */
+static void testPlayerReleasesNote(FP4& fp4, LoopbackBackend* backend) {
+    int tag = fp4.allocateScheduleTag();
+
+    fp4.sendNoteOnAt(0, 0, 62, 90, tag);
+    runFor(fp4, backend, 5);
+    CHECK_EQUAL(takeOutput(backend), "on62");
+
+    fp4.sendNoteOff(0, 62);
+    CHECK_EQUAL(takeOutput(backend), "");
+
+    fp4.cancelScheduled(tag);
+    fp4.releaseScheduledNotes(0);
+    CHECK_EQUAL(takeOutput(backend), "off62");
+}
+
+/* cancelled notes are removed from the queue, playing ones are released */
+static void testCancel(FP4& fp4, LoopbackBackend* backend) {
+    int tag = fp4.allocateScheduleTag();
+
+    fp4.sendNoteOnAt(1000, 1, 64, 90, tag);
+    fp4.sendNoteOffAt(40000, 1, 64, tag);
+    fp4.sendNoteOnAt(50000, 1, 65, 90, tag);
+    fp4.sendNoteOffAt(60000, 1, 65, tag);
+    runFor(fp4, backend, 10);
+    CHECK_EQUAL(takeOutput(backend), "on64/2");
+
+    fp4.cancelScheduled(tag);
+    CHECK(backend->scheduledCount() == 0);
+
+    fp4.releaseScheduledNotes(1);
+    CHECK_EQUAL(takeOutput(backend), "off64/2");
+
+    runFor(fp4, backend, 70);
+    CHECK_EQUAL(takeOutput(backend), "");
+}
+
+/* a note that was delivered but not read when its tag was cancelled is
+   dropped */
+static void testCancelDelivered(FP4& fp4, LoopbackBackend* backend) {
+    int tag = fp4.allocateScheduleTag();
+    int other = fp4.allocateScheduleTag();
+
+    fp4.sendNoteOnAt(1000, 2, 67, 90, tag);
+    fp4.sendNoteOnAt(1000, 2, 69, 90, other);
+    usleep(3000);
+    CHECK(backend->inputPending());
+
+    fp4.cancelScheduled(tag);
+    fp4.processEvents();
+    CHECK_EQUAL(takeOutput(backend), "on69/3");
+
+    fp4.sendNoteOffAt(0, 2, 67, tag);
+    fp4.sendNoteOffAt(0, 2, 69, other);
+    runFor(fp4, backend, 5);
+    CHECK_EQUAL(takeOutput(backend), "off69/3");
+}
+
+int main() {
+    LoopbackBackend* backend = new LoopbackBackend;
+    FP4 fp4("schedulingtest", backend);
+    CHECK(fp4.hasQueue());
+
+    testPlayerHoldsNote(fp4, backend);
+    testPlayerReleasesNote(fp4, backend);
+    testCancel(fp4, backend);
+    testCancelDelivered(fp4, backend);
+
+    return checkResult("scheduling");
+}
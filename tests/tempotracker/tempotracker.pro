@@ -0,0 +1,6 @@
+TARGET = tempotrackertest
+
+include(../tests.pri)
+
+SOURCES += \
+    tempotrackertest.cpp
@@ -0,0 +1,98 @@
+/******************************************************************************
+
+Copyright 2011-2013 Martijn van der Kwast <martijn@vdkwast.com>
+
+This file is part of FP4-Manager
+
+FP4-Manager is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+FP4-Manager is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+FP4 Manager. If not, see http://www.gnu.org/licenses/.
+
+******************************************************************************/
+
+/* TempoTracker follows jittered MIDI clock, predicts the next beat, and
+   follows a tempo change. tempotracker.cpp is part of the core in
+   tests.pri. */
+
+#include "check.h"
+#include "tempotracker.h"
+#include <math.h>
+
+// start time of the clock, in us
+static const uint64_t START = 1000000;
+
+/* send ticks at bpm with up to 2 ms of jitter, starting after the tick at
+   time. Returns the time of the last tick without jitter. */
+static uint64_t sendClock(TempoTracker& tracker, uint64_t time, double bpm, int ticks) {
+    double period = 60e6 / (bpm * MIDI_CLOCK_PPQ);
+    for (int i=1; i<=ticks; ++i) {
+        tracker.clock(time + (uint64_t)(i * period) + (i * 7 % 3) * 1000);
+    }
+    return time + (uint64_t)(ticks * period);
+}
+
+/* the tempo is known after a few beats, and beats fall on every 24 ticks */
+static void testLock(TempoTracker& tracker) {
+    tracker.start();
+    tracker.clock(START);
+    CHECK(!tracker.isLocked());
+
+    uint64_t time = sendClock(tracker, START, 120, 4 * MIDI_CLOCK_PPQ);
+    CHECK(tracker.isLocked());
+    CHECK(tracker.isRunning());
+    CHECK(fabs(tracker.tempo() - 120) < 1);
+
+    // the last tick was on a beat, the next one is half a second later
+    double phase = tracker.beatPhase(time + 1000);
+    CHECK(phase < 0.02 || phase > 0.98);
+
+    int64_t next = (int64_t)tracker.nextBeatTime(time + 1000) - (int64_t)time;
+    CHECK(next > 490000 && next < 510000);
+
+    double beats = 0;
+    CHECK(tracker.position(time, beats));
+    CHECK(fabs(beats - 4) < 0.05);
+}
+
+/* a tempo change is followed within a few beats */
+static void testTempoChange(TempoTracker& tracker) {
+    uint64_t time = sendClock(tracker, START, 120, 4 * MIDI_CLOCK_PPQ);
+    sendClock(tracker, time, 140, 8 * MIDI_CLOCK_PPQ);
+    CHECK(fabs(tracker.tempo() - 140) < 1);
+}
+
+/* no beat is predicted once stopped, or once the clock went away */
+static void testStop(TempoTracker& tracker) {
+    uint64_t time = sendClock(tracker, START, 120, 4 * MIDI_CLOCK_PPQ);
+    tracker.stop();
+    CHECK(!tracker.isRunning());
+    CHECK(tracker.nextBeatTime(time) == 0);
+
+    // a gap of a beat drops the lock
+    tracker.clock(time + 500000);
+    CHECK(!tracker.isLocked());
+    CHECK(tracker.tempo() == 0);
+}
+
+int main() {
+    TempoTracker tracker;
+    testLock(tracker);
+
+    tracker.reset();
+    tracker.start();
+    testTempoChange(tracker);
+
+    tracker.reset();
+    tracker.start();
+    testStop(tracker);
+
+    return checkResult("tempotracker");
+}
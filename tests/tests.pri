@@ -0,0 +1,24 @@
+# The MIDI core of FP4 Manager without the GUI, shared by the tests.
+
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+
+SOURCES += \
+    $$PWD/../fp4hw.cpp \
+    $$PWD/../fp4memorymap.cpp \
+    $$PWD/../dt1transaction.cpp \
+    $$PWD/../sysexpacer.cpp \
+    $$PWD/../tempotracker.cpp \
+    $$PWD/../latencystats.cpp \
+    $$PWD/../alsaseqbackend.cpp \
+    $$PWD/../loopbackbackend.cpp
+
+HEADERS += \
+    $$PWD/check.h
+
+QMAKE_CXXFLAGS += -std=c++0x
+LIBS += -lasound -lpthread
@@ -0,0 +1,17 @@
+# Tests of the MIDI core, run with "make check". They don't need a
+# sequencer or a device, events go through a LoopbackBackend. The bindings
+# test runs FP4Qt with the offscreen Qt platform.
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    scheduling \
+    batching \
+    controlrate \
+    notes \
+    dt1 \
+    bindings \
+    harmonizer \
+    tempotracker \
+    pacing \
+    parameters
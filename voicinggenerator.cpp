@@ -22,16 +22,23 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 #include "chordselecterdialog.h"
 #include "fp4qt.h"
 #include "musictheory.h"
+#include "fp4managerapplication.h"
 #include <QtWidgets>
+#include <algorithm>
 
 VoicingGenerator::VoicingGenerator(FP4Qt *fp4, int channel, QWidget *parent) :
     ControllerGenerator(fp4, channel, parent),
-    m_lastNote(0)
+    m_presetIsModified(false)
 {
+    memset(m_playedVoiceCount, 0, sizeof(m_playedVoiceCount));
+    memset(m_playedChannel, 0, sizeof(m_playedChannel));
 }
 
 QString VoicingGenerator::description() const {
-    return QString("<p>Harmonize the played notes.</p>");
+    return QString("<p>Harmonize the played notes. The chord is moved along the scale, so its "
+                   "intervals follow the scale degree of each played note.</p>"
+                   "<p>Voices go straight to the output channel, without splits, mappings or "
+                   "other generators.</p>");
 }
 
 QString VoicingGenerator::configName() const {
@@ -49,7 +56,7 @@ QWidget *VoicingGenerator::buildOptionsWidget() {
     layout->addWidget(channelLabel, 0, 0);
     m_outputChannelSpinBox = new QSpinBox;
     m_outputChannelSpinBox->setRange(1, 16);
-    m_outputChannelSpinBox->setValue(m_channel);
+    m_outputChannelSpinBox->setValue(m_channel+1);
     channelLabel->setBuddy(m_outputChannelSpinBox);
     layout->addWidget(m_outputChannelSpinBox, 0, 1);
 
@@ -74,16 +81,14 @@ QWidget *VoicingGenerator::buildOptionsWidget() {
     QHBoxLayout* scaleHBox = new QHBoxLayout;
     scaleHBox->setMargin(0);
     scaleWidget->setLayout(scaleHBox);
-    QComboBox* m_rootCombo = new QComboBox;
-    QStringList rootNotes;
-    rootNotes << "A" << "A#" << "B" << "B" << "C" << "C#" << "D" << "D#" << "E" << "F" << "F#" << "G" << "G#";
-    m_rootCombo->addItems(rootNotes);
+    m_rootCombo = new QComboBox;
+    for (int note=0; note<12; ++note) {
+        m_rootCombo->addItem(MusicTheory::noteName(note));
+    }
     scaleLabel->setBuddy(m_rootCombo);
     scaleHBox->addWidget(m_rootCombo);
     m_scaleCombo = new QComboBox;
-    QStringList scales;
-    scales << "Ionian" << "Dorian" << "Phrygian" << "Lydian" << "Mixolydian" << "Aeolian" << "Locrian";
-    m_scaleCombo->addItems(scales);
+    loadScales();
     scaleHBox->addWidget(m_scaleCombo);
     scaleHBox->addStretch();
     layout->addWidget(scaleWidget, 2, 1);
@@ -98,27 +103,92 @@ QWidget *VoicingGenerator::buildOptionsWidget() {
 
     m_configMap["Output Channel"] = m_outputChannelSpinBox;
     m_configMap["Velocity Percentage"] = m_velocitySlider;
+    m_configMap["Root"] = m_rootCombo;
+    m_configMap["Scale"] = m_scaleCombo;
+
+    connect(m_rootCombo, SIGNAL(currentIndexChanged(int)), SLOT(updateVoicings()));
+    connect(m_scaleCombo, SIGNAL(currentIndexChanged(int)), SLOT(updateVoicings()));
+    updateVoicings();
 
     return widget;
 }
 
+/* The modes of the major scale, followed by the presets of scales.ini. A
+   preset is a list of semitones from the root. */
+void VoicingGenerator::loadScales() {
+    static const int major[7] = { 0, 2, 4, 5, 7, 9, 11 };
+    QStringList modes;
+    modes << "Ionian" << "Dorian" << "Phrygian" << "Lydian" << "Mixolydian" << "Aeolian" << "Locrian";
+
+    for (int mode=0; mode<7; ++mode) {
+        QList<int> scale;
+        for (int degree=0; degree<7; ++degree) {
+            scale << (major[(mode + degree) % 7] - major[mode] + 12) % 12;
+        }
+        m_scales << scale;
+        m_scaleCombo->addItem(modes.at(mode));
+    }
+
+    QSettings settings(FP4App()->scalesFile(), QSettings::IniFormat);
+
+    foreach(const QString& presetName, settings.childKeys()) {
+        QList<int> scale;
+        foreach(const QString& semitones, settings.value(presetName).toStringList()) {
+            int value = semitones.toInt();
+            if (value >= 0 && value < 12 && !scale.contains(value)) {
+                scale << value;
+            }
+        }
+        if (scale.isEmpty()) {
+            continue;
+        }
+        std::sort(scale.begin(), scale.end());
+
+        m_scales << scale;
+        m_scaleCombo->addItem(presetName);
+    }
+}
+
+/* rebuild the voicing table of the harmonizer. Held voices are released
+   first, they may not belong to the new scale or chord. */
+void VoicingGenerator::updateVoicings() {
+    int scaleIndex = m_scaleCombo->currentIndex();
+    if (scaleIndex < 0 || scaleIndex >= m_scales.count()) {
+        return;
+    }
+
+    releaseNotes();
+
+    m_harmonizer.setRoot(m_rootCombo->currentIndex());
+    m_harmonizer.setScale(m_scales.at(scaleIndex).toVector().toStdVector());
+    m_harmonizer.setChord(m_chordNotes.toVector().toStdVector());
+    m_harmonizer.rebuild();
+}
+
 void VoicingGenerator::onNoteOnEvent(int channel, int note, int velocity) {
     if (channel != m_channel) {
         return;
     }
 
-    releaseNotes();
+    releaseNote(note);
 
-    int scaleNote = MusicTheory::noteNumber(note);
     int outVelocity = velocity * m_velocitySlider->value() / 100;
+    if (outVelocity <= 0) {
+        return;
+    }
+
+    const uint8_t* voices;
+    int count = m_harmonizer.voices(note, voices);
+    int outputChannel = m_outputChannelSpinBox->value()-1;
 
-    foreach(int chordNote, m_chordNotes) {
-        int play = chordNote + scaleNote;
-        m_playedNotes << play;
-        m_fp4->onNoteOn(m_outputChannelSpinBox->value(), play, outVelocity);
+    FP4OutputBatch batch(m_fp4);
+    for (int i=0; i<count; ++i) {
+        m_fp4->sendNoteOn(outputChannel, voices[i], outVelocity);
     }
 
-    m_lastNote = note;
+    memcpy(m_playedVoices[note], voices, count);
+    m_playedVoiceCount[note] = count;
+    m_playedChannel[note] = outputChannel;
 }
 
 void VoicingGenerator::onNoteOffEvent(int channel, int note) {
@@ -126,11 +196,7 @@ void VoicingGenerator::onNoteOffEvent(int channel, int note) {
         return;
     }
 
-    if (note != m_lastNote) {
-        return;
-    }
-
-    releaseNotes();
+    releaseNote(note);
 }
 
 void VoicingGenerator::onEnabledStateChange(bool enabled) {
@@ -169,15 +235,25 @@ void VoicingGenerator::onEditChordPressed() {
 
             m_chordLabel->setText(noteNames.join(" "));
         }
+
+        updateVoicings();
     }
 
     delete dlg;
 }
 
+/* release the voices of a played note */
+void VoicingGenerator::releaseNote(int note) {
+    FP4OutputBatch batch(m_fp4);
+    for (int i=0; i<m_playedVoiceCount[note]; ++i) {
+        m_fp4->sendNoteOff(m_playedChannel[note], m_playedVoices[note][i]);
+    }
+    m_playedVoiceCount[note] = 0;
+}
+
 void VoicingGenerator::releaseNotes() {
-    foreach(int note, m_playedNotes) {
-        m_fp4->onNoteOff(m_outputChannelSpinBox->value(), note);
+    for (int note=0; note<128; ++note) {
+        releaseNote(note);
     }
-    m_playedNotes.clear();
 }
 
@@ -22,6 +22,7 @@ FP4 Manager. If not, see http://www.gnu.org/licenses/.
 #define VOICINGGENERATOR_H
 
 #include "controllergenerator.h"
+#include "harmonizer.h"
 #include <QList>
 
 class FP4Qt;
@@ -47,8 +48,11 @@ protected slots:
     void onEnabledStateChange(bool enabled);
 
     void onEditChordPressed();
+    void updateVoicings();
 
 private:
+    void loadScales();
+    void releaseNote(int note);
     void releaseNotes();
 
 private:
@@ -62,8 +66,14 @@ private:
     QList<int> m_chordNotes;
     bool m_presetIsModified;
 
-    QList<int> m_playedNotes;
-    int m_lastNote;
+    // semitones of each scale in m_scaleCombo
+    QList<QList<int> > m_scales;
+    Harmonizer m_harmonizer;
+
+    // voices sent for each played note, and their channel
+    uint8_t m_playedVoices[128][HARMONIZER_MAX_VOICES];
+    uint8_t m_playedVoiceCount[128];
+    int m_playedChannel[128];
 };
 
 #endif